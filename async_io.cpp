@@ -0,0 +1,156 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include "async_io.h"
+
+namespace basecode {
+
+    async_io_loop::~async_io_loop() {
+        for (const auto& timer : _timers)
+            close(timer.first);
+        _timers.clear();
+
+        if (_event_fd != -1) {
+            close(_event_fd);
+            _event_fd = -1;
+        }
+
+        if (_epoll_fd != -1) {
+            close(_epoll_fd);
+            _epoll_fd = -1;
+        }
+    }
+
+    size_t async_io_loop::pending() const {
+        return _timers.size() + _ready.size();
+    }
+
+    bool async_io_loop::initialize(result& r) {
+        _epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (_epoll_fd == -1) {
+            r.add_message("A001", "unable to create epoll instance.", true);
+            return false;
+        }
+
+        _event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (_event_fd == -1) {
+            r.add_message("A001", "unable to create completion eventfd.", true);
+            return false;
+        }
+
+        epoll_event event {};
+        event.events = EPOLLIN;
+        event.data.fd = _event_fd;
+        if (epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, _event_fd, &event) != 0) {
+            r.add_message("A001", "unable to register completion eventfd.", true);
+            return false;
+        }
+
+        return true;
+    }
+
+    size_t async_io_loop::poll(int timeout_milliseconds) {
+        epoll_event events[16];
+        auto count = epoll_wait(_epoll_fd, events, 16, timeout_milliseconds);
+
+        size_t completed = 0;
+        for (int i = 0; i < count; i++) {
+            auto fd = events[i].data.fd;
+            if (fd == _event_fd) {
+                uint64_t value;
+                while (::read(_event_fd, &value, sizeof(value)) > 0) {
+                }
+                continue;
+            }
+
+            auto it = _timers.find(fd);
+            if (it == _timers.end())
+                continue;
+
+            uint64_t expirations = 0;
+            auto rc = ::read(fd, &expirations, sizeof(expirations));
+
+            auto callback = it->second;
+            epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+            close(fd);
+            _timers.erase(it);
+
+            callback(rc == sizeof(expirations) ? static_cast<int64_t>(expirations) : -1);
+            completed++;
+        }
+
+        std::deque<std::pair<completion_callable, int64_t>> ready;
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            ready.swap(_ready);
+        }
+        for (const auto& completion : ready) {
+            completion.first(completion.second);
+            completed++;
+        }
+
+        return completed;
+    }
+
+    bool async_io_loop::add_timer(
+            result& r,
+            uint64_t milliseconds,
+            const completion_callable& callback) {
+        auto fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+        if (fd == -1) {
+            r.add_message("A002", "unable to create timerfd.", true);
+            return false;
+        }
+
+        itimerspec spec {};
+        spec.it_value.tv_sec = static_cast<time_t>(milliseconds / 1000);
+        spec.it_value.tv_nsec = static_cast<long>((milliseconds % 1000) * 1000000);
+        if (milliseconds == 0)
+            spec.it_value.tv_nsec = 1;
+
+        epoll_event event {};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        if (timerfd_settime(fd, 0, &spec, nullptr) != 0
+        ||  epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            close(fd);
+            r.add_message("A002", "unable to arm timer.", true);
+            return false;
+        }
+
+        _timers[fd] = callback;
+        return true;
+    }
+
+    bool async_io_loop::read_file(
+            result& r,
+            const std::string& path,
+            void* buffer,
+            size_t size,
+            const completion_callable& callback) {
+        auto fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            r.add_message("A003", "unable to open file: " + path, true);
+            return false;
+        }
+
+        auto count = ::read(fd, buffer, size);
+        close(fd);
+
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            _ready.emplace_back(callback, static_cast<int64_t>(count));
+        }
+
+        uint64_t signal = 1;
+        if (::write(_event_fd, &signal, sizeof(signal)) != sizeof(signal)) {
+            r.add_message("A003", "unable to signal file read completion.", true);
+            return false;
+        }
+
+        return true;
+    }
+
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <mutex>
+#include <deque>
+#include <string>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include "result.h"
+
+namespace basecode {
+
+    // minimal epoll based completion loop used to exercise suspending host
+    // calls.  timers are backed by timerfds; regular files can't be polled, so
+    // file reads are performed eagerly and their completions are queued and
+    // delivered from poll() like any other event.
+    class async_io_loop {
+    public:
+        using completion_callable = std::function<void (int64_t)>;
+
+        async_io_loop() = default;
+
+        async_io_loop(const async_io_loop&) = delete;
+
+        async_io_loop& operator=(const async_io_loop&) = delete;
+
+        virtual ~async_io_loop();
+
+        size_t pending() const;
+
+        bool initialize(result& r);
+
+        size_t poll(int timeout_milliseconds);
+
+        bool add_timer(
+                result& r,
+                uint64_t milliseconds,
+                const completion_callable& callback);
+
+        bool read_file(
+                result& r,
+                const std::string& path,
+                void* buffer,
+                size_t size,
+                const completion_callable& callback);
+
+    private:
+        int _epoll_fd = -1;
+        int _event_fd = -1;
+        std::mutex _lock {};
+        std::deque<std::pair<completion_callable, int64_t>> _ready {};
+        std::unordered_map<int, completion_callable> _timers {};
+    };
+
+};
@@ -0,0 +1,359 @@
+#include <algorithm>
+#include <fmt/format.h>
+#include "verifier.h"
+#include "batch_terp.h"
+
+namespace basecode {
+
+    batch_terp::batch_terp(terp& terp, size_t lanes) : _terp(terp),
+                                                       _lanes(lanes) {
+        _mask.resize(lanes);
+        _zero.resize(lanes);
+        _taken.resize(lanes);
+        _exited.resize(lanes);
+        _pc.resize(lanes);
+        _sp.resize(lanes);
+        _registers.resize(64 * lanes);
+        _stack.resize(stack_slots * lanes);
+        _lhs_scratch.resize(lanes);
+        _rhs_scratch.resize(lanes);
+    }
+
+    void batch_terp::reset() {
+        std::fill(_registers.begin(), _registers.end(), 0);
+        std::fill(_zero.begin(), _zero.end(), 0);
+        std::fill(_exited.begin(), _exited.end(), 0);
+        std::fill(_sp.begin(), _sp.end(), stack_slots * sizeof(uint64_t));
+    }
+
+    size_t batch_terp::lanes() const {
+        return _lanes;
+    }
+
+    uint64_t* batch_terp::register_lanes(uint8_t index) {
+        if (index >= 64)
+            return nullptr;
+        return _registers.data() + static_cast<size_t>(index) * _lanes;
+    }
+
+    uint64_t* batch_terp::stack_slot(size_t lane, uint64_t address) {
+        if (address % sizeof(uint64_t) != 0 || address >= stack_slots * sizeof(uint64_t))
+            return nullptr;
+        return _stack.data() + (address / sizeof(uint64_t)) * _lanes + lane;
+    }
+
+    bool batch_terp::run(result& r, uint64_t address) {
+        std::fill(_pc.begin(), _pc.end(), address);
+        std::fill(_sp.begin(), _sp.end(), stack_slots * sizeof(uint64_t));
+        std::fill(_exited.begin(), _exited.end(), 0);
+
+        while (true) {
+            auto pc = UINT64_MAX;
+            for (size_t lane = 0; lane < _lanes; lane++) {
+                if (!_exited[lane])
+                    pc = std::min(pc, _pc[lane]);
+            }
+            if (pc == UINT64_MAX)
+                break;
+
+            for (size_t lane = 0; lane < _lanes; lane++)
+                _mask[lane] = !_exited[lane] && _pc[lane] == pc;
+
+            if (!step(r, pc))
+                return false;
+        }
+
+        return !r.is_failed();
+    }
+
+    const uint64_t* batch_terp::operand_lanes(
+            const instruction_t& inst,
+            uint8_t operand_index,
+            std::vector<uint64_t>& scratch) {
+        const auto& operand = inst.operands[operand_index];
+        if (operand.type == operand_types::register_integer)
+            return register_lanes(operand.index);
+        std::fill(scratch.begin(), scratch.end(), operand.value.u64);
+        return scratch.data();
+    }
+
+    bool batch_terp::step(result& r, uint64_t pc) {
+        // return addresses come from the lane stacks, which the program can
+        // store anything into
+        if (pc >= _terp.heap_size()) {
+            r.add_message("B012", fmt::format("PC ${:08X} is outside the heap.", pc), true);
+            return false;
+        }
+
+        instruction_t inst;
+        auto inst_size = inst.decode(r, _terp.heap(), pc);
+        if (inst_size == 0 || !verifier::check_instruction(r, inst, pc))
+            return false;
+
+        // SP only as the base of a frame access
+        auto frame_access = inst.op == op_codes::load || inst.op == op_codes::store;
+        for (size_t i = 0; i < inst.operands_count; i++) {
+            switch (inst.operands[i].type) {
+                case operand_types::register_integer:
+                case operand_types::constant_integer:
+                    break;
+                case operand_types::register_sp:
+                    if (frame_access && i == 1)
+                        break;
+                    [[fallthrough]];
+                default:
+                    r.add_message(
+                            "B011",
+                            fmt::format("unsupported operand type in batch mode at ${:08X}.", pc),
+                            true);
+                    return false;
+            }
+        }
+        if (frame_access && inst.operands[1].type != operand_types::register_sp) {
+            r.add_message(
+                    "B011",
+                    fmt::format("only SP-relative loads and stores run in batch mode, at ${:08X}.", pc),
+                    true);
+            return false;
+        }
+
+        const auto mask = _mask.data();
+        auto next_pc = pc + inst_size;
+
+        auto push = [&](size_t lane, uint64_t value) {
+            auto slot = stack_slot(lane, _sp[lane] - sizeof(uint64_t));
+            if (slot == nullptr) {
+                r.add_message(
+                        "B015",
+                        fmt::format("lane {} overflowed its stack at ${:08X}.", lane, pc),
+                        true);
+                return false;
+            }
+            _sp[lane] -= sizeof(uint64_t);
+            *slot = value;
+            return true;
+        };
+
+        auto pop = [&](size_t lane, uint64_t& value) {
+            auto slot = stack_slot(lane, _sp[lane]);
+            if (slot == nullptr) {
+                r.add_message(
+                        "B011",
+                        fmt::format("lane {} popped above its stack at ${:08X}.", lane, pc),
+                        true);
+                return false;
+            }
+            _sp[lane] += sizeof(uint64_t);
+            value = *slot;
+            return true;
+        };
+
+        auto frame_slot = [&](size_t lane, const uint64_t* offsets) {
+            auto offset = offsets != nullptr ? offsets[lane] : 0;
+            auto slot = stack_slot(lane, _sp[lane] + offset);
+            if (slot == nullptr) {
+                r.add_message(
+                        "B011",
+                        fmt::format("lane {} accessed outside its stack at ${:08X}.", lane, pc),
+                        true);
+            }
+            return slot;
+        };
+        auto branch = [&](const uint8_t* taken) {
+            auto address = operand_lanes(inst, 0, _rhs_scratch);
+            for (size_t lane = 0; lane < _lanes; lane++) {
+                if (mask[lane])
+                    _pc[lane] = taken[lane] ? address[lane] : next_pc;
+            }
+        };
+
+        auto binary = [&](auto op) {
+            auto target = register_lanes(inst.operands[0].index);
+            auto lhs = operand_lanes(inst, 1, _lhs_scratch);
+            auto rhs = operand_lanes(inst, 2, _rhs_scratch);
+            for (size_t lane = 0; lane < _lanes; lane++)
+                target[lane] = mask[lane] ? op(lhs[lane], rhs[lane]) : target[lane];
+        };
+
+        auto unary = [&](uint8_t target_index, uint8_t source_operand, auto op) {
+            auto target = register_lanes(inst.operands[target_index].index);
+            auto source = operand_lanes(inst, source_operand, _lhs_scratch);
+            for (size_t lane = 0; lane < _lanes; lane++)
+                target[lane] = mask[lane] ? op(source[lane]) : target[lane];
+        };
+
+        switch (inst.op) {
+            case op_codes::nop: {
+                break;
+            }
+            case op_codes::move: {
+                unary(1, 0, [](uint64_t value) { return value; });
+                break;
+            }
+            case op_codes::inc: {
+                unary(0, 0, [](uint64_t value) { return value + 1; });
+                break;
+            }
+            case op_codes::dec: {
+                unary(0, 0, [](uint64_t value) { return value - 1; });
+                break;
+            }
+            case op_codes::neg: {
+                unary(0, 1, [](uint64_t value) { return static_cast<uint64_t>(-static_cast<int64_t>(value)); });
+                break;
+            }
+            case op_codes::not_op: {
+                unary(0, 1, [](uint64_t value) { return ~value; });
+                break;
+            }
+            case op_codes::add: {
+                binary([](uint64_t lhs, uint64_t rhs) { return lhs + rhs; });
+                break;
+            }
+            case op_codes::sub: {
+                binary([](uint64_t lhs, uint64_t rhs) { return lhs - rhs; });
+                break;
+            }
+            case op_codes::mul: {
+                binary([](uint64_t lhs, uint64_t rhs) { return lhs * rhs; });
+                break;
+            }
+            case op_codes::div: {
+                binary([](uint64_t lhs, uint64_t rhs) { return rhs != 0 ? lhs / rhs : 0; });
+                break;
+            }
+            case op_codes::mod: {
+                binary([](uint64_t lhs, uint64_t rhs) { return rhs != 0 ? lhs % rhs : 0; });
+                break;
+            }
+            case op_codes::shr: {
+                binary([](uint64_t lhs, uint64_t rhs) { return lhs >> rhs; });
+                break;
+            }
+            case op_codes::shl: {
+                binary([](uint64_t lhs, uint64_t rhs) { return lhs << rhs; });
+                break;
+            }
+            case op_codes::and_op: {
+                binary([](uint64_t lhs, uint64_t rhs) { return lhs & rhs; });
+                break;
+            }
+            case op_codes::or_op: {
+                binary([](uint64_t lhs, uint64_t rhs) { return lhs | rhs; });
+                break;
+            }
+            case op_codes::xor_op: {
+                binary([](uint64_t lhs, uint64_t rhs) { return lhs ^ rhs; });
+                break;
+            }
+            case op_codes::load: {
+                auto target = register_lanes(inst.operands[0].index);
+                auto offsets = inst.operands_count > 2 ? operand_lanes(inst, 2, _rhs_scratch) : nullptr;
+                for (size_t lane = 0; lane < _lanes; lane++) {
+                    if (!mask[lane])
+                        continue;
+                    auto slot = frame_slot(lane, offsets);
+                    if (slot == nullptr)
+                        return false;
+                    target[lane] = *slot;
+                }
+                break;
+            }
+            case op_codes::store: {
+                auto source = operand_lanes(inst, 0, _lhs_scratch);
+                auto offsets = inst.operands_count > 2 ? operand_lanes(inst, 2, _rhs_scratch) : nullptr;
+                for (size_t lane = 0; lane < _lanes; lane++) {
+                    if (!mask[lane])
+                        continue;
+                    auto slot = frame_slot(lane, offsets);
+                    if (slot == nullptr)
+                        return false;
+                    *slot = source[lane];
+                }
+                break;
+            }
+            case op_codes::push: {
+                auto source = operand_lanes(inst, 0, _lhs_scratch);
+                for (size_t lane = 0; lane < _lanes; lane++) {
+                    if (mask[lane] && !push(lane, source[lane]))
+                        return false;
+                }
+                break;
+            }
+            case op_codes::pop: {
+                auto target = register_lanes(inst.operands[0].index);
+                for (size_t lane = 0; lane < _lanes; lane++) {
+                    if (mask[lane] && !pop(lane, target[lane]))
+                        return false;
+                }
+                break;
+            }
+            case op_codes::jsr: {
+                auto address = operand_lanes(inst, 0, _rhs_scratch);
+                for (size_t lane = 0; lane < _lanes; lane++) {
+                    if (!mask[lane])
+                        continue;
+                    if (!push(lane, next_pc))
+                        return false;
+                    _pc[lane] = address[lane];
+                    _zero[lane] = 0;
+                }
+                return true;
+            }
+            case op_codes::rts: {
+                for (size_t lane = 0; lane < _lanes; lane++) {
+                    if (mask[lane] && !pop(lane, _pc[lane]))
+                        return false;
+                }
+                return true;
+            }
+            case op_codes::cmp: {
+                auto lhs = operand_lanes(inst, 0, _lhs_scratch);
+                auto rhs = operand_lanes(inst, 1, _rhs_scratch);
+                for (size_t lane = 0; lane < _lanes; lane++)
+                    _zero[lane] = mask[lane] ? lhs[lane] == rhs[lane] : _zero[lane];
+                break;
+            }
+            case op_codes::beq: {
+                branch(_zero.data());
+                // like the scalar interpreter, a taken beq consumes the zero flag
+                for (size_t lane = 0; lane < _lanes; lane++)
+                    _zero[lane] = mask[lane] ? 0 : _zero[lane];
+                return true;
+            }
+            case op_codes::bne: {
+                for (size_t lane = 0; lane < _lanes; lane++)
+                    _taken[lane] = !_zero[lane];
+                branch(_taken.data());
+                return true;
+            }
+            case op_codes::jmp: {
+                std::fill(_taken.begin(), _taken.end(), 1);
+                branch(_taken.data());
+                for (size_t lane = 0; lane < _lanes; lane++)
+                    _zero[lane] = mask[lane] ? 0 : _zero[lane];
+                return true;
+            }
+            case op_codes::exit: {
+                for (size_t lane = 0; lane < _lanes; lane++)
+                    _exited[lane] |= mask[lane];
+                return true;
+            }
+            default: {
+                r.add_message(
+                        "B011",
+                        fmt::format("unsupported instruction in batch mode at ${:08X}.", pc),
+                        true);
+                return false;
+            }
+        }
+
+        for (size_t lane = 0; lane < _lanes; lane++) {
+            if (mask[lane])
+                _pc[lane] = next_pc;
+        }
+
+        return true;
+    }
+
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include "terp.h"
+#include "result.h"
+
+namespace basecode {
+
+    // runs one program over many independent inputs at once.  every integer
+    // register is held as an array with one slot per lane (structure of arrays)
+    // and each decoded instruction is applied to all lanes sitting at the same
+    // pc in a single tight loop.  lanes that branch differently are split up:
+    // each step executes the lanes with the lowest pc under a mask, so diverged
+    // lanes naturally reconverge once they reach a common instruction again.
+    //
+    // integer register code is supported (move, alu, cmp/branch, jmp, exit),
+    // plus calls: every lane has a private stack of stack_slots qwords, so
+    // push/pop, jsr/rts and SP-relative load/store (frame access) work per
+    // lane.  SP starts at the top of the lane stack on each run().  other
+    // memory instructions are rejected with B011.
+    class batch_terp {
+    public:
+        static const size_t stack_slots = 1024;
+
+        batch_terp(terp& terp, size_t lanes);
+
+        void reset();
+
+        size_t lanes() const;
+
+        // nullptr for an index past the 64 integer registers
+        uint64_t* register_lanes(uint8_t index);
+
+        bool run(result& r, uint64_t address);
+
+    private:
+        const uint64_t* operand_lanes(
+                const instruction_t& inst,
+                uint8_t operand_index,
+                std::vector<uint64_t>& scratch);
+
+        // the lane's stack slot at `address`, nullptr when outside its stack
+        uint64_t* stack_slot(size_t lane, uint64_t address);
+
+        bool step(result& r, uint64_t pc);
+
+    private:
+        terp& _terp;
+        size_t _lanes = 0;
+        std::vector<uint8_t> _mask {};
+        std::vector<uint8_t> _zero {};
+        std::vector<uint8_t> _taken {};
+        std::vector<uint8_t> _exited {};
+        std::vector<uint64_t> _pc {};
+        std::vector<uint64_t> _sp {};
+        std::vector<uint64_t> _registers {};
+        // slot-major: lanes at the same depth sit next to each other
+        std::vector<uint64_t> _stack {};
+        std::vector<uint64_t> _lhs_scratch {};
+        std::vector<uint64_t> _rhs_scratch {};
+    };
+
+};
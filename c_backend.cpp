@@ -0,0 +1,660 @@
+#include <vector>
+#include <fmt/format.h>
+#include "c_backend.h"
+
+namespace basecode {
+
+    static const char* s_runtime = R"(#include <stdint.h>
+#include <string.h>
+
+#ifndef BC_RUNTIME
+#define BC_RUNTIME
+
+#define BC_FLAG_ZERO     UINT64_C(1)
+#define BC_FLAG_CARRY    UINT64_C(2)
+#define BC_FLAG_OVERFLOW UINT64_C(4)
+#define BC_FLAG_NEGATIVE UINT64_C(8)
+#define BC_LESS(fr) ((((fr) & BC_FLAG_NEGATIVE) != 0) != (((fr) & BC_FLAG_OVERFLOW) != 0))
+
+enum {
+    BC_RUNNING = 0,
+    BC_EXITED  = 1,
+    BC_FAILED  = 2,
+};
+
+typedef struct bc_state {
+    uint8_t* heap;
+    uint64_t mask;
+    uint64_t i[64];
+    double f[64];
+    uint64_t sp;
+    uint64_t fr;
+    uint64_t sr;
+    int status;
+} bc_state_t;
+
+static inline uint64_t bc_load(bc_state_t* s, uint64_t address) {
+    uint64_t value;
+    memcpy(&value, s->heap + (address & s->mask), sizeof(value));
+    return value;
+}
+
+static inline void bc_store(bc_state_t* s, uint64_t address, uint64_t value) {
+    memcpy(s->heap + (address & s->mask), &value, sizeof(value));
+}
+
+static inline uint64_t bc_rotl(uint64_t n, uint8_t c) {
+    c &= 63;
+    return (n << c) | (n >> ((-c) & 63));
+}
+
+static inline uint64_t bc_rotr(uint64_t n, uint8_t c) {
+    c &= 63;
+    return (n >> c) | (n << ((-c) & 63));
+}
+
+static inline void bc_mulx(uint64_t lhs, uint64_t rhs, uint64_t* hi, uint64_t* lo) {
+    uint64_t a = lhs >> 32, b = lhs & 0xffffffffu;
+    uint64_t c = rhs >> 32, d = rhs & 0xffffffffu;
+    uint64_t bd = b * d, ad = a * d, bc = b * c, ac = a * c;
+    uint64_t mid = (bd >> 32) + (ad & 0xffffffffu) + (bc & 0xffffffffu);
+    *lo = (mid << 32) | (bd & 0xffffffffu);
+    *hi = ac + (ad >> 32) + (bc >> 32) + (mid >> 32);
+}
+
+/* callers guarantee hi < divisor, so the quotient fits 64 bits */
+static inline void bc_divx(uint64_t* lo, uint64_t* hi, uint64_t divisor) {
+    uint64_t quotient = 0, remainder = *hi, low = *lo;
+    int bit;
+    for (bit = 63; bit >= 0; bit--) {
+        uint64_t overflow = remainder >> 63;
+        remainder = (remainder << 1) | ((low >> bit) & 1);
+        quotient <<= 1;
+        if (overflow || remainder >= divisor) {
+            remainder -= divisor;
+            quotient |= 1;
+        }
+    }
+    *lo = quotient;
+    *hi = remainder;
+}
+
+#endif
+)";
+
+    static bool is_integer_register(operand_types type) {
+        switch (type) {
+            case operand_types::register_integer:
+            case operand_types::increment_register_pre:
+            case operand_types::increment_register_post:
+            case operand_types::decrement_register_pre:
+            case operand_types::decrement_register_post:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    static std::string constant_text(uint64_t value) {
+        return fmt::format("UINT64_C(0x{:x})", value);
+    }
+
+    // the C expression reading operand `index`, with the terp's coercions
+    static bool source_operand(
+            result& r,
+            const instruction_t& inst,
+            uint8_t index,
+            uint64_t next_address,
+            std::string& text) {
+        const auto& operand = inst.operands[index];
+        if (is_integer_register(operand.type)) {
+            text = fmt::format("i{}", operand.index);
+            return true;
+        }
+        switch (operand.type) {
+            case operand_types::register_floating_point:
+                text = fmt::format("(uint64_t)s->f[{}]", operand.index);
+                return true;
+            case operand_types::register_sp:
+                text = "sp";
+                return true;
+            case operand_types::register_pc:
+                // the terp advances PC before executing the instruction
+                text = constant_text(next_address);
+                return true;
+            case operand_types::register_flags:
+                text = "fr";
+                return true;
+            case operand_types::register_status:
+                text = "s->sr";
+                return true;
+            case operand_types::constant_float:
+                text = constant_text(static_cast<uint64_t>(operand.value.d64));
+                return true;
+            case operand_types::register_vector:
+                break;
+            default:
+                text = constant_text(operand.value.u64);
+                return true;
+        }
+        r.add_message("B020", "vector registers cannot be translated as scalar operands.", true);
+        return false;
+    }
+
+    // the C lvalue written by target operand `index`
+    static bool target_operand(
+            result& r,
+            const instruction_t& inst,
+            uint8_t index,
+            std::string& text) {
+        const auto& operand = inst.operands[index];
+        if (is_integer_register(operand.type)) {
+            text = fmt::format("i{}", operand.index);
+            return true;
+        }
+        switch (operand.type) {
+            case operand_types::register_floating_point:
+                text = fmt::format("s->f[{}]", operand.index);
+                return true;
+            case operand_types::register_sp:
+                text = "sp";
+                return true;
+            case operand_types::register_flags:
+                text = "fr";
+                return true;
+            case operand_types::register_status:
+                text = "s->sr";
+                return true;
+            case operand_types::register_pc:
+                r.add_message("B020", "writes to PC cannot be translated ahead of time.", true);
+                return false;
+            default:
+                r.add_message("B020", "operand cannot be a target of a translated instruction.", true);
+                return false;
+        }
+    }
+
+    // branch and jump targets have to be known at translation time
+    static bool direct_target(
+            result& r,
+            const instruction_t& inst,
+            uint8_t index,
+            uint64_t& address) {
+        if (inst.operands[index].type != operand_types::constant_integer) {
+            r.add_message("B020", "branches through a register cannot be translated ahead of time.", true);
+            return false;
+        }
+        address = inst.operands[index].value.u64;
+        return true;
+    }
+
+    static uint8_t branch_target_index(op_codes op) {
+        switch (op) {
+            case op_codes::bz:
+            case op_codes::bnz:
+                return 1;
+            case op_codes::tbz:
+            case op_codes::tbnz:
+                return 2;
+            default:
+                return 0;
+        }
+    }
+
+    c_backend::c_backend(const std::string& prefix) : _prefix(prefix) {
+    }
+
+    bool c_backend::translate(
+            result& r,
+            terp& terp,
+            uint64_t start,
+            uint64_t end,
+            uint64_t entry) {
+        _source.clear();
+        _functions.clear();
+        _indirect_calls = false;
+
+        if (!discover(r, terp, start, end, entry))
+            return false;
+
+        _source = s_runtime;
+        _source += "\n";
+        for (const auto& function : _functions)
+            _source += fmt::format("static void {}(bc_state_t* s);\n", function_symbol(function.first));
+        if (_indirect_calls) {
+            _source += fmt::format("\nstatic void {}_call(bc_state_t* s, uint64_t address) {{\n", _prefix);
+            _source += "    switch (address) {\n";
+            for (const auto& function : _functions) {
+                _source += fmt::format(
+                        "        case {}: {}(s); break;\n",
+                        constant_text(function.first),
+                        function_symbol(function.first));
+            }
+            _source += "        default: s->status = BC_FAILED; break;\n";
+            _source += "    }\n}\n";
+        }
+
+        for (const auto& function : _functions) {
+            if (!emit_function(r, function.first, function.second))
+                return false;
+        }
+
+        _source += fmt::format("\nvoid {}(bc_state_t* s) {{\n", run_symbol());
+        _source += "    s->status = BC_RUNNING;\n";
+        _source += fmt::format("    {}(s);\n}}\n", function_symbol(entry));
+        return true;
+    }
+
+    bool c_backend::discover(
+            result& r,
+            terp& terp,
+            uint64_t start,
+            uint64_t end,
+            uint64_t entry) {
+        std::vector<uint64_t> pending_functions {entry};
+        while (!pending_functions.empty()) {
+            auto address = pending_functions.back();
+            pending_functions.pop_back();
+            if (_functions.count(address) > 0)
+                continue;
+
+            auto& function = _functions[address];
+            std::vector<uint64_t> pending_blocks {address};
+            while (!pending_blocks.empty()) {
+                auto pc = pending_blocks.back();
+                pending_blocks.pop_back();
+
+                while (function.instructions.count(pc) == 0) {
+                    if (pc < start || pc >= end) {
+                        r.add_message(
+                                "B020",
+                                fmt::format("control reaches ${:08X}, outside the translated range.", pc),
+                                true);
+                        return false;
+                    }
+
+                    instruction_t inst;
+                    auto inst_size = inst.decode(r, terp.heap(), pc);
+                    if (inst_size == 0)
+                        return false;
+                    function.instructions[pc] = inst;
+
+                    for (size_t i = 0; i < inst.operands_count; i++) {
+                        if (is_integer_register(inst.operands[i].type))
+                            function.registers.insert(inst.operands[i].index);
+                    }
+
+                    auto falls_through = true;
+                    uint64_t target;
+                    switch (inst.op) {
+                        case op_codes::bz:
+                        case op_codes::bnz:
+                        case op_codes::tbz:
+                        case op_codes::tbnz:
+                        case op_codes::bne:
+                        case op_codes::beq:
+                        case op_codes::bg:
+                        case op_codes::bge:
+                        case op_codes::bl:
+                        case op_codes::ble:
+                        case op_codes::ba:
+                        case op_codes::bae:
+                        case op_codes::bb:
+                        case op_codes::bbe:
+                        case op_codes::jmp: {
+                            if (!direct_target(r, inst, branch_target_index(inst.op), target))
+                                return false;
+                            function.labels.insert(target);
+                            pending_blocks.push_back(target);
+                            falls_through = inst.op != op_codes::jmp;
+                            break;
+                        }
+                        case op_codes::jsr:
+                        case op_codes::tjsr: {
+                            if (inst.operands[0].type == operand_types::constant_integer)
+                                pending_functions.push_back(inst.operands[0].value.u64);
+                            else
+                                _indirect_calls = true;
+                            falls_through = inst.op == op_codes::jsr;
+                            break;
+                        }
+                        case op_codes::rts:
+                        case op_codes::exit: {
+                            falls_through = false;
+                            break;
+                        }
+                        default: {
+                            break;
+                        }
+                    }
+
+                    if (!falls_through)
+                        break;
+                    pc += inst_size;
+                }
+            }
+        }
+        return true;
+    }
+
+    bool c_backend::emit_function(result& r, uint64_t address, const function_t& function) {
+        std::string spill;
+        std::string reload;
+        for (auto index : function.registers) {
+            spill += fmt::format(" s->i[{0}] = i{0};", index);
+            reload += fmt::format(" i{0} = s->i[{0}];", index);
+        }
+        spill += " s->sp = sp; s->fr = fr;";
+        reload += " sp = s->sp; fr = s->fr;";
+
+        _source += fmt::format("\nstatic void {}(bc_state_t* s) {{\n", function_symbol(address));
+        for (auto index : function.registers)
+            _source += fmt::format("    uint64_t i{0} = s->i[{0}];\n", index);
+        _source += "    uint64_t sp = s->sp;\n";
+        _source += "    uint64_t fr = s->fr;\n";
+
+        for (const auto& entry : function.instructions) {
+            if (function.labels.count(entry.first) > 0)
+                _source += fmt::format("L_{:08x}: ;\n", entry.first);
+
+            auto inst = entry.second;
+            auto next_address = entry.first + inst.encoding_size();
+            _source += fmt::format("    /* ${:08X} */\n", entry.first);
+
+            switch (inst.op) {
+                case op_codes::jsr:
+                case op_codes::tjsr: {
+                    std::string target;
+                    if (!source_operand(r, inst, 0, next_address, target))
+                        return false;
+                    auto direct = inst.operands[0].type == operand_types::constant_integer;
+                    _source += direct
+                        ? "    { fr &= ~BC_FLAG_ZERO;"
+                        : fmt::format("    {{ uint64_t t = {}; fr &= ~BC_FLAG_ZERO;", target);
+                    if (inst.op == op_codes::jsr) {
+                        _source += fmt::format(
+                                " sp -= 8; bc_store(s, sp, {});",
+                                constant_text(next_address));
+                    }
+                    _source += fmt::format(
+                            "{} {} }}\n",
+                            spill,
+                            direct
+                                ? fmt::format("{}(s);", function_symbol(inst.operands[0].value.u64))
+                                : fmt::format("{}_call(s, t);", _prefix));
+                    if (inst.op == op_codes::jsr) {
+                        _source += "    if (s->status != BC_RUNNING) return;\n";
+                        _source += fmt::format("   {}\n", reload);
+                    } else {
+                        // the callee's rts pops our caller's return address
+                        _source += "    return;\n";
+                    }
+                    break;
+                }
+                case op_codes::rts: {
+                    _source += fmt::format("    sp += 8;{} return;\n", spill);
+                    break;
+                }
+                case op_codes::exit: {
+                    _source += fmt::format("   {} s->status = BC_EXITED; return;\n", spill);
+                    break;
+                }
+                default: {
+                    if (!emit_instruction(r, entry.first, next_address, spill, inst))
+                        return false;
+                    break;
+                }
+            }
+        }
+
+        _source += "}\n";
+        return true;
+    }
+
+    bool c_backend::emit_instruction(
+            result& r,
+            uint64_t address,
+            uint64_t next_address,
+            const std::string& spill,
+            const instruction_t& inst) {
+        std::string v[instruction_t::max_operands];
+        for (uint8_t i = 0; i < inst.operands_count; i++) {
+            if (!source_operand(r, inst, i, next_address, v[i]))
+                return false;
+        }
+
+        std::string t0;
+        std::string t1;
+        auto branch_label = [&]() {
+            return fmt::format("L_{:08x}", inst.operands[branch_target_index(inst.op)].value.u64);
+        };
+
+        std::string code;
+        switch (inst.op) {
+            case op_codes::nop:
+            case op_codes::xor_op:
+            case op_codes::test:
+            case op_codes::meta:
+            case op_codes::debug: {
+                // no-ops in the interpreter as well
+                break;
+            }
+            case op_codes::load: {
+                if (!target_operand(r, inst, 0, t0))
+                    return false;
+                auto offset = inst.operands_count > 2 ? fmt::format(" + {}", v[2]) : "";
+                code = fmt::format("{} = bc_load(s, {}{});", t0, v[1], offset);
+                break;
+            }
+            case op_codes::store: {
+                auto offset = inst.operands_count > 2 ? fmt::format(" + {}", v[2]) : "";
+                code = fmt::format("bc_store(s, {}{}, {});", v[1], offset, v[0]);
+                break;
+            }
+            case op_codes::move: {
+                if (!target_operand(r, inst, 1, t1))
+                    return false;
+                code = fmt::format("{} = {};", t1, v[0]);
+                break;
+            }
+            case op_codes::push: {
+                code = fmt::format("{{ uint64_t a = {}; sp -= 8; bc_store(s, sp, a); }}", v[0]);
+                break;
+            }
+            case op_codes::pop: {
+                if (!target_operand(r, inst, 0, t0))
+                    return false;
+                code = fmt::format("{{ uint64_t a = bc_load(s, sp); sp += 8; {} = a; }}", t0);
+                break;
+            }
+            case op_codes::inc:
+            case op_codes::dec: {
+                code = fmt::format(
+                        "i{}{};",
+                        inst.operands[0].index,
+                        inst.op == op_codes::inc ? "++" : "--");
+                break;
+            }
+            case op_codes::add:
+            case op_codes::addc:
+            case op_codes::sub:
+            case op_codes::subc: {
+                if (!target_operand(r, inst, 0, t0))
+                    return false;
+                auto carry_in = inst.op == op_codes::addc || inst.op == op_codes::subc
+                    ? "((fr & BC_FLAG_CARRY) ? 1 : 0)"
+                    : "0";
+                if (inst.op == op_codes::add || inst.op == op_codes::addc) {
+                    code = fmt::format(
+                            "{{ uint64_t a = {}, b = {}, c = {}, t = a + b, u = t + c; "
+                            "fr = (t < a || u < t) ? fr | BC_FLAG_CARRY : fr & ~BC_FLAG_CARRY; {} = u; }}",
+                            v[1], v[2], carry_in, t0);
+                } else {
+                    code = fmt::format(
+                            "{{ uint64_t a = {}, b = {}, c = {}, t = a - b, u = t - c; "
+                            "fr = (b > a || c > t) ? fr | BC_FLAG_CARRY : fr & ~BC_FLAG_CARRY; {} = u; }}",
+                            v[1], v[2], carry_in, t0);
+                }
+                break;
+            }
+            case op_codes::mulx: {
+                if (!target_operand(r, inst, 0, t0) || !target_operand(r, inst, 1, t1))
+                    return false;
+                code = fmt::format(
+                        "{{ uint64_t h, l; bc_mulx({}, {}, &h, &l); {} = h; {} = l; }}",
+                        v[2], v[3], t0, t1);
+                break;
+            }
+            case op_codes::divx: {
+                if (!target_operand(r, inst, 0, t0) || !target_operand(r, inst, 1, t1))
+                    return false;
+                // the interpreter fails with B017; here the run just stops
+                code = fmt::format(
+                        "{{ uint64_t l = {}, h = {}, d = {}; "
+                        "if (d == 0 || h >= d) {{{} s->status = BC_FAILED; return; }} "
+                        "bc_divx(&l, &h, d); {} = l; {} = h; }}",
+                        v[0], v[1], v[2], spill, t0, t1);
+                break;
+            }
+            case op_codes::mul:
+            case op_codes::div:
+            case op_codes::mod:
+            case op_codes::shr:
+            case op_codes::shl:
+            case op_codes::and_op:
+            case op_codes::or_op:
+            case op_codes::bis:
+            case op_codes::bic:
+            case op_codes::ror:
+            case op_codes::rol: {
+                if (!target_operand(r, inst, 0, t0))
+                    return false;
+                std::string expression;
+                switch (inst.op) {
+                    case op_codes::mul: expression = "a * b"; break;
+                    case op_codes::div: expression = "b != 0 ? a / b : 0"; break;
+                    case op_codes::mod: expression = "a % b"; break;
+                    case op_codes::shr: expression = "a >> b"; break;
+                    case op_codes::shl: expression = "a << b"; break;
+                    case op_codes::and_op: expression = "a & b"; break;
+                    case op_codes::or_op: expression = "a | b"; break;
+                    // the interpreter computes the bit as 2 ^ n; kept bit-for-bit
+                    case op_codes::bis: expression = "a | (2 ^ b)"; break;
+                    case op_codes::bic: expression = "a & ~(2 ^ b)"; break;
+                    case op_codes::ror: expression = "bc_rotr(a, (uint8_t)b)"; break;
+                    default: expression = "bc_rotl(a, (uint8_t)b)"; break;
+                }
+                code = fmt::format("{{ uint64_t a = {}, b = {}; {} = {}; }}", v[1], v[2], t0, expression);
+                break;
+            }
+            case op_codes::neg:
+            case op_codes::not_op: {
+                if (!target_operand(r, inst, 0, t0))
+                    return false;
+                code = fmt::format(
+                        "{} = {}{};",
+                        t0,
+                        inst.op == op_codes::neg ? "0 - " : "~",
+                        v[1]);
+                break;
+            }
+            case op_codes::cmp: {
+                code = fmt::format(
+                        "{{ uint64_t a = {}, b = {}, d = a - b; "
+                        "fr &= ~(BC_FLAG_ZERO | BC_FLAG_CARRY | BC_FLAG_OVERFLOW | BC_FLAG_NEGATIVE); "
+                        "if (d == 0) fr |= BC_FLAG_ZERO; "
+                        "if (b > a) fr |= BC_FLAG_CARRY; "
+                        "if (((a ^ b) & (a ^ d)) >> 63) fr |= BC_FLAG_OVERFLOW; "
+                        "if (d >> 63) fr |= BC_FLAG_NEGATIVE; }}",
+                        v[0], v[1]);
+                break;
+            }
+            case op_codes::bz:
+            case op_codes::bnz: {
+                code = fmt::format(
+                        "fr &= ~BC_FLAG_ZERO; if ({} {} 0) goto {};",
+                        v[0],
+                        inst.op == op_codes::bz ? "==" : "!=",
+                        branch_label());
+                break;
+            }
+            case op_codes::tbz:
+            case op_codes::tbnz: {
+                code = fmt::format(
+                        "fr &= ~BC_FLAG_ZERO; if (({} & {}) {} 0) goto {};",
+                        v[0],
+                        v[1],
+                        inst.op == op_codes::tbz ? "==" : "!=",
+                        branch_label());
+                break;
+            }
+            case op_codes::bne: {
+                code = fmt::format("if (!(fr & BC_FLAG_ZERO)) goto {};", branch_label());
+                break;
+            }
+            case op_codes::beq: {
+                code = fmt::format(
+                        "if (fr & BC_FLAG_ZERO) {{ fr &= ~BC_FLAG_ZERO; goto {}; }}",
+                        branch_label());
+                break;
+            }
+            case op_codes::bg:
+            case op_codes::bge:
+            case op_codes::bl:
+            case op_codes::ble:
+            case op_codes::ba:
+            case op_codes::bae:
+            case op_codes::bb:
+            case op_codes::bbe: {
+                std::string condition;
+                switch (inst.op) {
+                    case op_codes::bg: condition = "!(fr & BC_FLAG_ZERO) && !BC_LESS(fr)"; break;
+                    case op_codes::bge: condition = "!BC_LESS(fr)"; break;
+                    case op_codes::bl: condition = "BC_LESS(fr)"; break;
+                    case op_codes::ble: condition = "(fr & BC_FLAG_ZERO) || BC_LESS(fr)"; break;
+                    case op_codes::ba: condition = "!(fr & (BC_FLAG_ZERO | BC_FLAG_CARRY))"; break;
+                    case op_codes::bae: condition = "!(fr & BC_FLAG_CARRY)"; break;
+                    case op_codes::bb: condition = "(fr & BC_FLAG_CARRY)"; break;
+                    default: condition = "(fr & (BC_FLAG_ZERO | BC_FLAG_CARRY))"; break;
+                }
+                code = fmt::format("if ({}) goto {};", condition, branch_label());
+                break;
+            }
+            case op_codes::jmp: {
+                code = fmt::format("fr &= ~BC_FLAG_ZERO; goto {};", branch_label());
+                break;
+            }
+            default: {
+                r.add_message(
+                        "B020",
+                        fmt::format(
+                                "${:08X}: op code {} cannot be translated ahead of time.",
+                                address,
+                                static_cast<uint32_t>(inst.op)),
+                        true);
+                return false;
+            }
+        }
+
+        if (!code.empty())
+            _source += fmt::format("    {}\n", code);
+        return true;
+    }
+
+    std::string c_backend::function_symbol(uint64_t address) const {
+        return fmt::format("{}_fn_{:08x}", _prefix, address);
+    }
+
+    size_t c_backend::function_count() const {
+        return _functions.size();
+    }
+
+    std::string c_backend::run_symbol() const {
+        return fmt::format("{}_run", _prefix);
+    }
+
+    const std::string& c_backend::source() const {
+        return _source;
+    }
+
+};
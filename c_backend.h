@@ -0,0 +1,81 @@
+#pragma once
+
+#include <map>
+#include <set>
+#include <string>
+#include <cstdint>
+#include "terp.h"
+#include "result.h"
+
+namespace basecode {
+
+    // ahead-of-time translation of encoded instructions into portable C.
+    //
+    // translate() decodes the instruction_t stream straight out of a terp's
+    // heap, starting at `entry` and following every branch, jump and call
+    // target.  each subroutine (the entry point plus every direct jsr/tjsr
+    // target) becomes one C function; the integer registers it touches, SP
+    // and FR are locals, written back to the shared state around calls and on
+    // the way out since registers are global to the terp.  branches become
+    // gotos, jsr a C call that still pushes the return address so stack
+    // offsets match the interpreter, and exit unwinds every C frame.
+    //
+    // the generated source carries a small runtime reproducing the terp's
+    // semantics and exports:
+    //
+    //      void <prefix>_run(bc_state_t* s);
+    //
+    // the caller supplies the heap, its address mask and the initial SP.
+    // fuel, memoization, host calls, guard regions and floating point or
+    // vector registers are interpreter-only: instructions needing them, and
+    // jumps through a register, fail translation with B020.
+    class c_backend {
+    public:
+        explicit c_backend(const std::string& prefix = "bc");
+
+        bool translate(
+                result& r,
+                terp& terp,
+                uint64_t start,
+                uint64_t end,
+                uint64_t entry);
+
+        size_t function_count() const;
+
+        std::string run_symbol() const;
+
+        const std::string& source() const;
+
+    private:
+        struct function_t {
+            std::set<uint64_t> labels {};
+            std::set<uint8_t> registers {};
+            std::map<uint64_t, instruction_t> instructions {};
+        };
+
+        bool discover(
+                result& r,
+                terp& terp,
+                uint64_t start,
+                uint64_t end,
+                uint64_t entry);
+
+        bool emit_function(result& r, uint64_t address, const function_t& function);
+
+        bool emit_instruction(
+                result& r,
+                uint64_t address,
+                uint64_t next_address,
+                const std::string& spill,
+                const instruction_t& inst);
+
+        std::string function_symbol(uint64_t address) const;
+
+    private:
+        std::string _prefix;
+        std::string _source {};
+        bool _indirect_calls = false;
+        std::map<uint64_t, function_t> _functions {};
+    };
+
+};
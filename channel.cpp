@@ -0,0 +1,197 @@
+#include <cstring>
+#include <sys/mman.h>
+#include "channel.h"
+
+namespace basecode {
+
+    static size_t round_up_power_of_two(size_t value) {
+        size_t power = 1;
+        while (power < value)
+            power <<= 1;
+        return power;
+    }
+
+    channel::channel(
+            channel_kind kind,
+            size_t capacity,
+            size_t message_size) : _kind(kind),
+                                   _capacity(round_up_power_of_two(capacity)),
+                                   _message_size(message_size) {
+    }
+
+    channel::~channel() {
+        if (_mapping != nullptr) {
+            munmap(_mapping, _mapping_size);
+            _mapping = nullptr;
+            _header = nullptr;
+        }
+    }
+
+    channel_kind channel::kind() const {
+        return _kind;
+    }
+
+    size_t channel::capacity() const {
+        return _capacity;
+    }
+
+    size_t channel::message_size() const {
+        return _message_size;
+    }
+
+    bool channel::initialize(result& r) {
+        if (_message_size == 0) {
+            r.add_message("B023", "channel messages need at least one byte.", true);
+            return false;
+        }
+
+        _slot_size = (sizeof(slot_header_t) + _message_size + 15) & ~size_t(15);
+        _mapping_size = sizeof(ring_header_t) + _capacity * _slot_size;
+
+        auto mapping = mmap(
+                nullptr,
+                _mapping_size,
+                PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_ANONYMOUS,
+                -1,
+                0);
+        if (mapping == MAP_FAILED) {
+            r.add_message("B023", "unable to map channel ring.", true);
+            return false;
+        }
+
+        // anonymous mappings are zero filled: both indexes start at 0
+        _mapping = static_cast<uint8_t*>(mapping);
+        _header = reinterpret_cast<ring_header_t*>(_mapping);
+        for (uint64_t i = 0; i < _capacity; i++)
+            slot(i)->sequence = i;
+
+        return true;
+    }
+
+    channel::slot_header_t* channel::slot(uint64_t index) const {
+        auto offset = sizeof(ring_header_t) + (index & (_capacity - 1)) * _slot_size;
+        return reinterpret_cast<slot_header_t*>(_mapping + offset);
+    }
+
+    bool channel::try_send(const void* data, size_t size) {
+        if (_header == nullptr || size == 0 || size > _message_size)
+            return false;
+        return _kind == channel_kind::spsc ?
+            try_send_spsc(data, size) :
+            try_send_mpmc(data, size);
+    }
+
+    bool channel::try_receive(void* data, size_t& size) {
+        if (_header == nullptr)
+            return false;
+        return _kind == channel_kind::spsc ?
+            try_receive_spsc(data, size) :
+            try_receive_mpmc(data, size);
+    }
+
+    bool channel::try_send_spsc(const void* data, size_t size) {
+        auto tail = __atomic_load_n(&_header->tail, __ATOMIC_RELAXED);
+        if (tail - _header->cached_head >= _capacity) {
+            _header->cached_head = __atomic_load_n(&_header->head, __ATOMIC_ACQUIRE);
+            if (tail - _header->cached_head >= _capacity)
+                return false;
+        }
+
+        auto header = slot(tail);
+        header->size = size;
+        memcpy(header + 1, data, size);
+        __atomic_store_n(&_header->tail, tail + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    bool channel::try_receive_spsc(void* data, size_t& size) {
+        auto head = __atomic_load_n(&_header->head, __ATOMIC_RELAXED);
+        if (head == _header->cached_tail) {
+            _header->cached_tail = __atomic_load_n(&_header->tail, __ATOMIC_ACQUIRE);
+            if (head == _header->cached_tail)
+                return false;
+        }
+
+        auto header = slot(head);
+        size = header->size;
+        memcpy(data, header + 1, size);
+        __atomic_store_n(&_header->head, head + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    bool channel::try_send_mpmc(const void* data, size_t size) {
+        auto position = __atomic_load_n(&_header->tail, __ATOMIC_RELAXED);
+        slot_header_t* header;
+        while (true) {
+            header = slot(position);
+            auto sequence = __atomic_load_n(&header->sequence, __ATOMIC_ACQUIRE);
+            auto difference = static_cast<int64_t>(sequence - position);
+            if (difference == 0) {
+                // on failure `position` is reloaded with the current tail
+                if (__atomic_compare_exchange_n(
+                        &_header->tail,
+                        &position,
+                        position + 1,
+                        true,
+                        __ATOMIC_RELAXED,
+                        __ATOMIC_RELAXED)) {
+                    break;
+                }
+            } else if (difference < 0) {
+                // the receivers haven't freed this lap's slot yet: full
+                return false;
+            } else {
+                position = __atomic_load_n(&_header->tail, __ATOMIC_RELAXED);
+            }
+        }
+
+        header->size = size;
+        memcpy(header + 1, data, size);
+        __atomic_store_n(&header->sequence, position + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    bool channel::try_receive_mpmc(void* data, size_t& size) {
+        auto position = __atomic_load_n(&_header->head, __ATOMIC_RELAXED);
+        slot_header_t* header;
+        while (true) {
+            header = slot(position);
+            auto sequence = __atomic_load_n(&header->sequence, __ATOMIC_ACQUIRE);
+            auto difference = static_cast<int64_t>(sequence - (position + 1));
+            if (difference == 0) {
+                if (__atomic_compare_exchange_n(
+                        &_header->head,
+                        &position,
+                        position + 1,
+                        true,
+                        __ATOMIC_RELAXED,
+                        __ATOMIC_RELAXED)) {
+                    break;
+                }
+            } else if (difference < 0) {
+                return false;
+            } else {
+                position = __atomic_load_n(&_header->head, __ATOMIC_RELAXED);
+            }
+        }
+
+        size = header->size;
+        memcpy(data, header + 1, size);
+        // hand the slot to the sender one lap ahead
+        __atomic_store_n(&header->sequence, position + _capacity, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    void channel_registry::add(uint64_t id, channel* channel) {
+        _channels[id] = channel;
+    }
+
+    channel* channel_registry::find(uint64_t id) const {
+        auto it = _channels.find(id);
+        if (it == _channels.end())
+            return nullptr;
+        return it->second;
+    }
+
+};
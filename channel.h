@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <unordered_map>
+#include "result.h"
+
+namespace basecode {
+
+    enum class channel_kind : uint8_t {
+        spsc,
+        mpmc,
+    };
+
+    // bounded, lock-free ring of fixed-size message slots used to stream data
+    // between terps without going through the host.  the ring and its indexes
+    // live in one MAP_SHARED mapping, so a channel created before fork() keeps
+    // working across the processes.
+    //
+    //  - spsc: one sender and one receiver.  each side owns one index and only
+    //    reads the other's when its cached copy says the ring is full/empty.
+    //  - mpmc: any number of senders and receivers.  slots carry a sequence
+    //    number (Vyukov's bounded queue): a sender claims a slot with a cas on
+    //    the tail once its sequence says it is free, and publishes it by
+    //    bumping the sequence; receivers do the same on the head.
+    //
+    // messages carry 1 to message_size bytes.  try_send/try_receive never
+    // block; they fail when the ring is full/empty.
+    class channel {
+    public:
+        channel(channel_kind kind, size_t capacity, size_t message_size);
+
+        channel(const channel&) = delete;
+
+        channel& operator=(const channel&) = delete;
+
+        virtual ~channel();
+
+        channel_kind kind() const;
+
+        size_t capacity() const;
+
+        size_t message_size() const;
+
+        // capacity is rounded up to a power of two
+        bool initialize(result& r);
+
+        bool try_send(const void* data, size_t size);
+
+        // `data` must have room for message_size() bytes
+        bool try_receive(void* data, size_t& size);
+
+    private:
+        static const size_t cache_line_size = 64;
+
+        // head and tail on separate lines so senders and receivers don't
+        // invalidate each other's cached index on every message
+        struct ring_header_t {
+            alignas(cache_line_size) uint64_t head;
+            uint64_t cached_tail;
+            alignas(cache_line_size) uint64_t tail;
+            uint64_t cached_head;
+        };
+
+        struct slot_header_t {
+            uint64_t sequence;
+            uint64_t size;
+        };
+
+        slot_header_t* slot(uint64_t index) const;
+
+        bool try_send_spsc(const void* data, size_t size);
+
+        bool try_receive_spsc(void* data, size_t& size);
+
+        bool try_send_mpmc(const void* data, size_t size);
+
+        bool try_receive_mpmc(void* data, size_t& size);
+
+    private:
+        channel_kind _kind;
+        size_t _capacity;
+        size_t _message_size;
+        size_t _slot_size = 0;
+        size_t _mapping_size = 0;
+        uint8_t* _mapping = nullptr;
+        ring_header_t* _header = nullptr;
+    };
+
+    class channel_registry {
+    public:
+        channel_registry() = default;
+
+        void add(uint64_t id, channel* channel);
+
+        channel* find(uint64_t id) const;
+
+    private:
+        std::unordered_map<uint64_t, channel*> _channels {};
+    };
+
+};
@@ -0,0 +1,249 @@
+#include <cstring>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fmt/format.h>
+#include "terp.h"
+#include "code_cache.h"
+
+namespace basecode {
+
+    static const char s_magic[8] = {'B', 'C', 'C', 'A', 'C', 'H', 'E', '\0'};
+
+    struct cache_file_header_t {
+        char magic[8];
+        uint32_t format_version;
+        uint32_t vm_version;
+        uint64_t key;
+        // decoded forms are stored as raw instruction_t
+        uint32_t instruction_size;
+        uint32_t section_count;
+        uint64_t payload_size;
+        uint64_t checksum;
+    };
+
+    struct cache_section_header_t {
+        uint32_t kind;
+        uint32_t reserved;
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    static size_t align8(size_t value) {
+        return (value + 7) & ~size_t(7);
+    }
+
+    // FNV-1a style mixing a qword at a time; fast enough to checksum
+    // megabytes of cached code on every load
+    static uint64_t hash_bytes(const uint8_t* data, size_t size, uint64_t hash) {
+        const uint64_t prime = 0x100000001b3;
+        size_t offset = 0;
+        for (; offset + sizeof(uint64_t) <= size; offset += sizeof(uint64_t)) {
+            uint64_t word;
+            memcpy(&word, data + offset, sizeof(word));
+            hash = (hash ^ word) * prime;
+            hash ^= hash >> 29;
+        }
+        for (; offset < size; offset++)
+            hash = (hash ^ data[offset]) * prime;
+        return hash;
+    }
+
+    static bool write_all(int fd, const uint8_t* data, size_t size) {
+        size_t written = 0;
+        while (written < size) {
+            auto count = write(fd, data + written, size - written);
+            if (count <= 0)
+                return false;
+            written += static_cast<size_t>(count);
+        }
+        return true;
+    }
+
+    code_cache_entry::~code_cache_entry() {
+        release();
+    }
+
+    void code_cache_entry::release() {
+        if (_mapping != nullptr) {
+            munmap(_mapping, _mapping_size);
+            _mapping = nullptr;
+            _mapping_size = 0;
+        }
+    }
+
+    uint64_t code_cache_entry::key() const {
+        if (_mapping == nullptr)
+            return 0;
+        return reinterpret_cast<const cache_file_header_t*>(_mapping)->key;
+    }
+
+    bool code_cache_entry::is_valid() const {
+        return _mapping != nullptr;
+    }
+
+    bool code_cache_entry::find(cache_section kind, const uint8_t*& data, size_t& size) const {
+        if (_mapping == nullptr)
+            return false;
+
+        auto header = reinterpret_cast<const cache_file_header_t*>(_mapping);
+        auto sections = reinterpret_cast<const cache_section_header_t*>(header + 1);
+        for (uint32_t i = 0; i < header->section_count; i++) {
+            if (sections[i].kind != static_cast<uint32_t>(kind))
+                continue;
+            data = _mapping + sections[i].offset;
+            size = sections[i].size;
+            return true;
+        }
+        return false;
+    }
+
+    code_cache::code_cache(const std::string& directory) : _directory(directory) {
+    }
+
+    uint64_t code_cache::program_key(terp& terp, uint64_t start, uint64_t end) {
+        uint64_t hash = 0xcbf29ce484222325;
+        uint64_t versions = (uint64_t(terp::vm_version) << 32) | format_version;
+        hash = hash_bytes(reinterpret_cast<const uint8_t*>(&versions), sizeof(versions), hash);
+        hash = hash_bytes(reinterpret_cast<const uint8_t*>(&start), sizeof(start), hash);
+
+        // encode() leaves whatever was in the heap in an instruction's unused
+        // bytes, so each one is re-encoded into zeroed scratch before hashing
+        auto heap = terp.heap();
+        auto address = start;
+        while (address < end) {
+            result decode_result;
+            instruction_t inst;
+            auto size = inst.decode(decode_result, heap, address);
+            if (size == 0 || size > 64 || address + size > end) {
+                hash = hash_bytes(heap + address, std::min<uint64_t>(8, end - address), hash);
+                address += 8;
+                continue;
+            }
+
+            uint8_t scratch[64] {};
+            inst.encode(decode_result, scratch, 0);
+            hash = hash_bytes(scratch, size, hash);
+            address += size;
+        }
+        return hash;
+    }
+
+    std::string code_cache::entry_path(uint64_t key) const {
+        return fmt::format("{}/{:016x}.bccache", _directory, key);
+    }
+
+    bool code_cache::load(result& r, uint64_t key, code_cache_entry& entry) const {
+        entry.release();
+
+        auto path = entry_path(key);
+        auto fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1)
+            return false;
+
+        struct stat info {};
+        if (fstat(fd, &info) != 0
+        ||  static_cast<size_t>(info.st_size) < sizeof(cache_file_header_t)) {
+            close(fd);
+            r.add_message("B025", fmt::format("cache entry {} is truncated.", path), false);
+            return false;
+        }
+
+        auto size = static_cast<size_t>(info.st_size);
+        auto mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED) {
+            r.add_message("B025", fmt::format("unable to map cache entry {}.", path), false);
+            return false;
+        }
+
+        auto bytes = static_cast<uint8_t*>(mapping);
+        auto header = reinterpret_cast<const cache_file_header_t*>(bytes);
+        auto table_size = sizeof(cache_section_header_t) * size_t(header->section_count);
+
+        std::string problem;
+        if (memcmp(header->magic, s_magic, sizeof(s_magic)) != 0)
+            problem = "is not a cache entry";
+        else if (header->format_version != format_version || header->vm_version != terp::vm_version)
+            problem = "was written by another version";
+        else if (header->key != key || header->instruction_size != sizeof(instruction_t))
+            problem = "doesn't match the program";
+        else if (header->section_count > size / sizeof(cache_section_header_t)
+             ||  sizeof(cache_file_header_t) + table_size > size
+             ||  header->payload_size != size - sizeof(cache_file_header_t) - table_size)
+            problem = "is truncated";
+        else if (hash_bytes(bytes + sizeof(cache_file_header_t), size - sizeof(cache_file_header_t), key)
+                    != header->checksum)
+            problem = "fails its checksum";
+
+        if (problem.empty()) {
+            auto sections = reinterpret_cast<const cache_section_header_t*>(header + 1);
+            for (uint32_t i = 0; i < header->section_count; i++) {
+                if (sections[i].offset > size || sections[i].size > size - sections[i].offset) {
+                    problem = "has a section outside the file";
+                    break;
+                }
+            }
+        }
+
+        if (!problem.empty()) {
+            munmap(mapping, size);
+            r.add_message("B025", fmt::format("cache entry {} {}; ignoring it.", path, problem), false);
+            return false;
+        }
+
+        entry._mapping = bytes;
+        entry._mapping_size = size;
+        return true;
+    }
+
+    bool code_cache::store(result& r, uint64_t key, const code_cache_sections& sections) const {
+        cache_file_header_t header {};
+        memcpy(header.magic, s_magic, sizeof(s_magic));
+        header.format_version = format_version;
+        header.vm_version = terp::vm_version;
+        header.key = key;
+        header.instruction_size = sizeof(instruction_t);
+        header.section_count = static_cast<uint32_t>(sections.size());
+
+        // everything after the file header: section table, then the payloads
+        // on 8-byte boundaries so they can be read in place
+        auto table_size = sizeof(cache_section_header_t) * sections.size();
+        std::vector<uint8_t> body(table_size);
+        size_t index = 0;
+        for (const auto& section : sections) {
+            cache_section_header_t section_header {};
+            section_header.kind = static_cast<uint32_t>(section.first);
+            section_header.offset = sizeof(cache_file_header_t) + body.size();
+            section_header.size = section.second.size();
+            memcpy(body.data() + index * sizeof(section_header), &section_header, sizeof(section_header));
+            body.insert(body.end(), section.second.begin(), section.second.end());
+            body.resize(align8(body.size()));
+            index++;
+        }
+        header.payload_size = body.size() - table_size;
+        header.checksum = hash_bytes(body.data(), body.size(), key);
+
+        auto path = entry_path(key);
+        auto temporary_path = fmt::format("{}.{}.tmp", path, getpid());
+        auto fd = open(temporary_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd == -1) {
+            r.add_message("B025", fmt::format("unable to create cache entry {}.", path), true);
+            return false;
+        }
+
+        auto written = write_all(fd, reinterpret_cast<const uint8_t*>(&header), sizeof(header))
+            && write_all(fd, body.data(), body.size());
+        close(fd);
+        if (!written || rename(temporary_path.c_str(), path.c_str()) != 0) {
+            unlink(temporary_path.c_str());
+            r.add_message("B025", fmt::format("unable to write cache entry {}.", path), true);
+            return false;
+        }
+
+        return true;
+    }
+
+};
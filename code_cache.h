@@ -0,0 +1,79 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "result.h"
+
+namespace basecode {
+
+    class terp;
+
+    enum class cache_section : uint32_t {
+        verified_range = 1,
+        compiled_loops,
+        c_source,
+        native_code,
+    };
+
+    using code_cache_sections = std::map<cache_section, std::vector<uint8_t>>;
+
+    // read-only view of one cache entry, mapped straight from its file.
+    // section data points into the mapping and lives as long as the entry.
+    class code_cache_entry {
+    public:
+        code_cache_entry() = default;
+
+        code_cache_entry(const code_cache_entry&) = delete;
+
+        code_cache_entry& operator=(const code_cache_entry&) = delete;
+
+        virtual ~code_cache_entry();
+
+        void release();
+
+        uint64_t key() const;
+
+        bool is_valid() const;
+
+        bool find(cache_section kind, const uint8_t*& data, size_t& size) const;
+
+    private:
+        friend class code_cache;
+
+        uint8_t* _mapping = nullptr;
+        size_t _mapping_size = 0;
+    };
+
+    // on-disk cache of everything derived from an encoded program: the
+    // verified range, pre-decoded loops, translated C and whatever native
+    // code the host built from it.  entries are keyed by a content hash of the
+    // program's encoded instructions mixed with terp::vm_version, one file per
+    // key, so a restarted process running the same program starts warm.
+    //
+    // store() writes a temporary file and renames it into place, so readers
+    // never see a partial entry.  load() maps the file and checks its magic,
+    // versions, key, instruction layout, section table and payload checksum;
+    // an entry failing any of them is reported as a B025 warning and treated
+    // as a miss.
+    class code_cache {
+    public:
+        static const uint32_t format_version = 2;
+
+        explicit code_cache(const std::string& directory);
+
+        static uint64_t program_key(terp& terp, uint64_t start, uint64_t end);
+
+        std::string entry_path(uint64_t key) const;
+
+        // false without a message when there is no entry for the key
+        bool load(result& r, uint64_t key, code_cache_entry& entry) const;
+
+        bool store(result& r, uint64_t key, const code_cache_sections& sections) const;
+
+    private:
+        std::string _directory;
+    };
+
+};
@@ -0,0 +1,243 @@
+#include <mutex>
+#include <algorithm>
+#include "heap_allocator.h"
+
+namespace basecode {
+
+    static const uint32_t s_region_magic = 0x48454150;         // HEAP
+    static const uint64_t s_allocated_tag = 0xa110ca7ed0000000;
+    static const uint64_t s_free_tag = 0xf4eeb10c00000000;
+    static const uint64_t s_large_class = 0xff;
+
+    // allocators attached to the same region (guest threads on one heap) hash
+    // to the same host mutex
+    static std::mutex s_region_locks[64];
+
+    static inline uint64_t align16(uint64_t value) {
+        return (value + 15) & ~uint64_t(15);
+    }
+
+    static inline size_t size_class(uint64_t size) {
+        size_t index = 0;
+        uint64_t class_size = heap_allocator::min_block_size;
+        while (class_size < size) {
+            class_size <<= 1;
+            index++;
+        }
+        return index;
+    }
+
+    void heap_allocator::attach(uint8_t* heap, uint64_t base, uint64_t end) {
+        _heap = heap;
+        _base = align16(base);
+        _end = end & ~uint64_t(15);
+        for (auto& cache : _caches)
+            cache.count = 0;
+    }
+
+    void heap_allocator::detach() {
+        _heap = nullptr;
+        _base = 0;
+        _end = 0;
+    }
+
+    bool heap_allocator::is_attached() const {
+        return _heap != nullptr;
+    }
+
+    void heap_allocator::format() {
+        if (_heap == nullptr)
+            return;
+
+        auto header = region();
+        header->reserved = 0;
+        header->magic = s_region_magic;
+        header->bump = align16(_base + sizeof(region_header_t));
+        header->end = _end;
+        header->large_free = 0;
+        for (auto& list : header->free_lists)
+            list = 0;
+
+        for (auto& cache : _caches)
+            cache.count = 0;
+    }
+
+    void heap_allocator::flush() {
+        if (_heap == nullptr)
+            return;
+
+        lock();
+        auto header = region();
+        for (size_t index = 0; index < size_class_count; index++) {
+            auto& cache = _caches[index];
+            while (cache.count > 0) {
+                auto address = cache.blocks[--cache.count];
+                next_link(address) = header->free_lists[index];
+                header->free_lists[index] = address;
+            }
+        }
+        unlock();
+    }
+
+    uint64_t heap_allocator::allocate(uint64_t size) {
+        if (_heap == nullptr || size == 0)
+            return 0;
+
+        // can never fit, and align16 would wrap sizes near UINT64_MAX to 0
+        if (size > _end - _base)
+            return 0;
+
+        if (size > max_small_size)
+            return allocate_large(align16(size));
+
+        auto index = size_class(size);
+        auto& cache = _caches[index];
+        if (cache.count == 0) {
+            lock();
+            auto header = region();
+            while (cache.count < cache_batch && header->free_lists[index] != 0) {
+                auto address = pop_free_list(header->free_lists[index], min_block_size << index);
+                if (address == 0)
+                    break;
+                cache.blocks[cache.count++] = address;
+            }
+            unlock();
+
+            if (cache.count == 0)
+                return carve(min_block_size << index, index);
+        }
+
+        auto address = cache.blocks[--cache.count];
+        block_header(address)->tag = s_allocated_tag | index;
+        return address;
+    }
+
+    bool heap_allocator::release(uint64_t address) {
+        if (_heap == nullptr || !is_block(address, min_block_size))
+            return false;
+
+        auto header = block_header(address);
+        if ((header->tag & ~uint64_t(0xff)) != s_allocated_tag)
+            return false;
+
+        // the tag and size are guest-writable: only a class that exists, and a
+        // block that fits the pool, are taken back
+        auto index = header->tag & 0xff;
+        if (index == s_large_class) {
+            if (!is_block(address, header->size))
+                return false;
+        } else if (index >= size_class_count || !is_block(address, min_block_size << index)) {
+            return false;
+        }
+        header->tag = s_free_tag | index;
+
+        if (index == s_large_class) {
+            lock();
+            next_link(address) = region()->large_free;
+            region()->large_free = address;
+            unlock();
+            return true;
+        }
+
+        auto& cache = _caches[index];
+        if (cache.count == cache_capacity) {
+            lock();
+            auto region_header = region();
+            while (cache.count > cache_capacity - cache_batch) {
+                auto cached = cache.blocks[--cache.count];
+                next_link(cached) = region_header->free_lists[index];
+                region_header->free_lists[index] = cached;
+            }
+            unlock();
+        }
+        cache.blocks[cache.count++] = address;
+        return true;
+    }
+
+    void heap_allocator::lock() {
+        s_region_locks[(reinterpret_cast<uintptr_t>(region()) >> 4) % 64].lock();
+    }
+
+    void heap_allocator::unlock() {
+        s_region_locks[(reinterpret_cast<uintptr_t>(region()) >> 4) % 64].unlock();
+    }
+
+    heap_allocator::region_header_t* heap_allocator::region() {
+        return reinterpret_cast<region_header_t*>(_heap + _base);
+    }
+
+    bool heap_allocator::is_block(uint64_t address, uint64_t size) const {
+        return address % 16 == 0
+            && address >= align16(_base + sizeof(region_header_t)) + sizeof(block_header_t)
+            && address <= _end
+            && size <= _end - address;
+    }
+
+    uint64_t heap_allocator::pop_free_list(uint64_t& list, uint64_t size) {
+        auto address = list;
+        if (!is_block(address, size)) {
+            // a forged link: drop the rest of the list rather than follow it
+            list = 0;
+            return 0;
+        }
+        list = next_link(address);
+        return address;
+    }
+
+    uint64_t& heap_allocator::next_link(uint64_t address) {
+        return *reinterpret_cast<uint64_t*>(_heap + address);
+    }
+
+    heap_allocator::block_header_t* heap_allocator::block_header(uint64_t address) {
+        return reinterpret_cast<block_header_t*>(_heap + address - sizeof(block_header_t));
+    }
+
+    uint64_t heap_allocator::carve(uint64_t size, uint64_t tag) {
+        lock();
+        auto header = region();
+        auto end = std::min(header->end, _end);
+        auto bump = header->bump;
+        if (bump % 16 != 0
+        ||  bump < align16(_base + sizeof(region_header_t))
+        ||  bump > end
+        ||  sizeof(block_header_t) + size > end - bump) {
+            unlock();
+            return 0;
+        }
+        auto address = bump + sizeof(block_header_t);
+        header->bump = address + size;
+        unlock();
+
+        auto block = block_header(address);
+        block->size = size;
+        block->tag = s_allocated_tag | tag;
+        return address;
+    }
+
+    uint64_t heap_allocator::allocate_large(uint64_t size) {
+        lock();
+        auto header = region();
+        auto link = &header->large_free;
+        // a cycle forged into the list can't outlast the pool's block count
+        auto steps = (_end - _base) / min_block_size;
+        while (*link != 0 && steps-- > 0) {
+            auto address = *link;
+            if (!is_block(address, min_block_size)) {
+                *link = 0;
+                break;
+            }
+            auto block = block_header(address);
+            if (block->size >= size && is_block(address, block->size)) {
+                *link = next_link(address);
+                block->tag = s_allocated_tag | s_large_class;
+                unlock();
+                return address;
+            }
+            link = &next_link(address);
+        }
+        unlock();
+
+        return carve(size, s_large_class);
+    }
+
+};
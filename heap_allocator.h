@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace basecode {
+
+    // allocator behind the alloc/free instructions.  all of its shared state
+    // lives inside the terp heap, at the start of the region it manages, so
+    // snapshots and forks carry the allocator along with the data:
+    //
+    //  - requests up to 2KB are rounded to one of eight power-of-two size
+    //    classes and served from per-class free lists;
+    //  - larger requests are served first-fit from a list of freed large blocks;
+    //  - everything else is carved from a bump pointer, and format() releases
+    //    every allocation at once by rewinding it (terp::reset() does this).
+    //
+    // each heap_allocator instance also keeps a small local cache per size class
+    // that it refills and drains in batches, so several threads sharing one heap
+    // only touch the lock-protected shared lists occasionally.
+    //
+    // the guest can write everything in the region, so nothing read from it is
+    // trusted: list links, the bump pointer and block headers are checked
+    // against the pool before the host dereferences them, and the lock guarding
+    // the shared lists is a host mutex, out of the guest's reach.
+    class heap_allocator {
+    public:
+        static const size_t size_class_count = 8;
+        static const size_t min_block_size = 16;
+        static const size_t max_small_size = min_block_size << (size_class_count - 1);
+
+        heap_allocator() = default;
+
+        void detach();
+
+        void format();
+
+        void flush();
+
+        bool is_attached() const;
+
+        uint64_t allocate(uint64_t size);
+
+        bool release(uint64_t address);
+
+        void attach(uint8_t* heap, uint64_t base, uint64_t end);
+
+    private:
+        static const size_t cache_capacity = 32;
+        static const size_t cache_batch = cache_capacity / 2;
+
+        struct region_header_t {
+            uint32_t reserved;
+            uint32_t magic;
+            uint64_t bump;
+            uint64_t end;
+            uint64_t large_free;
+            uint64_t free_lists[size_class_count];
+        };
+
+        struct block_header_t {
+            uint64_t size;
+            uint64_t tag;
+        };
+
+        struct cache_t {
+            size_t count = 0;
+            uint64_t blocks[cache_capacity];
+        };
+
+        void lock();
+
+        void unlock();
+
+        region_header_t* region();
+
+        bool is_block(uint64_t address, uint64_t size) const;
+
+        uint64_t pop_free_list(uint64_t& list, uint64_t size);
+
+        uint64_t& next_link(uint64_t address);
+
+        block_header_t* block_header(uint64_t address);
+
+        uint64_t carve(uint64_t size, uint64_t tag);
+
+        uint64_t allocate_large(uint64_t size);
+
+    private:
+        uint8_t* _heap = nullptr;
+        uint64_t _base = 0;
+        uint64_t _end = 0;
+        cache_t _caches[size_class_count] {};
+    };
+
+};
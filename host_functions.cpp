@@ -0,0 +1,18 @@
+#include "host_functions.h"
+
+namespace basecode {
+
+    void host_function_registry::add(
+            uint64_t id,
+            const host_function_callable& function) {
+        _functions[id] = function;
+    }
+
+    const host_function_callable* host_function_registry::find(uint64_t id) const {
+        auto it = _functions.find(id);
+        if (it == _functions.end())
+            return nullptr;
+        return &it->second;
+    }
+
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include "result.h"
+
+namespace basecode {
+
+    class terp;
+
+    enum class host_call_status : uint8_t {
+        completed,
+        suspended,
+        failed,
+    };
+
+    // a host function receives the calling terp and returns its result in `value`,
+    // which the interpreter stores into I0.  a function that has to wait (e.g. on
+    // I/O) returns host_call_status::suspended instead; the terp then stops with
+    // run_status::suspended and stays parked until terp::complete_host_call()
+    // hands it the result, after which any thread may run() it again.
+    using host_function_callable = std::function<host_call_status (result&, terp&, uint64_t& value)>;
+
+    class host_function_registry {
+    public:
+        host_function_registry() = default;
+
+        void add(uint64_t id, const host_function_callable& function);
+
+        const host_function_callable* find(uint64_t id) const;
+
+    private:
+        std::unordered_map<uint64_t, host_function_callable> _functions {};
+    };
+
+};
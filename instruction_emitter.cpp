@@ -1,5 +1,6 @@
 #include "terp.h"
 #include "instruction_emitter.h"
+#include "partial_evaluator.h"
 
 namespace basecode {
 
@@ -32,6 +33,10 @@ namespace basecode {
         return size;
     }
 
+    size_t instruction_emitter::instruction_count() const {
+        return _instructions.size();
+    }
+
     uint64_t instruction_emitter::end_address() const {
         return _start_address + size();
     }
@@ -75,6 +80,142 @@ namespace basecode {
         _instructions.push_back(add_op);
     }
 
+    void instruction_emitter::add_with_carry_register_to_register(
+            op_sizes size,
+            uint8_t target_index,
+            uint8_t lhs_index,
+            uint8_t rhs_index) {
+        basecode::instruction_t addc_op;
+        addc_op.op = basecode::op_codes::addc;
+        addc_op.size = size;
+        addc_op.operands_count = 3;
+        addc_op.operands[0].type = basecode::operand_types::register_integer;
+        addc_op.operands[0].index = target_index;
+        addc_op.operands[1].type = basecode::operand_types::register_integer;
+        addc_op.operands[1].index = lhs_index;
+        addc_op.operands[2].type = basecode::operand_types::register_integer;
+        addc_op.operands[2].index = rhs_index;
+        _instructions.push_back(addc_op);
+    }
+
+    void instruction_emitter::subtract_with_borrow_register_to_register(
+            op_sizes size,
+            uint8_t target_index,
+            uint8_t lhs_index,
+            uint8_t rhs_index) {
+        basecode::instruction_t subc_op;
+        subc_op.op = basecode::op_codes::subc;
+        subc_op.size = size;
+        subc_op.operands_count = 3;
+        subc_op.operands[0].type = basecode::operand_types::register_integer;
+        subc_op.operands[0].index = target_index;
+        subc_op.operands[1].type = basecode::operand_types::register_integer;
+        subc_op.operands[1].index = lhs_index;
+        subc_op.operands[2].type = basecode::operand_types::register_integer;
+        subc_op.operands[2].index = rhs_index;
+        _instructions.push_back(subc_op);
+    }
+
+    void instruction_emitter::multiply_wide(
+            uint8_t high_index,
+            uint8_t low_index,
+            uint8_t lhs_index,
+            uint8_t rhs_index) {
+        basecode::instruction_t mulx_op;
+        mulx_op.op = basecode::op_codes::mulx;
+        mulx_op.size = basecode::op_sizes::qword;
+        mulx_op.operands_count = 4;
+        mulx_op.operands[0].type = basecode::operand_types::register_integer;
+        mulx_op.operands[0].index = high_index;
+        mulx_op.operands[1].type = basecode::operand_types::register_integer;
+        mulx_op.operands[1].index = low_index;
+        mulx_op.operands[2].type = basecode::operand_types::register_integer;
+        mulx_op.operands[2].index = lhs_index;
+        mulx_op.operands[3].type = basecode::operand_types::register_integer;
+        mulx_op.operands[3].index = rhs_index;
+        _instructions.push_back(mulx_op);
+    }
+
+    void instruction_emitter::divide_wide(
+            uint8_t low_index,
+            uint8_t high_index,
+            uint8_t divisor_index) {
+        basecode::instruction_t divx_op;
+        divx_op.op = basecode::op_codes::divx;
+        divx_op.size = basecode::op_sizes::qword;
+        divx_op.operands_count = 3;
+        divx_op.operands[0].type = basecode::operand_types::register_integer;
+        divx_op.operands[0].index = low_index;
+        divx_op.operands[1].type = basecode::operand_types::register_integer;
+        divx_op.operands[1].index = high_index;
+        divx_op.operands[2].type = basecode::operand_types::register_integer;
+        divx_op.operands[2].index = divisor_index;
+        _instructions.push_back(divx_op);
+    }
+
+    void instruction_emitter::add_big_integer(
+            uint8_t target_index,
+            uint8_t lhs_index,
+            uint8_t rhs_index,
+            size_t limbs,
+            uint8_t scratch_index) {
+        big_integer_op(
+                op_codes::add,
+                op_codes::addc,
+                target_index,
+                lhs_index,
+                rhs_index,
+                limbs,
+                scratch_index);
+    }
+
+    void instruction_emitter::subtract_big_integer(
+            uint8_t target_index,
+            uint8_t lhs_index,
+            uint8_t rhs_index,
+            size_t limbs,
+            uint8_t scratch_index) {
+        big_integer_op(
+                op_codes::sub,
+                op_codes::subc,
+                target_index,
+                lhs_index,
+                rhs_index,
+                limbs,
+                scratch_index);
+    }
+
+    void instruction_emitter::big_integer_op(
+            op_codes first_op,
+            op_codes chained_op,
+            uint8_t target_index,
+            uint8_t lhs_index,
+            uint8_t rhs_index,
+            size_t limbs,
+            uint8_t scratch_index) {
+        for (size_t limb = 0; limb < limbs; limb++) {
+            auto offset = limb * sizeof(uint64_t);
+            load_with_offset_to_register(lhs_index, scratch_index, offset);
+            load_with_offset_to_register(rhs_index, scratch_index + 1, offset);
+
+            // loads and stores leave the carry flag alone, so it flows from
+            // one limb's op into the next
+            basecode::instruction_t limb_op;
+            limb_op.op = limb == 0 ? first_op : chained_op;
+            limb_op.size = basecode::op_sizes::qword;
+            limb_op.operands_count = 3;
+            limb_op.operands[0].type = basecode::operand_types::register_integer;
+            limb_op.operands[0].index = scratch_index;
+            limb_op.operands[1].type = basecode::operand_types::register_integer;
+            limb_op.operands[1].index = scratch_index;
+            limb_op.operands[2].type = basecode::operand_types::register_integer;
+            limb_op.operands[2].index = scratch_index + 1;
+            _instructions.push_back(limb_op);
+
+            store_with_offset_from_register(scratch_index, target_index, offset);
+        }
+    }
+
     void instruction_emitter::load_stack_offset_to_register(
             uint8_t target_index,
             uint64_t offset) {
@@ -132,9 +273,19 @@ namespace basecode {
                 return false;
             offset += inst_size;
         }
+        if (_pure)
+            terp.mark_pure(_start_address);
         return true;
     }
 
+    void instruction_emitter::pure(bool value) {
+        _pure = value;
+    }
+
+    bool instruction_emitter::is_pure() const {
+        return _pure;
+    }
+
     void instruction_emitter::store_with_offset_from_register(
             uint8_t source_index,
             uint8_t target_index,
@@ -206,6 +357,175 @@ namespace basecode {
         _instructions.push_back(mul_op);
     }
 
+    void instruction_emitter::copy_memory(
+            op_sizes size,
+            uint8_t source_index,
+            uint8_t target_index,
+            uint64_t length) {
+        basecode::instruction_t copy_op;
+        copy_op.op = basecode::op_codes::copy;
+        copy_op.size = size;
+        copy_op.operands_count = 3;
+        copy_op.operands[0].type = basecode::operand_types::register_integer;
+        copy_op.operands[0].index = source_index;
+        copy_op.operands[1].type = basecode::operand_types::register_integer;
+        copy_op.operands[1].index = target_index;
+        copy_op.operands[2].type = basecode::operand_types::constant_integer;
+        copy_op.operands[2].value.u64 = length;
+        _instructions.push_back(copy_op);
+    }
+
+    void instruction_emitter::fill_memory(
+            op_sizes size,
+            uint64_t value,
+            uint8_t target_index,
+            uint64_t length) {
+        basecode::instruction_t fill_op;
+        fill_op.op = basecode::op_codes::fill;
+        fill_op.size = size;
+        fill_op.operands_count = 3;
+        fill_op.operands[0].type = basecode::operand_types::constant_integer;
+        fill_op.operands[0].value.u64 = value;
+        fill_op.operands[1].type = basecode::operand_types::register_integer;
+        fill_op.operands[1].index = target_index;
+        fill_op.operands[2].type = basecode::operand_types::constant_integer;
+        fill_op.operands[2].value.u64 = length;
+        _instructions.push_back(fill_op);
+    }
+
+    void instruction_emitter::compare_memory(
+            op_sizes size,
+            uint8_t target_index,
+            uint8_t lhs_index,
+            uint8_t rhs_index,
+            uint64_t length) {
+        basecode::instruction_t cmpm_op;
+        cmpm_op.op = basecode::op_codes::cmpm;
+        cmpm_op.size = size;
+        cmpm_op.operands_count = 4;
+        cmpm_op.operands[0].type = basecode::operand_types::register_integer;
+        cmpm_op.operands[0].index = target_index;
+        cmpm_op.operands[1].type = basecode::operand_types::register_integer;
+        cmpm_op.operands[1].index = lhs_index;
+        cmpm_op.operands[2].type = basecode::operand_types::register_integer;
+        cmpm_op.operands[2].index = rhs_index;
+        cmpm_op.operands[3].type = basecode::operand_types::constant_integer;
+        cmpm_op.operands[3].value.u64 = length;
+        _instructions.push_back(cmpm_op);
+    }
+
+    void instruction_emitter::find_in_memory(
+            op_sizes size,
+            uint8_t target_index,
+            uint64_t value,
+            uint8_t address_index,
+            uint64_t length) {
+        basecode::instruction_t find_op;
+        find_op.op = basecode::op_codes::find;
+        find_op.size = size;
+        find_op.operands_count = 4;
+        find_op.operands[0].type = basecode::operand_types::register_integer;
+        find_op.operands[0].index = target_index;
+        find_op.operands[1].type = basecode::operand_types::constant_integer;
+        find_op.operands[1].value.u64 = value;
+        find_op.operands[2].type = basecode::operand_types::register_integer;
+        find_op.operands[2].index = address_index;
+        find_op.operands[3].type = basecode::operand_types::constant_integer;
+        find_op.operands[3].value.u64 = length;
+        _instructions.push_back(find_op);
+    }
+
+    void instruction_emitter::alloc_int_constant(
+            uint8_t target_index,
+            uint64_t size) {
+        basecode::instruction_t alloc_op;
+        alloc_op.op = basecode::op_codes::alloc;
+        alloc_op.size = basecode::op_sizes::qword;
+        alloc_op.operands_count = 2;
+        alloc_op.operands[0].type = basecode::operand_types::register_integer;
+        alloc_op.operands[0].index = target_index;
+        alloc_op.operands[1].type = basecode::operand_types::constant_integer;
+        alloc_op.operands[1].value.u64 = size;
+        _instructions.push_back(alloc_op);
+    }
+
+    void instruction_emitter::alloc_int_register(
+            uint8_t target_index,
+            uint8_t size_index) {
+        basecode::instruction_t alloc_op;
+        alloc_op.op = basecode::op_codes::alloc;
+        alloc_op.size = basecode::op_sizes::qword;
+        alloc_op.operands_count = 2;
+        alloc_op.operands[0].type = basecode::operand_types::register_integer;
+        alloc_op.operands[0].index = target_index;
+        alloc_op.operands[1].type = basecode::operand_types::register_integer;
+        alloc_op.operands[1].index = size_index;
+        _instructions.push_back(alloc_op);
+    }
+
+    void instruction_emitter::free_int_register(uint8_t index) {
+        basecode::instruction_t free_op;
+        free_op.op = basecode::op_codes::free;
+        free_op.size = basecode::op_sizes::qword;
+        free_op.operands_count = 1;
+        free_op.operands[0].type = basecode::operand_types::register_integer;
+        free_op.operands[0].index = index;
+        _instructions.push_back(free_op);
+    }
+
+    void instruction_emitter::integer_arithmetic(
+            op_codes op,
+            op_sizes size,
+            uint8_t target_index,
+            uint8_t lhs_index,
+            uint8_t rhs_index) {
+        basecode::instruction_t arithmetic_op;
+        arithmetic_op.op = op;
+        arithmetic_op.size = size;
+        arithmetic_op.operands_count = 3;
+        arithmetic_op.operands[0].type = basecode::operand_types::register_integer;
+        arithmetic_op.operands[0].index = target_index;
+        arithmetic_op.operands[1].type = basecode::operand_types::register_integer;
+        arithmetic_op.operands[1].index = lhs_index;
+        arithmetic_op.operands[2].type = basecode::operand_types::register_integer;
+        arithmetic_op.operands[2].index = rhs_index;
+        _instructions.push_back(arithmetic_op);
+    }
+
+    void instruction_emitter::integer_arithmetic_constant(
+            op_codes op,
+            op_sizes size,
+            uint8_t target_index,
+            uint8_t lhs_index,
+            uint64_t rhs_value) {
+        basecode::instruction_t arithmetic_op;
+        arithmetic_op.op = op;
+        arithmetic_op.size = size;
+        arithmetic_op.operands_count = 3;
+        arithmetic_op.operands[0].type = basecode::operand_types::register_integer;
+        arithmetic_op.operands[0].index = target_index;
+        arithmetic_op.operands[1].type = basecode::operand_types::register_integer;
+        arithmetic_op.operands[1].index = lhs_index;
+        arithmetic_op.operands[2].type = basecode::operand_types::constant_integer;
+        arithmetic_op.operands[2].value.u64 = rhs_value;
+        _instructions.push_back(arithmetic_op);
+    }
+
+    void instruction_emitter::move_int_register_to_register(
+            op_sizes size,
+            uint8_t source_index,
+            uint8_t target_index) {
+        basecode::instruction_t move_op;
+        move_op.op = basecode::op_codes::move;
+        move_op.size = size;
+        move_op.operands_count = 2;
+        move_op.operands[0].type = basecode::operand_types::register_integer;
+        move_op.operands[0].index = source_index;
+        move_op.operands[1].type = basecode::operand_types::register_integer;
+        move_op.operands[1].index = target_index;
+        _instructions.push_back(move_op);
+    }
+
     void instruction_emitter::move_int_constant_to_register(
             op_sizes size,
             uint64_t value,
@@ -231,6 +551,266 @@ namespace basecode {
         _instructions.push_back(jmp_op);
     }
 
+    void instruction_emitter::vector_load(
+            uint8_t target_index,
+            uint8_t address_index,
+            uint64_t offset) {
+        basecode::instruction_t vload_op;
+        vload_op.op = basecode::op_codes::vload;
+        vload_op.size = basecode::op_sizes::qword;
+        vload_op.operands_count = 3;
+        vload_op.operands[0].type = basecode::operand_types::register_vector;
+        vload_op.operands[0].index = target_index;
+        vload_op.operands[1].type = basecode::operand_types::register_integer;
+        vload_op.operands[1].index = address_index;
+        vload_op.operands[2].type = basecode::operand_types::constant_integer;
+        vload_op.operands[2].value.u64 = offset;
+        _instructions.push_back(vload_op);
+    }
+
+    void instruction_emitter::vector_store(
+            uint8_t source_index,
+            uint8_t address_index,
+            uint64_t offset) {
+        basecode::instruction_t vstore_op;
+        vstore_op.op = basecode::op_codes::vstore;
+        vstore_op.size = basecode::op_sizes::qword;
+        vstore_op.operands_count = 3;
+        vstore_op.operands[0].type = basecode::operand_types::register_vector;
+        vstore_op.operands[0].index = source_index;
+        vstore_op.operands[1].type = basecode::operand_types::register_integer;
+        vstore_op.operands[1].index = address_index;
+        vstore_op.operands[2].type = basecode::operand_types::constant_integer;
+        vstore_op.operands[2].value.u64 = offset;
+        _instructions.push_back(vstore_op);
+    }
+
+    void instruction_emitter::vector_splat_constant(
+            uint8_t target_index,
+            double value) {
+        basecode::instruction_t vsplat_op;
+        vsplat_op.op = basecode::op_codes::vsplat;
+        vsplat_op.size = basecode::op_sizes::qword;
+        vsplat_op.operands_count = 2;
+        vsplat_op.operands[0].type = basecode::operand_types::register_vector;
+        vsplat_op.operands[0].index = target_index;
+        vsplat_op.operands[1].type = basecode::operand_types::constant_float;
+        vsplat_op.operands[1].value.d64 = value;
+        _instructions.push_back(vsplat_op);
+    }
+
+    void instruction_emitter::vector_arithmetic(
+            op_codes op,
+            uint8_t target_index,
+            uint8_t lhs_index,
+            uint8_t rhs_index) {
+        basecode::instruction_t vector_op;
+        vector_op.op = op;
+        vector_op.size = basecode::op_sizes::qword;
+        vector_op.operands_count = 3;
+        vector_op.operands[0].type = basecode::operand_types::register_vector;
+        vector_op.operands[0].index = target_index;
+        vector_op.operands[1].type = basecode::operand_types::register_vector;
+        vector_op.operands[1].index = lhs_index;
+        vector_op.operands[2].type = basecode::operand_types::register_vector;
+        vector_op.operands[2].index = rhs_index;
+        _instructions.push_back(vector_op);
+    }
+
+    void instruction_emitter::vector_multiply_add(
+            uint8_t target_index,
+            uint8_t lhs_index,
+            uint8_t rhs_index,
+            uint8_t addend_index) {
+        basecode::instruction_t vfma_op;
+        vfma_op.op = basecode::op_codes::vfma;
+        vfma_op.size = basecode::op_sizes::qword;
+        vfma_op.operands_count = 4;
+        vfma_op.operands[0].type = basecode::operand_types::register_vector;
+        vfma_op.operands[0].index = target_index;
+        vfma_op.operands[1].type = basecode::operand_types::register_vector;
+        vfma_op.operands[1].index = lhs_index;
+        vfma_op.operands[2].type = basecode::operand_types::register_vector;
+        vfma_op.operands[2].index = rhs_index;
+        vfma_op.operands[3].type = basecode::operand_types::register_vector;
+        vfma_op.operands[3].index = addend_index;
+        _instructions.push_back(vfma_op);
+    }
+
+    void instruction_emitter::vector_reduce(
+            op_codes op,
+            uint8_t target_index,
+            uint8_t source_index) {
+        basecode::instruction_t reduce_op;
+        reduce_op.op = op;
+        reduce_op.size = basecode::op_sizes::qword;
+        reduce_op.operands_count = 2;
+        reduce_op.operands[0].type = basecode::operand_types::register_floating_point;
+        reduce_op.operands[0].index = target_index;
+        reduce_op.operands[1].type = basecode::operand_types::register_vector;
+        reduce_op.operands[1].index = source_index;
+        _instructions.push_back(reduce_op);
+    }
+
+    void instruction_emitter::call_host(uint64_t id) {
+        basecode::instruction_t hcall_op;
+        hcall_op.op = basecode::op_codes::hcall;
+        hcall_op.size = basecode::op_sizes::qword;
+        hcall_op.operands_count = 1;
+        hcall_op.operands[0].type = basecode::operand_types::constant_integer;
+        hcall_op.operands[0].value.u64 = id;
+        _instructions.push_back(hcall_op);
+    }
+
+    void instruction_emitter::spawn_thread(
+            uint8_t target_index,
+            uint64_t entry_address,
+            uint8_t argument_index) {
+        basecode::instruction_t spawn_op;
+        spawn_op.op = basecode::op_codes::spawn;
+        spawn_op.size = basecode::op_sizes::qword;
+        spawn_op.operands_count = 3;
+        spawn_op.operands[0].type = basecode::operand_types::register_integer;
+        spawn_op.operands[0].index = target_index;
+        spawn_op.operands[1].type = basecode::operand_types::constant_integer;
+        spawn_op.operands[1].value.u64 = entry_address;
+        spawn_op.operands[2].type = basecode::operand_types::register_integer;
+        spawn_op.operands[2].index = argument_index;
+        _instructions.push_back(spawn_op);
+    }
+
+    void instruction_emitter::join_thread(uint8_t target_index, uint8_t id_index) {
+        basecode::instruction_t join_op;
+        join_op.op = basecode::op_codes::join;
+        join_op.size = basecode::op_sizes::qword;
+        join_op.operands_count = 2;
+        join_op.operands[0].type = basecode::operand_types::register_integer;
+        join_op.operands[0].index = target_index;
+        join_op.operands[1].type = basecode::operand_types::register_integer;
+        join_op.operands[1].index = id_index;
+        _instructions.push_back(join_op);
+    }
+
+    void instruction_emitter::atomic_load(uint8_t target_index, uint8_t address_index) {
+        basecode::instruction_t aload_op;
+        aload_op.op = basecode::op_codes::aload;
+        aload_op.size = basecode::op_sizes::qword;
+        aload_op.operands_count = 2;
+        aload_op.operands[0].type = basecode::operand_types::register_integer;
+        aload_op.operands[0].index = target_index;
+        aload_op.operands[1].type = basecode::operand_types::register_integer;
+        aload_op.operands[1].index = address_index;
+        _instructions.push_back(aload_op);
+    }
+
+    void instruction_emitter::atomic_store(uint8_t address_index, uint8_t value_index) {
+        basecode::instruction_t astore_op;
+        astore_op.op = basecode::op_codes::astore;
+        astore_op.size = basecode::op_sizes::qword;
+        astore_op.operands_count = 2;
+        astore_op.operands[0].type = basecode::operand_types::register_integer;
+        astore_op.operands[0].index = value_index;
+        astore_op.operands[1].type = basecode::operand_types::register_integer;
+        astore_op.operands[1].index = address_index;
+        _instructions.push_back(astore_op);
+    }
+
+    void instruction_emitter::compare_and_swap(
+            uint8_t target_index,
+            uint8_t address_index,
+            uint8_t expected_index,
+            uint8_t desired_index) {
+        basecode::instruction_t cas_op;
+        cas_op.op = basecode::op_codes::cas;
+        cas_op.size = basecode::op_sizes::qword;
+        cas_op.operands_count = 4;
+        cas_op.operands[0].type = basecode::operand_types::register_integer;
+        cas_op.operands[0].index = target_index;
+        cas_op.operands[1].type = basecode::operand_types::register_integer;
+        cas_op.operands[1].index = address_index;
+        cas_op.operands[2].type = basecode::operand_types::register_integer;
+        cas_op.operands[2].index = expected_index;
+        cas_op.operands[3].type = basecode::operand_types::register_integer;
+        cas_op.operands[3].index = desired_index;
+        _instructions.push_back(cas_op);
+    }
+
+    void instruction_emitter::fetch_add(
+            uint8_t target_index,
+            uint8_t address_index,
+            uint8_t addend_index) {
+        basecode::instruction_t xadd_op;
+        xadd_op.op = basecode::op_codes::xadd;
+        xadd_op.size = basecode::op_sizes::qword;
+        xadd_op.operands_count = 3;
+        xadd_op.operands[0].type = basecode::operand_types::register_integer;
+        xadd_op.operands[0].index = target_index;
+        xadd_op.operands[1].type = basecode::operand_types::register_integer;
+        xadd_op.operands[1].index = address_index;
+        xadd_op.operands[2].type = basecode::operand_types::register_integer;
+        xadd_op.operands[2].index = addend_index;
+        _instructions.push_back(xadd_op);
+    }
+
+    void instruction_emitter::wait_on_address(uint8_t address_index, uint8_t expected_index) {
+        basecode::instruction_t wait_op;
+        wait_op.op = basecode::op_codes::wait;
+        wait_op.size = basecode::op_sizes::qword;
+        wait_op.operands_count = 2;
+        wait_op.operands[0].type = basecode::operand_types::register_integer;
+        wait_op.operands[0].index = address_index;
+        wait_op.operands[1].type = basecode::operand_types::register_integer;
+        wait_op.operands[1].index = expected_index;
+        _instructions.push_back(wait_op);
+    }
+
+    void instruction_emitter::notify_address(uint8_t address_index) {
+        basecode::instruction_t notify_op;
+        notify_op.op = basecode::op_codes::notify;
+        notify_op.size = basecode::op_sizes::qword;
+        notify_op.operands_count = 1;
+        notify_op.operands[0].type = basecode::operand_types::register_integer;
+        notify_op.operands[0].index = address_index;
+        _instructions.push_back(notify_op);
+    }
+
+    void instruction_emitter::send_message(
+            uint8_t target_index,
+            uint8_t channel_index,
+            uint8_t address_index,
+            uint8_t length_index) {
+        basecode::instruction_t send_op;
+        send_op.op = basecode::op_codes::send;
+        send_op.size = basecode::op_sizes::qword;
+        send_op.operands_count = 4;
+        send_op.operands[0].type = basecode::operand_types::register_integer;
+        send_op.operands[0].index = target_index;
+        send_op.operands[1].type = basecode::operand_types::register_integer;
+        send_op.operands[1].index = channel_index;
+        send_op.operands[2].type = basecode::operand_types::register_integer;
+        send_op.operands[2].index = address_index;
+        send_op.operands[3].type = basecode::operand_types::register_integer;
+        send_op.operands[3].index = length_index;
+        _instructions.push_back(send_op);
+    }
+
+    void instruction_emitter::receive_message(
+            uint8_t target_index,
+            uint8_t channel_index,
+            uint8_t address_index) {
+        basecode::instruction_t recv_op;
+        recv_op.op = basecode::op_codes::recv;
+        recv_op.size = basecode::op_sizes::qword;
+        recv_op.operands_count = 3;
+        recv_op.operands[0].type = basecode::operand_types::register_integer;
+        recv_op.operands[0].index = target_index;
+        recv_op.operands[1].type = basecode::operand_types::register_integer;
+        recv_op.operands[1].index = channel_index;
+        recv_op.operands[2].type = basecode::operand_types::register_integer;
+        recv_op.operands[2].index = address_index;
+        _instructions.push_back(recv_op);
+    }
+
     void instruction_emitter::pop_float_register(uint8_t index) {
         basecode::instruction_t pop_op;
         pop_op.op = basecode::op_codes::pop;
@@ -287,6 +867,181 @@ namespace basecode {
         _instructions.push_back(jsr_op);
     }
 
+    void instruction_emitter::jump_subroutine_tail_indirect(uint8_t index) {
+        basecode::instruction_t tjsr_op;
+        tjsr_op.op = basecode::op_codes::tjsr;
+        tjsr_op.size = basecode::op_sizes::qword;
+        tjsr_op.operands_count = 1;
+        tjsr_op.operands[0].type = basecode::operand_types::register_integer;
+        tjsr_op.operands[0].index = index;
+        _instructions.push_back(tjsr_op);
+    }
+
+    void instruction_emitter::jump_subroutine_tail_direct(uint64_t address) {
+        basecode::instruction_t tjsr_op;
+        tjsr_op.op = basecode::op_codes::tjsr;
+        tjsr_op.size = basecode::op_sizes::qword;
+        tjsr_op.operands_count = 1;
+        tjsr_op.operands[0].type = basecode::operand_types::constant_integer;
+        tjsr_op.operands[0].value.u64 = address;
+        _instructions.push_back(tjsr_op);
+    }
+
+    size_t instruction_emitter::optimize_tail_calls() {
+        auto is_register = [](const instruction_t& inst, uint8_t operand, uint8_t index) {
+            return inst.operands[operand].type == operand_types::register_integer
+                && inst.operands[operand].index == index;
+        };
+
+        size_t count = 0;
+        for (size_t i = 0; i + 4 < _instructions.size(); i++) {
+            const auto& push_op = _instructions[i];
+            const auto& jsr_op = _instructions[i + 1];
+            const auto& pop_op = _instructions[i + 2];
+            const auto& store_op = _instructions[i + 3];
+            const auto& rts_op = _instructions[i + 4];
+
+            if (push_op.op != op_codes::push
+            ||  push_op.operands[0].type != operand_types::register_integer)
+                continue;
+            auto index = push_op.operands[0].index;
+
+            if (jsr_op.op != op_codes::jsr
+            ||  pop_op.op != op_codes::pop
+            ||  !is_register(pop_op, 0, index)
+            ||  store_op.op != op_codes::store
+            ||  !is_register(store_op, 0, index)
+            ||  store_op.operands[1].type != operand_types::register_sp
+            ||  store_op.operands_count != 3
+            ||  store_op.operands[2].type != operand_types::constant_integer
+            ||  store_op.operands[2].value.u64 != sizeof(uint64_t)
+            ||  rts_op.op != op_codes::rts)
+                continue;
+
+            // a branch landing inside the sequence would end up in the nop padding
+            auto sequence_start = address_of(i);
+            auto sequence_end = address_of(i + 5);
+            if (is_branch_target(sequence_start, sequence_end))
+                continue;
+
+            instruction_t tjsr_op = jsr_op;
+            tjsr_op.op = op_codes::tjsr;
+
+            std::vector<instruction_t> replacement {store_op, tjsr_op};
+            size_t replacement_size = store_op.encoding_size() + tjsr_op.encoding_size();
+            while (replacement_size < sequence_end - sequence_start) {
+                instruction_t no_op;
+                no_op.op = op_codes::nop;
+                replacement_size += no_op.encoding_size();
+                replacement.push_back(no_op);
+            }
+
+            auto it = _instructions.erase(
+                    _instructions.begin() + i,
+                    _instructions.begin() + i + 5);
+            _instructions.insert(it, replacement.begin(), replacement.end());
+            i += replacement.size() - 1;
+            count++;
+        }
+
+        return count;
+    }
+
+    size_t instruction_emitter::fold_constant_calls(partial_evaluator& evaluator) {
+        size_t count = 0;
+        for (size_t i = 0; i + 2 < _instructions.size(); i++) {
+            const auto& push_op = _instructions[i];
+            const auto& jsr_op = _instructions[i + 1];
+            const auto& pop_op = _instructions[i + 2];
+
+            if (push_op.op != op_codes::push
+            ||  push_op.operands[0].type != operand_types::constant_integer
+            ||  jsr_op.op != op_codes::jsr
+            ||  jsr_op.operands[0].type != operand_types::constant_integer
+            ||  pop_op.op != op_codes::pop
+            ||  pop_op.operands[0].type != operand_types::register_integer)
+                continue;
+
+            auto sequence_start = address_of(i);
+            auto sequence_end = address_of(i + 3);
+            if (is_branch_target(sequence_start, sequence_end))
+                continue;
+
+            uint64_t value;
+            if (!evaluator.evaluate(
+                    jsr_op.operands[0].value.u64,
+                    push_op.operands[0].value.u64,
+                    value))
+                continue;
+
+            instruction_t move_op;
+            move_op.op = op_codes::move;
+            move_op.size = pop_op.size;
+            move_op.operands_count = 2;
+            move_op.operands[0].type = operand_types::constant_integer;
+            move_op.operands[0].value.u64 = value;
+            move_op.operands[1] = pop_op.operands[0];
+
+            std::vector<instruction_t> replacement {move_op};
+            size_t replacement_size = move_op.encoding_size();
+            while (replacement_size < sequence_end - sequence_start) {
+                instruction_t no_op;
+                no_op.op = op_codes::nop;
+                replacement_size += no_op.encoding_size();
+                replacement.push_back(no_op);
+            }
+
+            auto it = _instructions.erase(
+                    _instructions.begin() + i,
+                    _instructions.begin() + i + 3);
+            _instructions.insert(it, replacement.begin(), replacement.end());
+            i += replacement.size() - 1;
+            count++;
+        }
+
+        return count;
+    }
+
+    uint64_t instruction_emitter::address_of(size_t index) const {
+        uint64_t address = _start_address;
+        for (size_t i = 0; i < index; i++)
+            address += _instructions[i].encoding_size();
+        return address;
+    }
+
+    bool instruction_emitter::is_branch_target(uint64_t start, uint64_t end) const {
+        for (const auto& inst : _instructions) {
+            switch (inst.op) {
+                case op_codes::bz:
+                case op_codes::bnz:
+                case op_codes::tbz:
+                case op_codes::tbnz:
+                case op_codes::bne:
+                case op_codes::beq:
+                case op_codes::bg:
+                case op_codes::bl:
+                case op_codes::bge:
+                case op_codes::ble:
+                case op_codes::ba:
+                case op_codes::bae:
+                case op_codes::bb:
+                case op_codes::bbe:
+                case op_codes::jmp:
+                    break;
+                default:
+                    continue;
+            }
+            for (size_t j = 0; j < inst.operands_count; j++) {
+                if (inst.operands[j].type != operand_types::constant_integer)
+                    continue;
+                auto target = inst.operands[j].value.u64;
+                if (target > start && target < end)
+                    return true;
+            }
+        }
+        return false;
+    }
+
     void instruction_emitter::pop_int_register(op_sizes size, uint8_t index) {
         basecode::instruction_t pop_op;
         pop_op.op = basecode::op_codes::pop;
@@ -367,4 +1122,14 @@ namespace basecode {
         _instructions.push_back(branch_op);
     }
 
+    void instruction_emitter::branch_if_compare(op_codes op, uint64_t address) {
+        basecode::instruction_t branch_op;
+        branch_op.op = op;
+        branch_op.size = basecode::op_sizes::qword;
+        branch_op.operands_count = 1;
+        branch_op.operands[0].type = basecode::operand_types::constant_integer;
+        branch_op.operands[0].value.u64 = address;
+        _instructions.push_back(branch_op);
+    }
+
 };
\ No newline at end of file
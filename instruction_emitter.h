@@ -7,6 +7,7 @@
 namespace basecode {
 
     class terp;
+    class partial_evaluator;
 
     class instruction_emitter {
     public:
@@ -20,6 +21,8 @@ namespace basecode {
 
         size_t size() const;
 
+        size_t instruction_count() const;
+
         uint64_t end_address() const;
 
         uint64_t start_address() const;
@@ -30,11 +33,107 @@ namespace basecode {
                 uint8_t lhs_index,
                 uint8_t rhs_index);
 
+        void add_with_carry_register_to_register(
+                op_sizes size,
+                uint8_t target_index,
+                uint8_t lhs_index,
+                uint8_t rhs_index);
+
+        void subtract_with_borrow_register_to_register(
+                op_sizes size,
+                uint8_t target_index,
+                uint8_t lhs_index,
+                uint8_t rhs_index);
+
+        void multiply_wide(
+                uint8_t high_index,
+                uint8_t low_index,
+                uint8_t lhs_index,
+                uint8_t rhs_index);
+
+        void divide_wide(
+                uint8_t low_index,
+                uint8_t high_index,
+                uint8_t divisor_index);
+
+        // multi-precision add/subtract of `limbs` little-endian qwords addressed
+        // by the lhs/rhs/target registers: four instructions per limb.
+        // clobbers scratch_index and scratch_index + 1.
+        void add_big_integer(
+                uint8_t target_index,
+                uint8_t lhs_index,
+                uint8_t rhs_index,
+                size_t limbs,
+                uint8_t scratch_index);
+
+        void subtract_big_integer(
+                uint8_t target_index,
+                uint8_t lhs_index,
+                uint8_t rhs_index,
+                size_t limbs,
+                uint8_t scratch_index);
+
         void load_with_offset_to_register(
                 uint8_t source_index,
                 uint8_t target_index,
                 uint64_t offset);
 
+        void copy_memory(
+                op_sizes size,
+                uint8_t source_index,
+                uint8_t target_index,
+                uint64_t length);
+
+        void fill_memory(
+                op_sizes size,
+                uint64_t value,
+                uint8_t target_index,
+                uint64_t length);
+
+        void compare_memory(
+                op_sizes size,
+                uint8_t target_index,
+                uint8_t lhs_index,
+                uint8_t rhs_index,
+                uint64_t length);
+
+        void find_in_memory(
+                op_sizes size,
+                uint8_t target_index,
+                uint64_t value,
+                uint8_t address_index,
+                uint64_t length);
+
+        void alloc_int_constant(
+                uint8_t target_index,
+                uint64_t size);
+
+        void alloc_int_register(
+                uint8_t target_index,
+                uint8_t size_index);
+
+        void free_int_register(uint8_t index);
+
+        // add, sub, mul, div, mod, shl, shr, and, or or xor
+        void integer_arithmetic(
+                op_codes op,
+                op_sizes size,
+                uint8_t target_index,
+                uint8_t lhs_index,
+                uint8_t rhs_index);
+
+        void integer_arithmetic_constant(
+                op_codes op,
+                op_sizes size,
+                uint8_t target_index,
+                uint8_t lhs_index,
+                uint64_t rhs_value);
+
+        void move_int_register_to_register(
+                op_sizes size,
+                uint8_t source_index,
+                uint8_t target_index);
+
         void move_int_constant_to_register(
                 op_sizes size,
                 uint64_t value,
@@ -42,6 +141,12 @@ namespace basecode {
 
         bool encode(result& r, terp& terp);
 
+        // marks the emitted function pure: encode() registers its start address
+        // with terp::mark_pure so repeated calls are memoized
+        void pure(bool value);
+
+        bool is_pure() const;
+
         void load_stack_offset_to_register(
                 uint8_t target_index,
                 uint64_t offset);
@@ -81,6 +186,83 @@ namespace basecode {
 
         void jump_direct(uint64_t address);
 
+        void vector_load(
+                uint8_t target_index,
+                uint8_t address_index,
+                uint64_t offset);
+
+        void vector_store(
+                uint8_t source_index,
+                uint8_t address_index,
+                uint64_t offset);
+
+        void vector_splat_constant(
+                uint8_t target_index,
+                double value);
+
+        // vadd, vsub, vmul, vmin or vmax
+        void vector_arithmetic(
+                op_codes op,
+                uint8_t target_index,
+                uint8_t lhs_index,
+                uint8_t rhs_index);
+
+        void vector_multiply_add(
+                uint8_t target_index,
+                uint8_t lhs_index,
+                uint8_t rhs_index,
+                uint8_t addend_index);
+
+        // vhadd, vhmin or vhmax into a floating point register
+        void vector_reduce(
+                op_codes op,
+                uint8_t target_index,
+                uint8_t source_index);
+
+        void call_host(uint64_t id);
+
+        // the new thread starts at entry_address with the argument in I0;
+        // join yields its I0 at exit
+        void spawn_thread(
+                uint8_t target_index,
+                uint64_t entry_address,
+                uint8_t argument_index);
+
+        void join_thread(uint8_t target_index, uint8_t id_index);
+
+        void atomic_load(uint8_t target_index, uint8_t address_index);
+
+        void atomic_store(uint8_t address_index, uint8_t value_index);
+
+        // target receives the previous value; the zero flag is set on a swap
+        void compare_and_swap(
+                uint8_t target_index,
+                uint8_t address_index,
+                uint8_t expected_index,
+                uint8_t desired_index);
+
+        void fetch_add(
+                uint8_t target_index,
+                uint8_t address_index,
+                uint8_t addend_index);
+
+        void wait_on_address(uint8_t address_index, uint8_t expected_index);
+
+        void notify_address(uint8_t address_index);
+
+        // target receives 1 when sent, 0 when the channel is full
+        void send_message(
+                uint8_t target_index,
+                uint8_t channel_index,
+                uint8_t address_index,
+                uint8_t length_index);
+
+        // target receives the message length, 0 when the channel is empty
+        void receive_message(
+                uint8_t target_index,
+                uint8_t channel_index,
+                uint8_t address_index);
+
         void push_float_constant(double value);
 
         void pop_float_register(uint8_t index);
@@ -103,10 +285,41 @@ namespace basecode {
 
         void branch_if_not_equal(uint64_t address);
 
+        // bg, bge, bl or ble (signed), ba, bae, bb or bbe (unsigned)
+        void branch_if_compare(op_codes op, uint64_t address);
+
         void jump_subroutine_indirect(uint8_t index);
 
         void jump_subroutine_direct(uint64_t address);
 
+        void jump_subroutine_tail_indirect(uint8_t index);
+
+        void jump_subroutine_tail_direct(uint64_t address);
+
+        // rewrites calls in tail position:
+        //
+        //      push Ix / jsr target / pop Ix / store Ix, SP, #8 / rts
+        //
+        // into:
+        //
+        //      store Ix, SP, #8 / tjsr target / nop...
+        //
+        // the rewrite is padded with (unreachable) nops so every address in the
+        // emitter stays put and already patched branches remain valid.
+        size_t optimize_tail_calls();
+
+        // replaces calls to pure functions with constant arguments:
+        //
+        //      push #c / jsr fn / pop Ix
+        //
+        // by the value the evaluator computed for fn(c):
+        //
+        //      move #fn(c), Ix / nop...
+        //
+        // padded like optimize_tail_calls.  calls the evaluator can't finish
+        // within its budget are left alone.
+        size_t fold_constant_calls(partial_evaluator& evaluator);
+
         inline instruction_t& operator[](size_t index) {
             return _instructions[index];
         };
@@ -118,6 +331,21 @@ namespace basecode {
         void push_int_constant(op_sizes size, uint64_t value);
 
     private:
+        uint64_t address_of(size_t index) const;
+
+        bool is_branch_target(uint64_t start, uint64_t end) const;
+
+        void big_integer_op(
+                op_codes first_op,
+                op_codes chained_op,
+                uint8_t target_index,
+                uint8_t lhs_index,
+                uint8_t rhs_index,
+                size_t limbs,
+                uint8_t scratch_index);
+
+    private:
+        bool _pure = false;
         uint64_t _start_address = 0;
         std::vector<instruction_t> _instructions {};
     };
@@ -0,0 +1,974 @@
+#include <set>
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+#include <fmt/format.h>
+#include "ir.h"
+#include "instruction_emitter.h"
+
+namespace basecode {
+
+    bool ir_value_t::is_binary() const {
+        switch (op) {
+            case ir_opcodes::add:
+            case ir_opcodes::sub:
+            case ir_opcodes::mul:
+            case ir_opcodes::div:
+            case ir_opcodes::mod:
+            case ir_opcodes::and_op:
+            case ir_opcodes::or_op:
+            case ir_opcodes::xor_op:
+            case ir_opcodes::shl:
+            case ir_opcodes::shr:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    bool ir_value_t::is_compare() const {
+        return op == ir_opcodes::cmp_eq || op == ir_opcodes::cmp_ne;
+    }
+
+    bool ir_value_t::is_terminator() const {
+        return op == ir_opcodes::branch
+            || op == ir_opcodes::cond_branch
+            || op == ir_opcodes::ret;
+    }
+
+    bool ir_value_t::has_side_effects() const {
+        // the parameter load is pinned to the top of the entry block
+        if (op == ir_opcodes::parameter || is_terminator())
+            return true;
+        if (op == ir_opcodes::call)
+            return callee == nullptr || !callee->is_pure();
+        return false;
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+
+    ir_value_t* ir_block_t::terminator() const {
+        if (instructions.empty() || !instructions.back()->is_terminator())
+            return nullptr;
+        return instructions.back().get();
+    }
+
+    std::vector<ir_block_t*> ir_block_t::successors() const {
+        auto inst = terminator();
+        if (inst == nullptr || inst->op == ir_opcodes::ret)
+            return {};
+        return inst->blocks;
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+
+    ir_function::ir_function(
+            const std::string& name,
+            size_t parameter_count) : _name(name),
+                                      _parameter_count(parameter_count) {
+        auto entry_block = add_block();
+        if (_parameter_count > 0) {
+            auto value = std::make_unique<ir_value_t>();
+            value->id = next_value_id();
+            value->op = ir_opcodes::parameter;
+            value->type = ir_types::u64;
+            value->block = entry_block;
+            _parameter = value.get();
+            entry_block->instructions.push_back(std::move(value));
+        }
+    }
+
+    void ir_function::pure(bool value) {
+        _pure = value;
+    }
+
+    bool ir_function::is_pure() const {
+        return _pure;
+    }
+
+    size_t ir_function::parameter_count() const {
+        return _parameter_count;
+    }
+
+    const std::string& ir_function::name() const {
+        return _name;
+    }
+
+    ir_block_t* ir_function::entry() const {
+        return _blocks.front().get();
+    }
+
+    ir_block_t* ir_function::add_block() {
+        auto block = std::make_unique<ir_block_t>();
+        block->id = static_cast<uint32_t>(_blocks.size());
+        _blocks.push_back(std::move(block));
+        return _blocks.back().get();
+    }
+
+    ir_value_t* ir_function::parameter() {
+        return _parameter;
+    }
+
+    size_t ir_function::instruction_count() const {
+        size_t count = 0;
+        for (const auto& block : _blocks)
+            count += block->instructions.size();
+        return count;
+    }
+
+    uint32_t ir_function::next_value_id() {
+        return _next_id++;
+    }
+
+    std::vector<std::unique_ptr<ir_block_t>>& ir_function::blocks() {
+        return _blocks;
+    }
+
+    const std::vector<std::unique_ptr<ir_block_t>>& ir_function::blocks() const {
+        return _blocks;
+    }
+
+    void ir_function::compute_cfg() {
+        for (auto& block : _blocks) {
+            block->reachable = false;
+            block->idom = nullptr;
+            block->predecessors.clear();
+        }
+
+        // iterative depth first search for the post order
+        std::vector<ir_block_t*> post_order;
+        std::vector<std::pair<ir_block_t*, size_t>> stack;
+        entry()->reachable = true;
+        stack.emplace_back(entry(), 0);
+        while (!stack.empty()) {
+            auto& top = stack.back();
+            auto successors = top.first->successors();
+            if (top.second < successors.size()) {
+                auto next = successors[top.second++];
+                if (!next->reachable) {
+                    next->reachable = true;
+                    stack.emplace_back(next, 0);
+                }
+                continue;
+            }
+            post_order.push_back(top.first);
+            stack.pop_back();
+        }
+
+        _rpo.assign(post_order.rbegin(), post_order.rend());
+        for (size_t i = 0; i < _rpo.size(); i++)
+            _rpo[i]->rpo_index = i;
+
+        for (auto block : _rpo) {
+            for (auto successor : block->successors()) {
+                auto& predecessors = successor->predecessors;
+                if (std::find(predecessors.begin(), predecessors.end(), block) == predecessors.end())
+                    predecessors.push_back(block);
+            }
+        }
+
+        // Cooper, Harvey & Kennedy: "A Simple, Fast Dominance Algorithm"
+        auto intersect = [](ir_block_t* lhs, ir_block_t* rhs) {
+            while (lhs != rhs) {
+                while (lhs->rpo_index > rhs->rpo_index)
+                    lhs = lhs->idom;
+                while (rhs->rpo_index > lhs->rpo_index)
+                    rhs = rhs->idom;
+            }
+            return lhs;
+        };
+
+        entry()->idom = entry();
+        auto changed = true;
+        while (changed) {
+            changed = false;
+            for (size_t i = 1; i < _rpo.size(); i++) {
+                auto block = _rpo[i];
+                ir_block_t* new_idom = nullptr;
+                for (auto predecessor : block->predecessors) {
+                    if (predecessor->idom == nullptr)
+                        continue;
+                    new_idom = new_idom == nullptr ? predecessor : intersect(predecessor, new_idom);
+                }
+                if (block->idom != new_idom) {
+                    block->idom = new_idom;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    const std::vector<ir_block_t*>& ir_function::reverse_post_order() const {
+        return _rpo;
+    }
+
+    bool ir_function::dominates(const ir_block_t* dominator, const ir_block_t* block) const {
+        while (block != nullptr) {
+            if (block == dominator)
+                return true;
+            if (block->idom == block)
+                return false;
+            block = block->idom;
+        }
+        return false;
+    }
+
+    size_t ir_function::use_count(const ir_value_t* value) const {
+        size_t count = 0;
+        for (const auto& block : _blocks) {
+            for (const auto& inst : block->instructions)
+                count += std::count(inst->operands.begin(), inst->operands.end(), value);
+        }
+        return count;
+    }
+
+    void ir_function::replace_all_uses(ir_value_t* from, ir_value_t* to) {
+        for (auto& block : _blocks) {
+            for (auto& inst : block->instructions) {
+                for (auto& operand : inst->operands) {
+                    if (operand == from)
+                        operand = to;
+                }
+            }
+        }
+    }
+
+    size_t ir_function::remove_unreachable_blocks() {
+        compute_cfg();
+
+        std::unordered_set<ir_block_t*> dead;
+        for (auto& block : _blocks) {
+            if (!block->reachable)
+                dead.insert(block.get());
+        }
+        if (dead.empty())
+            return 0;
+
+        for (auto& block : _blocks) {
+            if (!block->reachable)
+                continue;
+            for (auto dead_block : dead)
+                remove_phi_incoming(block.get(), dead_block);
+        }
+
+        _blocks.erase(
+                std::remove_if(
+                        _blocks.begin(),
+                        _blocks.end(),
+                        [](const std::unique_ptr<ir_block_t>& block) { return !block->reachable; }),
+                _blocks.end());
+
+        compute_cfg();
+        return dead.size();
+    }
+
+    void ir_function::remove_phi_incoming(ir_block_t* block, ir_block_t* predecessor) {
+        for (auto& inst : block->instructions) {
+            if (inst->op != ir_opcodes::phi)
+                break;
+            for (size_t i = 0; i < inst->blocks.size();) {
+                if (inst->blocks[i] == predecessor) {
+                    inst->blocks.erase(inst->blocks.begin() + i);
+                    inst->operands.erase(inst->operands.begin() + i);
+                } else {
+                    i++;
+                }
+            }
+        }
+    }
+
+    size_t ir_function::merge_straight_line_blocks() {
+        size_t merged = 0;
+        auto changed = true;
+        while (changed) {
+            changed = false;
+            compute_cfg();
+            for (auto block : _rpo) {
+                if (block == entry() || block->predecessors.size() != 1)
+                    continue;
+                auto predecessor = block->predecessors[0];
+                auto terminator = predecessor->terminator();
+                if (predecessor == block || terminator == nullptr || terminator->op != ir_opcodes::branch)
+                    continue;
+
+                // a single predecessor means every phi has a single incoming
+                auto& instructions = block->instructions;
+                while (!instructions.empty() && instructions.front()->op == ir_opcodes::phi) {
+                    auto& phi = instructions.front();
+                    replace_all_uses(phi.get(), phi->operands.empty() ? nullptr : phi->operands[0]);
+                    instructions.erase(instructions.begin());
+                }
+
+                for (auto successor : block->successors()) {
+                    for (auto& inst : successor->instructions) {
+                        if (inst->op != ir_opcodes::phi)
+                            break;
+                        for (auto& incoming : inst->blocks) {
+                            if (incoming == block)
+                                incoming = predecessor;
+                        }
+                    }
+                }
+
+                predecessor->instructions.pop_back();
+                for (auto& inst : instructions) {
+                    inst->block = predecessor;
+                    predecessor->instructions.push_back(std::move(inst));
+                }
+                instructions.clear();
+
+                _blocks.erase(std::find_if(
+                        _blocks.begin(),
+                        _blocks.end(),
+                        [&](const std::unique_ptr<ir_block_t>& owned) { return owned.get() == block; }));
+                merged++;
+                changed = true;
+                break;
+            }
+        }
+        return merged;
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+
+    ir_builder::ir_builder(ir_function& function) : _function(function),
+                                                    _block(function.entry()) {
+    }
+
+    void ir_builder::position_at_end(ir_block_t* block) {
+        _block = block;
+    }
+
+    ir_value_t* ir_builder::constant(uint64_t value) {
+        auto inst = std::make_unique<ir_value_t>();
+        inst->op = ir_opcodes::constant;
+        inst->type = ir_types::u64;
+        inst->constant = value;
+        return append(std::move(inst));
+    }
+
+    ir_value_t* ir_builder::binary(ir_opcodes op, ir_value_t* lhs, ir_value_t* rhs) {
+        auto inst = std::make_unique<ir_value_t>();
+        inst->op = op;
+        inst->operands = {lhs, rhs};
+        inst->type = inst->is_compare() ? ir_types::boolean : ir_types::u64;
+        return append(std::move(inst));
+    }
+
+    ir_value_t* ir_builder::phi() {
+        auto inst = std::make_unique<ir_value_t>();
+        inst->id = _function.next_value_id();
+        inst->op = ir_opcodes::phi;
+        inst->type = ir_types::u64;
+        inst->block = _block;
+
+        auto& instructions = _block->instructions;
+        auto it = instructions.begin();
+        while (it != instructions.end() && (*it)->op == ir_opcodes::phi)
+            ++it;
+        auto value = inst.get();
+        instructions.insert(it, std::move(inst));
+        return value;
+    }
+
+    void ir_builder::add_incoming(ir_value_t* phi, ir_value_t* value, ir_block_t* predecessor) {
+        phi->operands.push_back(value);
+        phi->blocks.push_back(predecessor);
+    }
+
+    ir_value_t* ir_builder::call(ir_function* callee, ir_value_t* argument) {
+        auto inst = std::make_unique<ir_value_t>();
+        inst->op = ir_opcodes::call;
+        inst->type = ir_types::u64;
+        inst->callee = callee;
+        if (argument != nullptr)
+            inst->operands.push_back(argument);
+        return append(std::move(inst));
+    }
+
+    void ir_builder::branch(ir_block_t* target) {
+        auto inst = std::make_unique<ir_value_t>();
+        inst->op = ir_opcodes::branch;
+        inst->blocks = {target};
+        append(std::move(inst));
+    }
+
+    void ir_builder::cond_branch(ir_value_t* condition, ir_block_t* if_true, ir_block_t* if_false) {
+        auto inst = std::make_unique<ir_value_t>();
+        inst->op = ir_opcodes::cond_branch;
+        inst->operands = {condition};
+        inst->blocks = {if_true, if_false};
+        append(std::move(inst));
+    }
+
+    void ir_builder::ret(ir_value_t* value) {
+        auto inst = std::make_unique<ir_value_t>();
+        inst->op = ir_opcodes::ret;
+        if (value != nullptr)
+            inst->operands.push_back(value);
+        append(std::move(inst));
+    }
+
+    ir_value_t* ir_builder::append(std::unique_ptr<ir_value_t> value) {
+        value->id = _function.next_value_id();
+        value->block = _block;
+        auto inst = value.get();
+        _block->instructions.push_back(std::move(value));
+        return inst;
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+
+    static op_codes lowered_op(ir_opcodes op) {
+        switch (op) {
+            case ir_opcodes::add:    return op_codes::add;
+            case ir_opcodes::sub:    return op_codes::sub;
+            case ir_opcodes::mul:    return op_codes::mul;
+            case ir_opcodes::div:    return op_codes::div;
+            case ir_opcodes::mod:    return op_codes::mod;
+            case ir_opcodes::and_op: return op_codes::and_op;
+            case ir_opcodes::or_op:  return op_codes::or_op;
+            case ir_opcodes::xor_op: return op_codes::xor_op;
+            case ir_opcodes::shl:    return op_codes::shl;
+            case ir_opcodes::shr:    return op_codes::shr;
+            default:                 return op_codes::nop;
+        }
+    }
+
+    // lowers one function: number the instructions in reverse post order,
+    // compute block liveness, turn it into one conservative interval per value,
+    // linear scan those onto I1-I63 and emit.
+    class ir_lowering {
+    public:
+        ir_lowering(
+                result& r,
+                const ir_module& module,
+                ir_function& function,
+                instruction_emitter& emitter) : _r(r),
+                                                _module(module),
+                                                _function(function),
+                                                _emitter(emitter) {
+        }
+
+        bool lower() {
+            _function.compute_cfg();
+            _order = _function.reverse_post_order();
+
+            number();
+            if (!check_booleans())
+                return false;
+            liveness();
+            build_intervals();
+            if (!allocate())
+                return false;
+            return emit();
+        }
+
+    private:
+        struct interval_t {
+            size_t start = 0;
+            size_t end = 0;
+            uint8_t reg = 0;
+        };
+
+        // constants only take a register when an instruction can't use them as
+        // an immediate, i.e. as the lhs of an arithmetic op or comparison
+        bool needs_register(const ir_value_t* value) const {
+            if (value->type != ir_types::u64)
+                return false;
+            if (value->op != ir_opcodes::constant)
+                return true;
+            for (auto block : _order) {
+                for (const auto& inst : block->instructions) {
+                    if ((inst->is_binary() || inst->is_compare())
+                    &&  inst->operands[0] == value)
+                        return true;
+                }
+            }
+            return false;
+        }
+
+        bool has_register(const ir_value_t* value) const {
+            return _intervals.count(value) != 0;
+        }
+
+        uint8_t reg(const ir_value_t* value) const {
+            auto it = _intervals.find(value);
+            return it == _intervals.end() ? 0 : it->second.reg;
+        }
+
+        // values read in registers at the instruction's own position; phi
+        // operands are read at the end of the predecessor instead
+        std::vector<const ir_value_t*> register_uses(const ir_value_t* inst) const {
+            std::vector<const ir_value_t*> uses;
+            if (inst->op == ir_opcodes::phi || inst->is_compare())
+                return uses;
+
+            auto operands = inst->operands;
+            if (inst->op == ir_opcodes::cond_branch && operands[0]->is_compare())
+                operands = operands[0]->operands;
+
+            for (auto operand : operands) {
+                if (_register_values.count(operand) != 0)
+                    uses.push_back(operand);
+            }
+            return uses;
+        }
+
+        void number() {
+            size_t position = 0;
+            for (auto block : _order) {
+                _block_start[block] = position;
+                for (const auto& inst : block->instructions) {
+                    _positions[inst.get()] = position;
+                    if (needs_register(inst.get()))
+                        _register_values.insert(inst.get());
+                    position += 2;
+                }
+                _block_end[block] = position - 2;
+            }
+        }
+
+        bool check_booleans() {
+            for (auto block : _order) {
+                for (const auto& inst : block->instructions) {
+                    for (size_t i = 0; i < inst->operands.size(); i++) {
+                        if (inst->operands[i]->type != ir_types::boolean)
+                            continue;
+                        if (inst->op == ir_opcodes::cond_branch)
+                            continue;
+                        _r.add_message(
+                                "B019",
+                                fmt::format(
+                                        "{}: boolean value %{} can only feed a branch.",
+                                        _function.name(),
+                                        inst->operands[i]->id),
+                                true);
+                        return false;
+                    }
+                }
+            }
+            return true;
+        }
+
+        std::vector<const ir_value_t*> phi_sources(const ir_block_t* from, const ir_block_t* to) const {
+            std::vector<const ir_value_t*> sources;
+            for (const auto& inst : to->instructions) {
+                if (inst->op != ir_opcodes::phi)
+                    break;
+                for (size_t i = 0; i < inst->blocks.size(); i++) {
+                    if (inst->blocks[i] == from && _register_values.count(inst->operands[i]) != 0)
+                        sources.push_back(inst->operands[i]);
+                }
+            }
+            return sources;
+        }
+
+        void liveness() {
+            using value_set = std::set<const ir_value_t*>;
+            std::unordered_map<const ir_block_t*, value_set> uses;
+            std::unordered_map<const ir_block_t*, value_set> defs;
+            std::unordered_map<const ir_block_t*, value_set> phis;
+
+            for (auto block : _order) {
+                auto& block_uses = uses[block];
+                auto& block_defs = defs[block];
+                for (const auto& inst : block->instructions) {
+                    if (inst->op == ir_opcodes::phi) {
+                        phis[block].insert(inst.get());
+                        block_defs.insert(inst.get());
+                        continue;
+                    }
+                    for (auto use : register_uses(inst.get())) {
+                        if (block_defs.count(use) == 0)
+                            block_uses.insert(use);
+                    }
+                    if (_register_values.count(inst.get()) != 0)
+                        block_defs.insert(inst.get());
+                }
+            }
+
+            auto changed = true;
+            while (changed) {
+                changed = false;
+                for (auto it = _order.rbegin(); it != _order.rend(); ++it) {
+                    auto block = *it;
+                    value_set out;
+                    for (auto successor : block->successors()) {
+                        for (auto value : _live_in[successor]) {
+                            if (phis[successor].count(value) == 0)
+                                out.insert(value);
+                        }
+                        for (auto value : phi_sources(block, successor))
+                            out.insert(value);
+                    }
+
+                    value_set in = uses[block];
+                    for (auto value : out) {
+                        if (defs[block].count(value) == 0)
+                            in.insert(value);
+                    }
+
+                    if (out != _live_out[block] || in != _live_in[block]) {
+                        _live_out[block] = std::move(out);
+                        _live_in[block] = std::move(in);
+                        changed = true;
+                    }
+                }
+            }
+        }
+
+        void build_intervals() {
+            for (auto value : _register_values) {
+                auto position = _positions[value];
+                _intervals[value] = {position, position, 0};
+            }
+
+            for (auto block : _order) {
+                for (const auto& inst : block->instructions) {
+                    auto position = _positions[inst.get()];
+                    for (auto use : register_uses(inst.get())) {
+                        auto& interval = _intervals[use];
+                        interval.end = std::max(interval.end, position);
+                    }
+
+                    // phi registers are written by moves at the end of each
+                    // predecessor
+                    if (inst->op == ir_opcodes::phi && has_register(inst.get())) {
+                        auto& interval = _intervals[inst.get()];
+                        for (auto predecessor : inst->blocks) {
+                            if (_block_end.count(predecessor) == 0)
+                                continue;
+                            interval.start = std::min(interval.start, _block_end[predecessor]);
+                            interval.end = std::max(interval.end, _block_end[predecessor]);
+                        }
+                    }
+                }
+
+                for (auto value : _live_out[block]) {
+                    auto& interval = _intervals[value];
+                    interval.end = std::max(interval.end, _block_end[block]);
+                }
+                for (auto value : _live_in[block]) {
+                    auto& interval = _intervals[value];
+                    interval.start = std::min(interval.start, _block_start[block]);
+                }
+            }
+        }
+
+        bool allocate() {
+            std::vector<std::pair<const ir_value_t*, interval_t*>> sorted;
+            for (auto& entry : _intervals)
+                sorted.emplace_back(entry.first, &entry.second);
+            std::sort(sorted.begin(), sorted.end(), [](const auto& lhs, const auto& rhs) {
+                if (lhs.second->start != rhs.second->start)
+                    return lhs.second->start < rhs.second->start;
+                return lhs.first->id < rhs.first->id;
+            });
+
+            std::vector<interval_t*> active;
+            bool in_use[64] {};
+            for (auto& entry : sorted) {
+                auto interval = entry.second;
+                for (auto it = active.begin(); it != active.end();) {
+                    if ((*it)->end < interval->start) {
+                        in_use[(*it)->reg] = false;
+                        it = active.erase(it);
+                    } else {
+                        ++it;
+                    }
+                }
+
+                uint8_t reg = 1;
+                while (reg < 64 && in_use[reg])
+                    reg++;
+                if (reg == 64) {
+                    _r.add_message(
+                            "B019",
+                            fmt::format("{}: more than 63 values live at once.", _function.name()),
+                            true);
+                    return false;
+                }
+
+                in_use[reg] = true;
+                interval->reg = reg;
+                active.push_back(interval);
+            }
+            return true;
+        }
+
+        void emit_phi_moves(const ir_block_t* from, const ir_block_t* to) {
+            std::vector<std::pair<uint8_t, uint8_t>> register_moves;
+            std::vector<std::pair<uint64_t, uint8_t>> constant_moves;
+            for (const auto& inst : to->instructions) {
+                if (inst->op != ir_opcodes::phi)
+                    break;
+                if (!has_register(inst.get()))
+                    continue;
+                for (size_t i = 0; i < inst->blocks.size(); i++) {
+                    if (inst->blocks[i] != from)
+                        continue;
+                    auto source = inst->operands[i];
+                    if (has_register(source)) {
+                        if (reg(source) != reg(inst.get()))
+                            register_moves.emplace_back(reg(source), reg(inst.get()));
+                    } else {
+                        constant_moves.emplace_back(source->constant, reg(inst.get()));
+                    }
+                }
+            }
+
+            // the moves are parallel: when a target is also a source, go
+            // through the stack
+            auto conflict = false;
+            for (const auto& move : register_moves) {
+                for (const auto& other : register_moves)
+                    conflict |= move.second == other.first;
+            }
+
+            if (conflict) {
+                for (const auto& move : register_moves)
+                    _emitter.push_int_register(op_sizes::qword, move.first);
+                for (auto it = register_moves.rbegin(); it != register_moves.rend(); ++it)
+                    _emitter.pop_int_register(op_sizes::qword, it->second);
+            } else {
+                for (const auto& move : register_moves)
+                    _emitter.move_int_register_to_register(op_sizes::qword, move.first, move.second);
+            }
+
+            for (const auto& move : constant_moves)
+                _emitter.move_int_constant_to_register(op_sizes::qword, move.first, move.second);
+        }
+
+        bool has_phi_moves(const ir_block_t* from, const ir_block_t* to) const {
+            for (const auto& inst : to->instructions) {
+                if (inst->op != ir_opcodes::phi)
+                    break;
+                if (has_register(inst.get())
+                &&  std::find(inst->blocks.begin(), inst->blocks.end(), from) != inst->blocks.end())
+                    return true;
+            }
+            return false;
+        }
+
+        void jump_to(const ir_block_t* target, const ir_block_t* next) {
+            if (target == next)
+                return;
+            _fixups.emplace_back(_emitter.instruction_count(), target);
+            _emitter.jump_direct(0);
+        }
+
+        void emit_call(const ir_value_t* inst) {
+            auto position = _positions[inst];
+            std::vector<uint8_t> saved;
+            for (const auto& entry : _intervals) {
+                if (entry.second.start < position && entry.second.end > position)
+                    saved.push_back(entry.second.reg);
+            }
+            std::sort(saved.begin(), saved.end());
+            saved.erase(std::unique(saved.begin(), saved.end()), saved.end());
+
+            for (auto index : saved)
+                _emitter.push_int_register(op_sizes::qword, index);
+
+            if (inst->operands.empty())
+                _emitter.push_int_constant(op_sizes::qword, 0);
+            else if (has_register(inst->operands[0]))
+                _emitter.push_int_register(op_sizes::qword, reg(inst->operands[0]));
+            else
+                _emitter.push_int_constant(op_sizes::qword, inst->operands[0]->constant);
+
+            _emitter.jump_subroutine_direct(_module.address_of(inst->callee));
+            _emitter.pop_int_register(op_sizes::qword, reg(inst));
+
+            for (auto it = saved.rbegin(); it != saved.rend(); ++it)
+                _emitter.pop_int_register(op_sizes::qword, *it);
+        }
+
+        void emit_cond_branch(const ir_block_t* block, const ir_value_t* inst, const ir_block_t* next) {
+            auto condition = inst->operands[0];
+            auto if_true = inst->blocks[0];
+            auto if_false = inst->blocks[1];
+
+            if (condition->op == ir_opcodes::constant) {
+                auto target = condition->constant != 0 ? if_true : if_false;
+                emit_phi_moves(block, target);
+                jump_to(target, next);
+                return;
+            }
+
+            auto lhs = condition->operands[0];
+            auto rhs = condition->operands[1];
+            if (has_register(rhs))
+                _emitter.compare_int_register_to_register(op_sizes::qword, reg(lhs), reg(rhs));
+            else
+                _emitter.compare_int_register_to_constant(op_sizes::qword, reg(lhs), rhs->constant);
+
+            auto branch_index = _emitter.instruction_count();
+            if (condition->op == ir_opcodes::cmp_eq)
+                _emitter.branch_if_equal(0);
+            else
+                _emitter.branch_if_not_equal(0);
+
+            // taken edges into phis need their own stub for the moves
+            auto true_moves = has_phi_moves(block, if_true);
+            if (!true_moves)
+                _fixups.emplace_back(branch_index, if_true);
+
+            emit_phi_moves(block, if_false);
+            jump_to(if_false, true_moves ? nullptr : next);
+
+            if (true_moves) {
+                _emitter[branch_index].patch_branch_address(_emitter.end_address());
+                emit_phi_moves(block, if_true);
+                jump_to(if_true, next);
+            }
+        }
+
+        bool emit() {
+            std::unordered_map<const ir_block_t*, uint64_t> addresses;
+            for (size_t i = 0; i < _order.size(); i++) {
+                auto block = _order[i];
+                auto next = i + 1 < _order.size() ? _order[i + 1] : nullptr;
+                addresses[block] = _emitter.end_address();
+
+                for (const auto& value : block->instructions) {
+                    auto inst = value.get();
+                    switch (inst->op) {
+                        case ir_opcodes::parameter:
+                            if (has_register(inst))
+                                _emitter.load_stack_offset_to_register(reg(inst), 8);
+                            break;
+                        case ir_opcodes::constant:
+                            if (has_register(inst))
+                                _emitter.move_int_constant_to_register(op_sizes::qword, inst->constant, reg(inst));
+                            break;
+                        case ir_opcodes::phi:
+                        case ir_opcodes::cmp_eq:
+                        case ir_opcodes::cmp_ne:
+                            break;
+                        case ir_opcodes::call:
+                            emit_call(inst);
+                            break;
+                        case ir_opcodes::branch:
+                            emit_phi_moves(block, inst->blocks[0]);
+                            jump_to(inst->blocks[0], next);
+                            break;
+                        case ir_opcodes::cond_branch:
+                            if (!inst->operands[0]->is_compare()
+                            &&  inst->operands[0]->op != ir_opcodes::constant) {
+                                _r.add_message(
+                                        "B019",
+                                        fmt::format("{}: branch condition must be a comparison.", _function.name()),
+                                        true);
+                                return false;
+                            }
+                            emit_cond_branch(block, inst, next);
+                            break;
+                        case ir_opcodes::ret: {
+                            if (!inst->operands.empty()) {
+                                auto result_value = inst->operands[0];
+                                if (has_register(result_value)) {
+                                    _emitter.store_register_to_stack_offset(reg(result_value), 8);
+                                } else {
+                                    _emitter.move_int_constant_to_register(op_sizes::qword, result_value->constant, 0);
+                                    _emitter.store_register_to_stack_offset(0, 8);
+                                }
+                            }
+                            _emitter.rts();
+                            break;
+                        }
+                        default: {
+                            auto lhs = inst->operands[0];
+                            auto rhs = inst->operands[1];
+                            if (has_register(rhs)) {
+                                _emitter.integer_arithmetic(
+                                        lowered_op(inst->op),
+                                        op_sizes::qword,
+                                        reg(inst),
+                                        reg(lhs),
+                                        reg(rhs));
+                            } else {
+                                _emitter.integer_arithmetic_constant(
+                                        lowered_op(inst->op),
+                                        op_sizes::qword,
+                                        reg(inst),
+                                        reg(lhs),
+                                        rhs->constant);
+                            }
+                            break;
+                        }
+                    }
+                }
+            }
+
+            for (const auto& fixup : _fixups)
+                _emitter[fixup.first].patch_branch_address(addresses[fixup.second]);
+
+            return true;
+        }
+
+    private:
+        result& _r;
+        const ir_module& _module;
+        ir_function& _function;
+        instruction_emitter& _emitter;
+        std::vector<ir_block_t*> _order {};
+        std::unordered_set<const ir_value_t*> _register_values {};
+        std::unordered_map<const ir_value_t*, size_t> _positions {};
+        std::unordered_map<const ir_block_t*, size_t> _block_start {};
+        std::unordered_map<const ir_block_t*, size_t> _block_end {};
+        std::unordered_map<const ir_block_t*, std::set<const ir_value_t*>> _live_in {};
+        std::unordered_map<const ir_block_t*, std::set<const ir_value_t*>> _live_out {};
+        std::unordered_map<const ir_value_t*, interval_t> _intervals {};
+        std::vector<std::pair<size_t, const ir_block_t*>> _fixups {};
+    };
+
+    ///////////////////////////////////////////////////////////////////////////
+
+    ir_function* ir_module::add_function(const std::string& name, size_t parameter_count) {
+        _functions.push_back(std::make_unique<ir_function>(name, parameter_count));
+        return _functions.back().get();
+    }
+
+    const std::vector<std::unique_ptr<ir_function>>& ir_module::functions() const {
+        return _functions;
+    }
+
+    uint64_t ir_module::address_of(const ir_function* function) const {
+        for (size_t i = 0; i < _functions.size(); i++) {
+            if (_functions[i].get() == function)
+                return i < _addresses.size() ? _addresses[i] : 0;
+        }
+        return 0;
+    }
+
+    bool ir_module::lower(
+            result& r,
+            uint64_t start_address,
+            std::vector<instruction_emitter>& emitters) const {
+        // call operands are fixed-size constants, so a first pass against
+        // placeholder addresses gives every function's final size
+        _addresses.assign(_functions.size(), 0);
+        for (auto pass = 0; pass < 2; pass++) {
+            emitters.clear();
+            auto address = start_address;
+            for (size_t i = 0; i < _functions.size(); i++) {
+                emitters.emplace_back(address);
+                auto& emitter = emitters.back();
+                emitter.pure(_functions[i]->is_pure());
+
+                ir_lowering lowering(r, *this, *_functions[i], emitter);
+                if (!lowering.lower())
+                    return false;
+
+                if (pass == 0)
+                    _addresses[i] = address;
+                address = emitter.end_address();
+            }
+        }
+        return true;
+    }
+
+};
@@ -0,0 +1,209 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "terp.h"
+#include "result.h"
+
+namespace basecode {
+
+    class ir_function;
+    class instruction_emitter;
+
+    // mid-level SSA form that sits between a front end and instruction_emitter.
+    //
+    // a function is a list of basic blocks; each block holds instructions that
+    // are also the values they define, ending in exactly one terminator
+    // (branch, cond_branch or ret).  phis sit at the top of their block, with
+    // one incoming value per predecessor.
+    //
+    // values are u64, or boolean for the result of a comparison.  booleans
+    // only feed cond_branch: they lower to a cmp right before the branch.
+    //
+    // functions follow the terp's single-slot calling convention: at most one
+    // argument, read from SP+8 and overwritten by the return value.
+    enum class ir_types : uint8_t {
+        none,
+        u64,
+        boolean,
+    };
+
+    enum class ir_opcodes : uint8_t {
+        constant,
+        parameter,
+        add,
+        sub,
+        mul,
+        div,
+        mod,
+        and_op,
+        or_op,
+        xor_op,
+        shl,
+        shr,
+        cmp_eq,
+        cmp_ne,
+        phi,
+        call,
+        branch,
+        cond_branch,
+        ret,
+    };
+
+    struct ir_block_t;
+
+    struct ir_value_t {
+        bool is_binary() const;
+
+        bool is_compare() const;
+
+        bool is_terminator() const;
+
+        bool has_side_effects() const;
+
+        uint32_t id = 0;
+        ir_opcodes op = ir_opcodes::constant;
+        ir_types type = ir_types::none;
+        uint64_t constant = 0;
+        ir_block_t* block = nullptr;
+        ir_function* callee = nullptr;
+        std::vector<ir_value_t*> operands {};
+        // branch targets; for phis, the predecessor each operand comes from
+        std::vector<ir_block_t*> blocks {};
+    };
+
+    struct ir_block_t {
+        ir_value_t* terminator() const;
+
+        std::vector<ir_block_t*> successors() const;
+
+        uint32_t id = 0;
+        std::vector<std::unique_ptr<ir_value_t>> instructions {};
+
+        // filled in by ir_function::compute_cfg
+        bool reachable = false;
+        size_t rpo_index = 0;
+        ir_block_t* idom = nullptr;
+        std::vector<ir_block_t*> predecessors {};
+    };
+
+    class ir_function {
+    public:
+        ir_function(const std::string& name, size_t parameter_count);
+
+        void pure(bool value);
+
+        bool is_pure() const;
+
+        size_t parameter_count() const;
+
+        const std::string& name() const;
+
+        ir_block_t* entry() const;
+
+        ir_block_t* add_block();
+
+        ir_value_t* parameter();
+
+        size_t instruction_count() const;
+
+        uint32_t next_value_id();
+
+        std::vector<std::unique_ptr<ir_block_t>>& blocks();
+
+        const std::vector<std::unique_ptr<ir_block_t>>& blocks() const;
+
+        // predecessors, reverse post order and immediate dominators; must be
+        // rerun after a pass changes the shape of the graph
+        void compute_cfg();
+
+        const std::vector<ir_block_t*>& reverse_post_order() const;
+
+        bool dominates(const ir_block_t* dominator, const ir_block_t* block) const;
+
+        size_t use_count(const ir_value_t* value) const;
+
+        void replace_all_uses(ir_value_t* from, ir_value_t* to);
+
+        // drops blocks the entry can't reach, along with their phi incomings;
+        // returns the number of blocks removed
+        size_t remove_unreachable_blocks();
+
+        void remove_phi_incoming(ir_block_t* block, ir_block_t* predecessor);
+
+        // folds each block into its predecessor when that is its only one and
+        // jumps straight to it; returns the number of blocks merged away
+        size_t merge_straight_line_blocks();
+
+    private:
+        bool _pure = false;
+        std::string _name;
+        uint32_t _next_id = 0;
+        size_t _parameter_count = 0;
+        ir_value_t* _parameter = nullptr;
+        std::vector<ir_block_t*> _rpo {};
+        std::vector<std::unique_ptr<ir_block_t>> _blocks {};
+    };
+
+    class ir_builder {
+    public:
+        explicit ir_builder(ir_function& function);
+
+        void position_at_end(ir_block_t* block);
+
+        ir_value_t* constant(uint64_t value);
+
+        // arithmetic and bitwise ops yield u64, cmp_eq/cmp_ne a boolean
+        ir_value_t* binary(ir_opcodes op, ir_value_t* lhs, ir_value_t* rhs);
+
+        // phis are placed ahead of every non-phi instruction in the block
+        ir_value_t* phi();
+
+        void add_incoming(ir_value_t* phi, ir_value_t* value, ir_block_t* predecessor);
+
+        // `argument` may be null when the callee takes no parameter
+        ir_value_t* call(ir_function* callee, ir_value_t* argument);
+
+        void branch(ir_block_t* target);
+
+        void cond_branch(ir_value_t* condition, ir_block_t* if_true, ir_block_t* if_false);
+
+        // `value` may be null for functions without a result
+        void ret(ir_value_t* value);
+
+    private:
+        ir_value_t* append(std::unique_ptr<ir_value_t> value);
+
+    private:
+        ir_function& _function;
+        ir_block_t* _block = nullptr;
+    };
+
+    class ir_module {
+    public:
+        ir_module() = default;
+
+        ir_function* add_function(const std::string& name, size_t parameter_count);
+
+        const std::vector<std::unique_ptr<ir_function>>& functions() const;
+
+        // lowers every function to one emitter each, laid out back to back from
+        // `start_address`; callee addresses are resolved across the module.
+        // values get integer registers I1-I63 by linear scan over live
+        // intervals, I0 is scratch.  fails with B019 when a function needs more
+        // registers or uses a boolean outside a branch.
+        bool lower(
+                result& r,
+                uint64_t start_address,
+                std::vector<instruction_emitter>& emitters) const;
+
+        uint64_t address_of(const ir_function* function) const;
+
+    private:
+        std::vector<std::unique_ptr<ir_function>> _functions {};
+        mutable std::vector<uint64_t> _addresses {};
+    };
+
+};
@@ -0,0 +1,601 @@
+#include <map>
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+#include "ir_passes.h"
+
+namespace basecode {
+
+    ir_pass_manager ir_pass_manager::standard_pipeline() {
+        ir_pass_manager manager;
+        manager.add(std::make_unique<inlining_pass>());
+        manager.add(std::make_unique<constant_propagation_pass>());
+        manager.add(std::make_unique<common_subexpression_pass>());
+        manager.add(std::make_unique<loop_invariant_motion_pass>());
+        manager.add(std::make_unique<dead_code_elimination_pass>());
+        return manager;
+    }
+
+    void ir_pass_manager::add(std::unique_ptr<ir_pass> pass) {
+        _passes.push_back(std::move(pass));
+    }
+
+    size_t ir_pass_manager::run(ir_module& module) {
+        size_t changes = 0;
+        for (const auto& function : module.functions())
+            changes += run(*function);
+        return changes;
+    }
+
+    size_t ir_pass_manager::run(ir_function& function) {
+        size_t changes = 0;
+        for (size_t round = 0; round < max_rounds; round++) {
+            size_t round_changes = 0;
+            for (auto& pass : _passes)
+                round_changes += pass->run(function);
+            changes += round_changes;
+            if (round_changes == 0)
+                break;
+        }
+        return changes;
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+
+    inlining_pass::inlining_pass(
+            size_t size_limit,
+            size_t hot_size_limit,
+            uint64_t hot_call_count) : _size_limit(size_limit),
+                                       _hot_size_limit(hot_size_limit),
+                                       _hot_call_count(hot_call_count) {
+    }
+
+    const char* inlining_pass::name() const {
+        return "inlining";
+    }
+
+    void inlining_pass::profile(const ir_function* callee, uint64_t calls) {
+        _calls[callee] = calls;
+    }
+
+    void inlining_pass::load_profile(const ir_module& module, const terp& terp) {
+        for (const auto& function : module.functions())
+            _calls[function.get()] = terp.call_count(module.address_of(function.get()));
+    }
+
+    bool inlining_pass::should_inline(const ir_function* caller, const ir_function* callee) const {
+        if (callee == nullptr || callee == caller)
+            return false;
+
+        for (const auto& block : callee->blocks()) {
+            for (const auto& inst : block->instructions) {
+                if (inst->op == ir_opcodes::call && inst->callee == callee)
+                    return false;
+            }
+        }
+
+        auto size = callee->instruction_count();
+        if (size <= _size_limit)
+            return true;
+
+        auto it = _calls.find(callee);
+        return size <= _hot_size_limit
+            && it != _calls.end()
+            && it->second >= _hot_call_count;
+    }
+
+    size_t inlining_pass::run(ir_function& function) {
+        // only the calls present up front: calls cloned in from callees wait
+        // for the next round, which bounds the growth per round
+        std::vector<ir_value_t*> calls;
+        for (const auto& block : function.blocks()) {
+            for (const auto& inst : block->instructions) {
+                if (inst->op == ir_opcodes::call && should_inline(&function, inst->callee))
+                    calls.push_back(inst.get());
+            }
+        }
+
+        for (auto call : calls) {
+            auto block = call->block;
+            auto& instructions = block->instructions;
+            auto it = std::find_if(
+                    instructions.begin(),
+                    instructions.end(),
+                    [&](const std::unique_ptr<ir_value_t>& inst) { return inst.get() == call; });
+            inline_call(function, block, std::distance(instructions.begin(), it));
+        }
+
+        return calls.size();
+    }
+
+    void inlining_pass::inline_call(ir_function& caller, ir_block_t* block, size_t index) {
+        auto& instructions = block->instructions;
+        auto call = instructions[index].get();
+        auto callee = call->callee;
+
+        // the slot holds the argument until the callee overwrites it, so a
+        // missing argument or return value reads as whatever was pushed: zero
+        ir_value_t* argument = nullptr;
+        if (call->operands.empty()) {
+            auto zero = std::make_unique<ir_value_t>();
+            zero->id = caller.next_value_id();
+            zero->op = ir_opcodes::constant;
+            zero->type = ir_types::u64;
+            zero->block = block;
+            argument = zero.get();
+            instructions.insert(instructions.begin() + index, std::move(zero));
+            index++;
+        } else {
+            argument = call->operands[0];
+        }
+
+        auto continuation = caller.add_block();
+        for (auto i = index + 1; i < instructions.size(); i++) {
+            instructions[i]->block = continuation;
+            continuation->instructions.push_back(std::move(instructions[i]));
+        }
+        instructions.erase(instructions.begin() + index + 1, instructions.end());
+
+        for (auto successor : continuation->successors()) {
+            for (auto& inst : successor->instructions) {
+                if (inst->op != ir_opcodes::phi)
+                    break;
+                for (auto& incoming : inst->blocks) {
+                    if (incoming == block)
+                        incoming = continuation;
+                }
+            }
+        }
+
+        // clone first, then remap: phis may refer to values defined later
+        std::unordered_map<const ir_block_t*, ir_block_t*> block_map;
+        std::unordered_map<const ir_value_t*, ir_value_t*> value_map;
+        std::vector<ir_value_t*> clones;
+        for (const auto& callee_block : callee->blocks())
+            block_map[callee_block.get()] = caller.add_block();
+
+        for (const auto& callee_block : callee->blocks()) {
+            auto target = block_map[callee_block.get()];
+            for (const auto& inst : callee_block->instructions) {
+                if (inst->op == ir_opcodes::parameter) {
+                    value_map[inst.get()] = argument;
+                    continue;
+                }
+                auto clone = std::make_unique<ir_value_t>(*inst);
+                clone->id = caller.next_value_id();
+                clone->block = target;
+                value_map[inst.get()] = clone.get();
+                clones.push_back(clone.get());
+                target->instructions.push_back(std::move(clone));
+            }
+        }
+
+        std::vector<std::pair<ir_value_t*, ir_block_t*>> returns;
+        for (auto clone : clones) {
+            for (auto& operand : clone->operands)
+                operand = value_map[operand];
+            for (auto& target : clone->blocks)
+                target = block_map[target];
+
+            if (clone->op == ir_opcodes::ret) {
+                auto value = clone->operands.empty() ? argument : clone->operands[0];
+                returns.emplace_back(value, clone->block);
+                clone->op = ir_opcodes::branch;
+                clone->operands.clear();
+                clone->blocks = {continuation};
+            }
+        }
+
+        auto result_value = argument;
+        if (returns.size() == 1) {
+            result_value = returns[0].first;
+        } else if (returns.size() > 1) {
+            ir_builder builder(caller);
+            builder.position_at_end(continuation);
+            result_value = builder.phi();
+            for (const auto& ret : returns)
+                builder.add_incoming(result_value, ret.first, ret.second);
+        }
+
+        caller.replace_all_uses(call, result_value);
+        instructions.pop_back();
+
+        ir_builder builder(caller);
+        builder.position_at_end(block);
+        builder.branch(block_map[callee->entry()]);
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+
+    static void make_constant(ir_value_t* inst, uint64_t value) {
+        inst->op = ir_opcodes::constant;
+        inst->constant = value;
+        inst->operands.clear();
+    }
+
+    static bool is_constant(const ir_value_t* value, uint64_t constant) {
+        return value->op == ir_opcodes::constant && value->constant == constant;
+    }
+
+    static bool fold_binary(ir_opcodes op, uint64_t lhs, uint64_t rhs, uint64_t& value) {
+        switch (op) {
+            case ir_opcodes::add:    value = lhs + rhs; return true;
+            case ir_opcodes::sub:    value = lhs - rhs; return true;
+            case ir_opcodes::mul:    value = lhs * rhs; return true;
+            // the terp's div yields zero for a zero divisor
+            case ir_opcodes::div:    value = rhs == 0 ? 0 : lhs / rhs; return true;
+            case ir_opcodes::mod:
+                if (rhs == 0)
+                    return false;
+                value = lhs % rhs;
+                return true;
+            case ir_opcodes::and_op: value = lhs & rhs; return true;
+            case ir_opcodes::or_op:  value = lhs | rhs; return true;
+            case ir_opcodes::xor_op: value = lhs ^ rhs; return true;
+            case ir_opcodes::shl:
+            case ir_opcodes::shr:
+                if (rhs >= 64)
+                    return false;
+                value = op == ir_opcodes::shl ? lhs << rhs : lhs >> rhs;
+                return true;
+            case ir_opcodes::cmp_eq: value = lhs == rhs; return true;
+            case ir_opcodes::cmp_ne: value = lhs != rhs; return true;
+            default:
+                return false;
+        }
+    }
+
+    // the operand `inst` reduces to without computing anything, or null
+    static ir_value_t* identity_operand(const ir_value_t* inst) {
+        auto lhs = inst->operands[0];
+        auto rhs = inst->operands[1];
+        switch (inst->op) {
+            case ir_opcodes::add:
+            case ir_opcodes::or_op:
+            case ir_opcodes::xor_op:
+                if (is_constant(lhs, 0))
+                    return rhs;
+                return is_constant(rhs, 0) ? lhs : nullptr;
+            case ir_opcodes::sub:
+            case ir_opcodes::shl:
+            case ir_opcodes::shr:
+                return is_constant(rhs, 0) ? lhs : nullptr;
+            case ir_opcodes::mul:
+                if (is_constant(lhs, 1))
+                    return rhs;
+                return is_constant(rhs, 1) ? lhs : nullptr;
+            case ir_opcodes::div:
+                return is_constant(rhs, 1) ? lhs : nullptr;
+            default:
+                return nullptr;
+        }
+    }
+
+    const char* constant_propagation_pass::name() const {
+        return "constant-propagation";
+    }
+
+    size_t constant_propagation_pass::run(ir_function& function) {
+        size_t changes = 0;
+        function.compute_cfg();
+
+        for (auto block : function.reverse_post_order()) {
+            for (auto& value : block->instructions) {
+                auto inst = value.get();
+
+                if (inst->is_binary() || inst->is_compare()) {
+                    auto lhs = inst->operands[0];
+                    auto rhs = inst->operands[1];
+                    uint64_t folded;
+                    if (lhs->op == ir_opcodes::constant
+                    &&  rhs->op == ir_opcodes::constant
+                    &&  fold_binary(inst->op, lhs->constant, rhs->constant, folded)) {
+                        make_constant(inst, folded);
+                        changes++;
+                        continue;
+                    }
+
+                    if (inst->is_compare() && lhs == rhs) {
+                        make_constant(inst, inst->op == ir_opcodes::cmp_eq ? 1 : 0);
+                        changes++;
+                        continue;
+                    }
+
+                    if ((inst->op == ir_opcodes::mul || inst->op == ir_opcodes::and_op)
+                    &&  (is_constant(lhs, 0) || is_constant(rhs, 0))) {
+                        make_constant(inst, 0);
+                        changes++;
+                        continue;
+                    }
+
+                    auto identity = identity_operand(inst);
+                    if (identity != nullptr && function.use_count(inst) > 0) {
+                        function.replace_all_uses(inst, identity);
+                        changes++;
+                    }
+                    continue;
+                }
+
+                if (inst->op == ir_opcodes::phi) {
+                    ir_value_t* unique = nullptr;
+                    auto is_unique = true;
+                    for (auto operand : inst->operands) {
+                        if (operand == inst || operand == unique)
+                            continue;
+                        if (unique != nullptr) {
+                            is_unique = false;
+                            break;
+                        }
+                        unique = operand;
+                    }
+                    if (is_unique && unique != nullptr && function.use_count(inst) > 0) {
+                        function.replace_all_uses(inst, unique);
+                        changes++;
+                    }
+                    continue;
+                }
+
+                if (inst->op == ir_opcodes::cond_branch
+                &&  inst->operands[0]->op == ir_opcodes::constant) {
+                    auto taken = inst->operands[0]->constant != 0 ? inst->blocks[0] : inst->blocks[1];
+                    auto not_taken = inst->operands[0]->constant != 0 ? inst->blocks[1] : inst->blocks[0];
+                    if (not_taken != taken)
+                        function.remove_phi_incoming(not_taken, block);
+                    inst->op = ir_opcodes::branch;
+                    inst->operands.clear();
+                    inst->blocks = {taken};
+                    changes++;
+                }
+            }
+        }
+
+        changes += function.remove_unreachable_blocks();
+        changes += function.merge_straight_line_blocks();
+        return changes;
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+
+    const char* dead_code_elimination_pass::name() const {
+        return "dead-code-elimination";
+    }
+
+    size_t dead_code_elimination_pass::run(ir_function& function) {
+        size_t changes = function.remove_unreachable_blocks();
+
+        auto changed = true;
+        while (changed) {
+            changed = false;
+
+            std::unordered_map<const ir_value_t*, size_t> uses;
+            for (const auto& block : function.blocks()) {
+                for (const auto& inst : block->instructions) {
+                    for (auto operand : inst->operands)
+                        uses[operand]++;
+                }
+            }
+
+            // an instruction is only erased once nothing refers to it, so no
+            // operand is ever left dangling
+            for (auto& block : function.blocks()) {
+                auto& instructions = block->instructions;
+                auto end = std::remove_if(
+                        instructions.begin(),
+                        instructions.end(),
+                        [&](const std::unique_ptr<ir_value_t>& inst) {
+                            return !inst->has_side_effects() && uses[inst.get()] == 0;
+                        });
+                if (end != instructions.end()) {
+                    changes += std::distance(end, instructions.end());
+                    instructions.erase(end, instructions.end());
+                    changed = true;
+                }
+            }
+        }
+
+        return changes;
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+
+    static bool is_commutative(ir_opcodes op) {
+        switch (op) {
+            case ir_opcodes::add:
+            case ir_opcodes::mul:
+            case ir_opcodes::and_op:
+            case ir_opcodes::or_op:
+            case ir_opcodes::xor_op:
+            case ir_opcodes::cmp_eq:
+            case ir_opcodes::cmp_ne:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    const char* common_subexpression_pass::name() const {
+        return "common-subexpression-elimination";
+    }
+
+    size_t common_subexpression_pass::run(ir_function& function) {
+        function.compute_cfg();
+
+        std::unordered_map<const ir_block_t*, std::vector<ir_block_t*>> children;
+        for (auto block : function.reverse_post_order()) {
+            if (block->idom != nullptr && block->idom != block)
+                children[block->idom].push_back(block);
+        }
+
+        using key_t = std::vector<uintptr_t>;
+        auto make_key = [](const ir_value_t* inst, key_t& key) {
+            auto pure_call = inst->op == ir_opcodes::call
+                && inst->callee != nullptr
+                && inst->callee->is_pure();
+            if (inst->op != ir_opcodes::constant
+            &&  !inst->is_binary()
+            &&  !inst->is_compare()
+            &&  !pure_call)
+                return false;
+
+            std::vector<uintptr_t> operands;
+            for (auto operand : inst->operands)
+                operands.push_back(reinterpret_cast<uintptr_t>(operand));
+            if (is_commutative(inst->op))
+                std::sort(operands.begin(), operands.end());
+
+            key = {
+                static_cast<uintptr_t>(inst->op),
+                static_cast<uintptr_t>(inst->type),
+                static_cast<uintptr_t>(inst->constant),
+                reinterpret_cast<uintptr_t>(inst->callee),
+            };
+            key.insert(key.end(), operands.begin(), operands.end());
+            return true;
+        };
+
+        size_t changes = 0;
+        std::map<key_t, ir_value_t*> available;
+        std::function<void (ir_block_t*)> visit = [&](ir_block_t* block) {
+            std::vector<key_t> scope;
+            auto& instructions = block->instructions;
+            for (size_t i = 0; i < instructions.size();) {
+                auto inst = instructions[i].get();
+                key_t key;
+                if (!make_key(inst, key)) {
+                    i++;
+                    continue;
+                }
+
+                auto it = available.find(key);
+                if (it != available.end()) {
+                    function.replace_all_uses(inst, it->second);
+                    instructions.erase(instructions.begin() + i);
+                    changes++;
+                    continue;
+                }
+
+                available[key] = inst;
+                scope.push_back(std::move(key));
+                i++;
+            }
+
+            for (auto child : children[block])
+                visit(child);
+
+            for (const auto& key : scope)
+                available.erase(key);
+        };
+        visit(function.entry());
+
+        return changes;
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+
+    const char* loop_invariant_motion_pass::name() const {
+        return "loop-invariant-code-motion";
+    }
+
+    size_t loop_invariant_motion_pass::run(ir_function& function) {
+        function.compute_cfg();
+
+        std::vector<std::pair<ir_block_t*, ir_block_t*>> back_edges;
+        for (auto block : function.reverse_post_order()) {
+            for (auto successor : block->successors()) {
+                if (function.dominates(successor, block))
+                    back_edges.emplace_back(successor, block);
+            }
+        }
+
+        size_t changes = 0;
+        for (const auto& edge : back_edges) {
+            auto header = edge.first;
+            function.compute_cfg();
+
+            // natural loop: everything that reaches the latch without going
+            // through the header
+            std::unordered_set<ir_block_t*> body {header};
+            std::vector<ir_block_t*> work {edge.second};
+            while (!work.empty()) {
+                auto block = work.back();
+                work.pop_back();
+                if (!body.insert(block).second)
+                    continue;
+                for (auto predecessor : block->predecessors)
+                    work.push_back(predecessor);
+            }
+
+            ir_block_t* outside = nullptr;
+            size_t outside_count = 0;
+            for (auto predecessor : header->predecessors) {
+                if (body.count(predecessor) == 0) {
+                    outside = predecessor;
+                    outside_count++;
+                }
+            }
+            if (outside_count != 1)
+                continue;
+
+            auto preheader = outside;
+            if (outside->successors().size() != 1) {
+                preheader = function.add_block();
+                ir_builder builder(function);
+                builder.position_at_end(preheader);
+                builder.branch(header);
+
+                for (auto& target : outside->terminator()->blocks) {
+                    if (target == header)
+                        target = preheader;
+                }
+                for (auto& inst : header->instructions) {
+                    if (inst->op != ir_opcodes::phi)
+                        break;
+                    for (auto& incoming : inst->blocks) {
+                        if (incoming == outside)
+                            incoming = preheader;
+                    }
+                }
+                function.compute_cfg();
+            }
+
+            auto moved = true;
+            while (moved) {
+                moved = false;
+                for (auto block : function.reverse_post_order()) {
+                    if (body.count(block) == 0)
+                        continue;
+
+                    auto& instructions = block->instructions;
+                    for (size_t i = 0; i < instructions.size();) {
+                        auto inst = instructions[i].get();
+                        auto candidate = inst->op == ir_opcodes::constant
+                            || inst->is_compare()
+                            || (inst->is_binary()
+                                && inst->op != ir_opcodes::div
+                                && inst->op != ir_opcodes::mod);
+                        auto invariant = candidate && std::all_of(
+                                inst->operands.begin(),
+                                inst->operands.end(),
+                                [&](const ir_value_t* operand) { return body.count(operand->block) == 0; });
+                        if (!invariant) {
+                            i++;
+                            continue;
+                        }
+
+                        auto owned = std::move(instructions[i]);
+                        instructions.erase(instructions.begin() + i);
+                        owned->block = preheader;
+                        auto& target = preheader->instructions;
+                        target.insert(target.end() - 1, std::move(owned));
+                        moved = true;
+                        changes++;
+                    }
+                }
+            }
+        }
+
+        return changes;
+    }
+
+};
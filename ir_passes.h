@@ -0,0 +1,123 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "ir.h"
+#include "terp.h"
+
+namespace basecode {
+
+    class ir_pass {
+    public:
+        virtual ~ir_pass() = default;
+
+        virtual const char* name() const = 0;
+
+        // returns the number of changes made to the function
+        virtual size_t run(ir_function& function) = 0;
+    };
+
+    // runs its passes in order, over and over, until a full round changes
+    // nothing or max_rounds is reached
+    class ir_pass_manager {
+    public:
+        static const size_t max_rounds = 8;
+
+        ir_pass_manager() = default;
+
+        // inlining, constant propagation, dead code elimination, common
+        // subexpression elimination and loop-invariant code motion
+        static ir_pass_manager standard_pipeline();
+
+        void add(std::unique_ptr<ir_pass> pass);
+
+        size_t run(ir_module& module);
+
+        size_t run(ir_function& function);
+
+    private:
+        std::vector<std::unique_ptr<ir_pass>> _passes {};
+    };
+
+    // splices callees into their callers: the call's block is split, the
+    // callee's blocks are cloned with fresh values, its parameter becomes the
+    // call argument and each ret branches to the continuation, where a phi
+    // collects the return values.  callees up to size_limit instructions are
+    // always inlined; callees up to hot_size_limit only once the profile has
+    // seen at least hot_call_count calls to them.  self-recursive callees are
+    // never inlined.
+    class inlining_pass : public ir_pass {
+    public:
+        static const size_t default_size_limit = 8;
+        static const size_t default_hot_size_limit = 32;
+        static const uint64_t default_hot_call_count = 1000;
+
+        explicit inlining_pass(
+                size_t size_limit = default_size_limit,
+                size_t hot_size_limit = default_hot_size_limit,
+                uint64_t hot_call_count = default_hot_call_count);
+
+        const char* name() const override;
+
+        size_t run(ir_function& function) override;
+
+        void profile(const ir_function* callee, uint64_t calls);
+
+        // call counts from a terp that ran `module` as lowered by ir_module::lower
+        void load_profile(const ir_module& module, const terp& terp);
+
+    private:
+        bool should_inline(const ir_function* caller, const ir_function* callee) const;
+
+        void inline_call(ir_function& caller, ir_block_t* block, size_t index);
+
+    private:
+        size_t _size_limit;
+        size_t _hot_size_limit;
+        uint64_t _hot_call_count;
+        std::unordered_map<const ir_function*, uint64_t> _calls {};
+    };
+
+    // folds arithmetic and comparisons on constants, simple identities (x+0,
+    // x*1, x*0, ...), phis with a single distinct incoming value and branches
+    // on constant conditions, then drops the blocks that became unreachable and
+    // merges straight-line chains of blocks
+    class constant_propagation_pass : public ir_pass {
+    public:
+        const char* name() const override;
+
+        size_t run(ir_function& function) override;
+    };
+
+    // removes unused instructions without side effects; calls only count as
+    // side effect free when the callee is pure
+    class dead_code_elimination_pass : public ir_pass {
+    public:
+        const char* name() const override;
+
+        size_t run(ir_function& function) override;
+    };
+
+    // dominator-scoped value numbering: an instruction recomputing a value
+    // that a dominating instruction already computed is replaced by it
+    class common_subexpression_pass : public ir_pass {
+    public:
+        const char* name() const override;
+
+        size_t run(ir_function& function) override;
+    };
+
+    // hoists loop-invariant arithmetic into the loop preheader, creating one
+    // when the loop's single outside predecessor also branches elsewhere.
+    // div and mod stay put: hoisting them could fault on a path that never
+    // executed them.
+    class loop_invariant_motion_pass : public ir_pass {
+    public:
+        const char* name() const override;
+
+        size_t run(ir_function& function) override;
+    };
+
+};
@@ -1,8 +1,24 @@
 #include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <thread>
 #include <iostream>
 #include <functional>
+#include <filesystem>
+#include <unistd.h>
 #include <fmt/format.h>
 #include "terp.h"
+#include "async_io.h"
+#include "channel.h"
+#include "batch_terp.h"
+#include "verifier.h"
+#include "terp_snapshot.h"
+#include "partial_evaluator.h"
+#include "ir.h"
+#include "ir_passes.h"
+#include "c_backend.h"
+#include "code_cache.h"
 #include "instruction_emitter.h"
 
 using test_function_callable = std::function<bool (basecode::result&, basecode::terp&)>;
@@ -19,11 +35,7 @@ static void print_results(basecode::result& r) {
 }
 
 static bool run_terp(basecode::result& r, basecode::terp& terp) {
-    while (!terp.has_exited())
-        if (!terp.step(r))
-            return false;
-
-    return true;
+    return terp.run(r) == basecode::run_status::exited;
 }
 
 static bool test_square(basecode::result& r, basecode::terp& terp) {
@@ -115,6 +127,1997 @@ static bool test_fibonacci(basecode::result& r, basecode::terp& terp) {
     return result;
 }
 
+static bool test_tail_call(basecode::result& r, basecode::terp& terp) {
+    basecode::instruction_emitter bootstrap_emitter(0);
+    bootstrap_emitter.jump_direct(0);
+
+    basecode::instruction_emitter fn_countdown(bootstrap_emitter.end_address());
+    fn_countdown.load_stack_offset_to_register(0, 8);
+    fn_countdown.compare_int_register_to_constant(basecode::op_sizes::qword, 0, 0);
+    fn_countdown.branch_if_equal(0);
+    fn_countdown.subtract_int_constant_from_register(basecode::op_sizes::qword, 0, 0, 1);
+    fn_countdown.push_int_register(basecode::op_sizes::qword, 0);
+    fn_countdown.jump_subroutine_direct(fn_countdown.start_address());
+    fn_countdown.pop_int_register(basecode::op_sizes::qword, 0);
+    fn_countdown.store_register_to_stack_offset(0, 8);
+    fn_countdown.rts();
+    fn_countdown[2].patch_branch_address(fn_countdown.end_address());
+    fn_countdown.rts();
+
+    if (fn_countdown.optimize_tail_calls() != 1) {
+        r.add_message("T002", "fn_countdown should have one call in tail position.", true);
+        return false;
+    }
+
+    basecode::instruction_emitter main_emitter(fn_countdown.end_address());
+    main_emitter.push_int_constant(basecode::op_sizes::qword, 1000000);
+    main_emitter.jump_subroutine_direct(fn_countdown.start_address());
+    main_emitter.pop_int_register(basecode::op_sizes::qword, 7);
+    main_emitter.exit();
+
+    bootstrap_emitter[0].patch_branch_address(main_emitter.start_address());
+    bootstrap_emitter.encode(r, terp);
+    fn_countdown.encode(r, terp);
+    main_emitter.encode(r, terp);
+
+    if (r.is_failed())
+        return false;
+
+    auto result = run_terp(r, terp);
+    if (terp.register_file().i[7] != 0) {
+        r.add_message("T001", "I7 should contain 0.", true);
+    }
+
+    if (terp.register_file().sp != terp.heap_size()) {
+        r.add_message("T001", "SP should be back at the top of the heap.", true);
+    }
+
+    return result;
+}
+
+static bool test_call_site_cache(basecode::result& r, basecode::terp& terp) {
+    basecode::instruction_emitter bootstrap_emitter(0);
+    bootstrap_emitter.jump_direct(0);
+
+    basecode::instruction_emitter fn_one_emitter(bootstrap_emitter.end_address());
+    fn_one_emitter.move_int_constant_to_register(basecode::op_sizes::qword, 1, 0);
+    fn_one_emitter.rts();
+
+    basecode::instruction_emitter fn_two_emitter(fn_one_emitter.end_address());
+    fn_two_emitter.move_int_constant_to_register(basecode::op_sizes::qword, 2, 0);
+    fn_two_emitter.rts();
+
+    // a direct call site and an indirect one, each at the start of a wrapper
+    basecode::instruction_emitter fn_direct_emitter(fn_two_emitter.end_address());
+    fn_direct_emitter.jump_subroutine_direct(fn_one_emitter.start_address());
+    fn_direct_emitter.rts();
+
+    basecode::instruction_emitter fn_indirect_emitter(fn_direct_emitter.end_address());
+    fn_indirect_emitter.jump_subroutine_indirect(4);
+    fn_indirect_emitter.rts();
+
+    auto fn_size = fn_two_emitter.end_address() - fn_two_emitter.start_address();
+    basecode::instruction_emitter main_emitter(fn_indirect_emitter.end_address());
+    main_emitter.jump_subroutine_direct(fn_direct_emitter.start_address());
+    main_emitter.jump_subroutine_direct(fn_direct_emitter.start_address());
+    main_emitter.move_int_constant_to_register(basecode::op_sizes::qword, fn_one_emitter.start_address(), 4);
+    main_emitter.jump_subroutine_direct(fn_indirect_emitter.start_address());
+    main_emitter.move_int_constant_to_register(basecode::op_sizes::qword, fn_two_emitter.start_address(), 4);
+    main_emitter.jump_subroutine_direct(fn_indirect_emitter.start_address());
+    // overwrite fn_one with fn_two: the indirect site's cached decode of
+    // fn_one is stale from here on
+    main_emitter.move_int_constant_to_register(basecode::op_sizes::qword, fn_two_emitter.start_address(), 1);
+    main_emitter.move_int_constant_to_register(basecode::op_sizes::qword, fn_one_emitter.start_address(), 2);
+    main_emitter.copy_memory(basecode::op_sizes::byte, 1, 2, fn_size);
+    main_emitter.move_int_constant_to_register(basecode::op_sizes::qword, fn_one_emitter.start_address(), 4);
+    main_emitter.jump_subroutine_direct(fn_indirect_emitter.start_address());
+    main_emitter.exit();
+
+    bootstrap_emitter[0].patch_branch_address(main_emitter.start_address());
+    bootstrap_emitter.encode(r, terp);
+    fn_one_emitter.encode(r, terp);
+    fn_two_emitter.encode(r, terp);
+    fn_direct_emitter.encode(r, terp);
+    fn_indirect_emitter.encode(r, terp);
+    main_emitter.encode(r, terp);
+
+    if (r.is_failed() || !run_terp(r, terp))
+        return false;
+
+    auto direct_site = terp.call_site(fn_direct_emitter.start_address());
+    if (direct_site == nullptr
+    ||  direct_site->is_polymorphic()
+    ||  direct_site->misses != 1
+    ||  direct_site->hits != 1) {
+        r.add_message("T023", "a direct call site should miss once, then hit.", true);
+        return false;
+    }
+
+    auto indirect_site = terp.call_site(fn_indirect_emitter.start_address());
+    if (indirect_site == nullptr
+    ||  !indirect_site->is_polymorphic()
+    ||  indirect_site->count != 2
+    ||  indirect_site->misses != 2
+    ||  indirect_site->hits != 1) {
+        r.add_message("T023", "an indirect call site should cache both of its targets.", true);
+        return false;
+    }
+
+    if (terp.call_site(main_emitter.end_address()) != nullptr) {
+        r.add_message("T023", "an address that never ran jsr should have no call site.", true);
+        return false;
+    }
+
+    if (terp.register_file().i[0] != 2) {
+        r.add_message("T023", "a store over a cached callee should invalidate its decoded instruction.", true);
+        return false;
+    }
+
+    return true;
+}
+
+static bool test_snapshot_fork(basecode::result& r, basecode::terp& terp) {
+    if (!test_square(r, terp))
+        return false;
+
+    basecode::terp_snapshot snapshot;
+    if (!terp.snapshot(r, snapshot))
+        return false;
+
+    for (size_t i = 0; i < 1000; i++) {
+        basecode::terp clone(snapshot.heap_size());
+        if (!clone.initialize(r, snapshot))
+            return false;
+
+        if (clone.register_file().i[5] != 81 || clone.register_file().i[6] != 25) {
+            r.add_message("T001", "forked terp should see the snapshot's register file.", true);
+            return false;
+        }
+
+        clone.heap()[0] = 0xff;
+    }
+
+    if (terp.heap()[0] == 0xff) {
+        r.add_message("T001", "writes to a forked terp must not reach the original heap.", true);
+        return false;
+    }
+
+    // a clone built with default options still gets the source's layout
+    basecode::heap_options_t options;
+    options.stack_size = 64 * 1024;
+    options.allocator_size = 64 * 1024;
+    basecode::terp guarded_terp(1024 * 1024, options);
+    basecode::terp_snapshot guarded_snapshot;
+    if (!guarded_terp.initialize(r) || !guarded_terp.snapshot(r, guarded_snapshot))
+        return false;
+
+    basecode::terp guarded_clone(guarded_snapshot.heap_size());
+    if (!guarded_clone.initialize(r, guarded_snapshot))
+        return false;
+
+    basecode::instruction_emitter clone_emitter(0);
+    clone_emitter.alloc_int_constant(1, 24);
+    basecode::instruction_emitter fn_runaway_emitter(clone_emitter.end_address());
+    fn_runaway_emitter.jump_subroutine_direct(fn_runaway_emitter.start_address());
+    clone_emitter.encode(r, guarded_clone);
+    fn_runaway_emitter.encode(r, guarded_clone);
+
+    basecode::result overflow_result;
+    if (guarded_clone.run(overflow_result) != basecode::run_status::failed
+    ||  !overflow_result.has_code("B015")
+    ||  guarded_clone.register_file().i[1] == 0) {
+        r.add_message("T009", "a snapshot clone should keep the source's stack guard and allocator.", true);
+        return false;
+    }
+
+    return true;
+}
+
+static bool test_preemption(basecode::result& r, basecode::terp& terp) {
+    basecode::instruction_emitter loop_emitter(0);
+    loop_emitter.inc(basecode::op_sizes::qword, 0);
+    loop_emitter.jump_direct(loop_emitter.start_address());
+    loop_emitter.encode(r, terp);
+
+    if (r.is_failed())
+        return false;
+
+    for (size_t slice = 1; slice <= 3; slice++) {
+        if (terp.run(r, 1000) != basecode::run_status::yielded) {
+            r.add_message("T003", "runaway loop should yield when its budget is spent.", true);
+            return false;
+        }
+
+        if (terp.register_file().i[0] != slice * 1000) {
+            r.add_message("T003", "each slice should execute exactly 1000 loop iterations.", true);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool test_async_host_call(basecode::result& r, basecode::terp& terp) {
+    basecode::async_io_loop io_loop;
+    if (!io_loop.initialize(r))
+        return false;
+
+    basecode::host_function_registry registry;
+    registry.add(1, [&](basecode::result& r, basecode::terp& caller, uint64_t&) {
+        auto armed = io_loop.add_timer(r, caller.register_file().i[0], [&caller](int64_t expirations) {
+            caller.complete_host_call(static_cast<uint64_t>(expirations));
+        });
+        return armed ? basecode::host_call_status::suspended : basecode::host_call_status::failed;
+    });
+    registry.add(2, [](basecode::result&, basecode::terp& caller, uint64_t& value) {
+        value = caller.register_file().i[0] + 41;
+        return basecode::host_call_status::completed;
+    });
+    terp.host_functions(&registry);
+
+    basecode::instruction_emitter main_emitter(0);
+    main_emitter.move_int_constant_to_register(basecode::op_sizes::qword, 2, 0);
+    main_emitter.call_host(1);
+    main_emitter.call_host(2);
+    main_emitter.exit();
+    main_emitter.encode(r, terp);
+
+    if (r.is_failed())
+        return false;
+
+    auto status = terp.run(r);
+    if (status != basecode::run_status::suspended) {
+        r.add_message("T004", "terp should suspend while the timer is pending.", true);
+        return false;
+    }
+
+    while (io_loop.pending() > 0)
+        io_loop.poll(-1);
+
+    status = terp.run(r);
+    terp.host_functions(nullptr);
+    if (status != basecode::run_status::exited) {
+        r.add_message("T004", "terp should exit once the host call completes.", true);
+        return false;
+    }
+
+    if (terp.register_file().i[0] != 42) {
+        r.add_message("T001", "I0 should contain 42.", true);
+        return false;
+    }
+
+    // a completion that lands before the host function returns suspended
+    // must not be lost
+    basecode::host_function_registry early_registry;
+    early_registry.add(1, [](basecode::result&, basecode::terp& caller, uint64_t&) {
+        caller.complete_host_call(7);
+        return basecode::host_call_status::suspended;
+    });
+    terp.reset();
+    terp.host_functions(&early_registry);
+
+    basecode::instruction_emitter early_emitter(0);
+    early_emitter.call_host(1);
+    early_emitter.exit();
+    early_emitter.encode(r, terp);
+    if (r.is_failed())
+        return false;
+
+    status = terp.run(r);
+    terp.host_functions(nullptr);
+    if (status != basecode::run_status::exited || terp.register_file().i[0] != 7) {
+        r.add_message("T004", "a host call completed before it suspends should still resume.", true);
+        return false;
+    }
+
+    return true;
+}
+
+static bool test_bulk_memory(basecode::result& r, basecode::terp& terp) {
+    const uint64_t buffer_a = 0x10000;
+    const uint64_t buffer_b = 0x20000;
+
+    basecode::instruction_emitter main_emitter(0);
+    main_emitter.move_int_constant_to_register(basecode::op_sizes::qword, buffer_a, 1);
+    main_emitter.move_int_constant_to_register(basecode::op_sizes::qword, buffer_b, 2);
+    main_emitter.move_int_constant_to_register(basecode::op_sizes::qword, buffer_a + 2 * 37, 5);
+    main_emitter.fill_memory(basecode::op_sizes::qword, 0x1122334455667788, 2, 40);
+    main_emitter.fill_memory(basecode::op_sizes::word, 0xabcd, 1, 100);
+    main_emitter.find_in_memory(basecode::op_sizes::word, 3, 0x1234, 1, 100);
+    main_emitter.fill_memory(basecode::op_sizes::word, 0x1234, 5, 1);
+    main_emitter.find_in_memory(basecode::op_sizes::word, 4, 0x1234, 1, 100);
+    main_emitter.copy_memory(basecode::op_sizes::byte, 1, 2, 200);
+    main_emitter.compare_memory(basecode::op_sizes::byte, 6, 1, 2, 200);
+    main_emitter.exit();
+    main_emitter.encode(r, terp);
+
+    if (r.is_failed())
+        return false;
+
+    auto result = run_terp(r, terp);
+
+    auto heap = terp.heap();
+    if (heap[buffer_a] != 0xcd || heap[buffer_a + 1] != 0xab || heap[buffer_a + 199] != 0xab) {
+        r.add_message("T005", "fill.w should replicate the 16-bit pattern.", true);
+    }
+
+    if (heap[buffer_b + 200] != 0x88 || heap[buffer_b + 207] != 0x11) {
+        r.add_message("T005", "fill.qw should replicate the 64-bit pattern.", true);
+    }
+
+    const auto& registers = terp.register_file();
+    if (registers.i[3] != 100 || registers.i[4] != 37) {
+        r.add_message("T005", "find.w should return the element index, or the length when missing.", true);
+    }
+
+    if (registers.i[6] != 0) {
+        r.add_message("T005", "cmpm should report the copied buffers as equal.", true);
+    }
+
+    // length * 8 wraps to 8 bytes, but find scans `length` elements
+    basecode::instruction_emitter overflow_emitter(0);
+    overflow_emitter.move_int_constant_to_register(basecode::op_sizes::qword, 4096, 1);
+    overflow_emitter.find_in_memory(basecode::op_sizes::qword, 3, 0x1234, 1, (1ull << 61) + 1);
+    overflow_emitter.exit();
+    overflow_emitter.encode(r, terp);
+
+    basecode::result overflow_result;
+    terp.reset();
+    if (terp.run(overflow_result) != basecode::run_status::failed
+    ||  !overflow_result.has_code("B014")) {
+        r.add_message("T005", "find should reject element counts whose byte size wraps.", true);
+        return false;
+    }
+
+    return result;
+}
+
+static bool test_vector_dot_product(basecode::result& r, basecode::terp& terp) {
+    const uint64_t lhs_address = 0x10000;
+    const uint64_t rhs_address = 0x10080;
+
+    auto lhs = reinterpret_cast<double*>(terp.heap() + lhs_address);
+    auto rhs = reinterpret_cast<double*>(terp.heap() + rhs_address);
+    for (size_t i = 0; i < 16; i++) {
+        lhs[i] = static_cast<double>(i);
+        rhs[i] = 2.0;
+    }
+
+    basecode::instruction_emitter main_emitter(0);
+    main_emitter.move_int_constant_to_register(basecode::op_sizes::qword, lhs_address, 1);
+    main_emitter.move_int_constant_to_register(basecode::op_sizes::qword, rhs_address, 2);
+    main_emitter.vector_splat_constant(0, 0.0);
+    for (uint64_t offset = 0; offset < 16 * sizeof(double); offset += sizeof(basecode::vector4d_t)) {
+        main_emitter.vector_load(1, 1, offset);
+        main_emitter.vector_load(2, 2, offset);
+        main_emitter.vector_multiply_add(0, 1, 2, 0);
+    }
+    main_emitter.vector_reduce(basecode::op_codes::vhadd, 0, 0);
+    main_emitter.vector_reduce(basecode::op_codes::vhmax, 1, 0);
+    main_emitter.exit();
+    main_emitter.encode(r, terp);
+
+    if (r.is_failed())
+        return false;
+
+    auto result = run_terp(r, terp);
+    if (terp.register_file().f[0] != 240.0) {
+        r.add_message("T001", "F0 should contain 240.0.", true);
+    }
+
+    if (terp.register_file().f[1] != 72.0) {
+        r.add_message("T001", "F1 should contain 72.0.", true);
+    }
+
+    return result;
+}
+
+static bool test_batch_lanes(basecode::result& r, basecode::terp& terp) {
+    // I1 = I0 == 7 ? 1000 : I0 * I0
+    basecode::instruction_emitter fn_emitter(0);
+    fn_emitter.compare_int_register_to_constant(basecode::op_sizes::qword, 0, 7);
+    fn_emitter.branch_if_equal(0);
+    fn_emitter.multiply_int_register_to_register(basecode::op_sizes::qword, 1, 0, 0);
+    fn_emitter.jump_direct(0);
+    fn_emitter[1].patch_branch_address(fn_emitter.end_address());
+    fn_emitter.move_int_constant_to_register(basecode::op_sizes::qword, 1000, 1);
+    fn_emitter[3].patch_branch_address(fn_emitter.end_address());
+    fn_emitter.exit();
+    fn_emitter.encode(r, terp);
+
+    if (r.is_failed())
+        return false;
+
+    basecode::batch_terp batch(terp, 4096);
+    batch.reset();
+    auto inputs = batch.register_lanes(0);
+    for (size_t lane = 0; lane < batch.lanes(); lane++)
+        inputs[lane] = lane;
+
+    if (!batch.run(r, fn_emitter.start_address()))
+        return false;
+
+    auto outputs = batch.register_lanes(1);
+    for (size_t lane = 0; lane < batch.lanes(); lane++) {
+        auto expected = lane == 7 ? 1000 : lane * lane;
+        if (outputs[lane] != expected) {
+            r.add_message("T006", "batch lane produced the wrong result.", true);
+            return false;
+        }
+    }
+
+    if (batch.register_lanes(64) != nullptr) {
+        r.add_message("T006", "batch register index past I63 should be rejected.", true);
+        return false;
+    }
+
+    // every lane calls fn_square with its own frame
+    basecode::instruction_emitter fn_square_emitter(fn_emitter.end_address());
+    fn_square_emitter.load_stack_offset_to_register(0, 8);
+    fn_square_emitter.multiply_int_register_to_register(basecode::op_sizes::dword, 0, 0, 0);
+    fn_square_emitter.store_register_to_stack_offset(0, 8);
+    fn_square_emitter.rts();
+
+    basecode::instruction_emitter main_emitter(fn_square_emitter.end_address());
+    main_emitter.push_int_register(basecode::op_sizes::qword, 0);
+    main_emitter.jump_subroutine_direct(fn_square_emitter.start_address());
+    main_emitter.pop_int_register(basecode::op_sizes::qword, 1);
+    main_emitter.exit();
+
+    fn_square_emitter.encode(r, terp);
+    main_emitter.encode(r, terp);
+
+    if (r.is_failed())
+        return false;
+
+    batch.reset();
+    for (size_t lane = 0; lane < batch.lanes(); lane++)
+        inputs[lane] = lane;
+
+    if (!batch.run(r, main_emitter.start_address()))
+        return false;
+
+    for (size_t lane = 0; lane < batch.lanes(); lane++) {
+        if (outputs[lane] != lane * lane) {
+            r.add_message("T006", "batch lane returned the wrong result from fn_square.", true);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool test_verifier(basecode::result& r, basecode::terp& terp) {
+    basecode::instruction_emitter bad_register_emitter(0);
+    bad_register_emitter.load_with_offset_to_register(200, 0, 0);
+    bad_register_emitter.exit();
+    bad_register_emitter.encode(r, terp);
+
+    basecode::verifier verifier(terp);
+    basecode::result bad_register_result;
+    if (verifier.verify(bad_register_result, 0, bad_register_emitter.end_address())
+    ||  !bad_register_result.has_code("B012")) {
+        r.add_message("T007", "verifier should reject out of range register indexes.", true);
+        return false;
+    }
+
+    basecode::instruction_emitter unbalanced_emitter(0);
+    unbalanced_emitter.pop_int_register(basecode::op_sizes::qword, 0);
+    unbalanced_emitter.rts();
+    unbalanced_emitter.encode(r, terp);
+
+    basecode::result unbalanced_result;
+    if (verifier.verify(unbalanced_result, 0, unbalanced_emitter.end_address())
+    ||  !unbalanced_result.has_code("B013")) {
+        r.add_message("T007", "verifier should reject unbalanced stack use.", true);
+        return false;
+    }
+
+    basecode::instruction_emitter bootstrap_emitter(0);
+    bootstrap_emitter.jump_direct(0);
+
+    basecode::instruction_emitter fn_double_emitter(bootstrap_emitter.end_address());
+    fn_double_emitter.load_stack_offset_to_register(0, 8);
+    fn_double_emitter.add_int_register_to_register(basecode::op_sizes::qword, 0, 0, 0);
+    fn_double_emitter.store_register_to_stack_offset(0, 8);
+    fn_double_emitter.rts();
+
+    basecode::instruction_emitter main_emitter(fn_double_emitter.end_address());
+    main_emitter.push_int_constant(basecode::op_sizes::qword, 21);
+    main_emitter.jump_subroutine_direct(fn_double_emitter.start_address());
+    main_emitter.pop_int_register(basecode::op_sizes::qword, 1);
+    main_emitter.exit();
+
+    bootstrap_emitter[0].patch_branch_address(main_emitter.start_address());
+    bootstrap_emitter.encode(r, terp);
+    fn_double_emitter.encode(r, terp);
+    main_emitter.encode(r, terp);
+
+    if (!verifier.verify(r, 0, main_emitter.end_address()) || !terp.is_verified(0)) {
+        r.add_message("T007", "fn_double's program should verify.", true);
+        return false;
+    }
+
+    // only instruction boundaries count: a return address or indirect call
+    // target in the middle of an instruction has to be checked
+    if (terp.is_verified(main_emitter.start_address() + 8)
+    ||  !terp.is_verified(main_emitter.start_address())) {
+        r.add_message("T007", "only instruction boundaries should be verified.", true);
+        return false;
+    }
+
+    if (!run_terp(r, terp))
+        return false;
+
+    if (terp.register_file().i[1] != 42) {
+        r.add_message("T001", "I1 should contain 42.", true);
+        return false;
+    }
+
+    // a verified function that overwrites its own return address: rts lands
+    // inside an instruction and must not run it unchecked
+    terp.reset();
+    basecode::instruction_emitter smash_bootstrap_emitter(0);
+    smash_bootstrap_emitter.jump_direct(0);
+
+    basecode::instruction_emitter fn_smash_emitter(smash_bootstrap_emitter.end_address());
+    fn_smash_emitter.move_int_constant_to_register(
+            basecode::op_sizes::qword,
+            fn_smash_emitter.start_address() + 8,
+            2);
+    fn_smash_emitter.store_register_to_stack_offset(2, 0);
+    fn_smash_emitter.rts();
+
+    basecode::instruction_emitter smash_main_emitter(fn_smash_emitter.end_address());
+    smash_main_emitter.jump_subroutine_direct(fn_smash_emitter.start_address());
+    smash_main_emitter.exit();
+
+    smash_bootstrap_emitter[0].patch_branch_address(smash_main_emitter.start_address());
+    smash_bootstrap_emitter.encode(r, terp);
+    fn_smash_emitter.encode(r, terp);
+    smash_main_emitter.encode(r, terp);
+
+    basecode::result smash_result;
+    if (!verifier.verify(r, 0, smash_main_emitter.end_address())
+    ||  terp.run(smash_result) != basecode::run_status::failed
+    ||  !smash_result.has_code("B012")) {
+        r.add_message("T007", "a return into the middle of an instruction should be checked.", true);
+        return false;
+    }
+
+    return true;
+}
+
+static bool test_masked_heap(basecode::result& r, basecode::terp&) {
+    basecode::heap_options_t options;
+    options.masked_addresses = true;
+
+    basecode::terp masked_terp((1024 * 1024) * 3, options);
+    if (!masked_terp.initialize(r))
+        return false;
+
+    // the reservation is 4MB: addresses wrap into it, and the top 1MB traps
+    basecode::instruction_emitter main_emitter(0);
+    main_emitter.move_int_constant_to_register(basecode::op_sizes::qword, 0x7fff00000000 + 0x1000, 1);
+    main_emitter.move_int_constant_to_register(basecode::op_sizes::qword, 42, 0);
+    main_emitter.store_with_offset_from_register(0, 1, 0);
+    main_emitter.move_int_constant_to_register(basecode::op_sizes::qword, (1024 * 1024) * 3 + 0x1000, 2);
+    main_emitter.load_with_offset_to_register(2, 3, 0);
+    main_emitter.exit();
+    main_emitter.encode(r, masked_terp);
+
+    if (r.is_failed())
+        return false;
+
+    basecode::result trap_result;
+    if (masked_terp.run(trap_result) != basecode::run_status::failed
+    ||  !trap_result.has_code("B014")) {
+        r.add_message("T008", "loads beyond the heap should trap with B014.", true);
+        return false;
+    }
+
+    if (*reinterpret_cast<uint64_t*>(masked_terp.heap() + 0x1000) != 42) {
+        r.add_message("T008", "out of range stores should wrap into the heap reservation.", true);
+        return false;
+    }
+
+    // a store through an alias of verified code has to void the proof just
+    // like a store to the code's own address
+    masked_terp.reset();
+    basecode::instruction_emitter alias_emitter(0);
+    alias_emitter.move_int_constant_to_register(basecode::op_sizes::qword, 0x400000, 1);
+    alias_emitter.move_int_constant_to_register(basecode::op_sizes::qword, 0x1234, 0);
+    alias_emitter.store_with_offset_from_register(0, 1, 0);
+    alias_emitter.exit();
+    alias_emitter.encode(r, masked_terp);
+
+    basecode::verifier verifier(masked_terp);
+    if (!verifier.verify(r, 0, alias_emitter.end_address()) || !masked_terp.is_verified(0))
+        return false;
+
+    if (!run_terp(r, masked_terp))
+        return false;
+
+    if (masked_terp.is_verified(0)) {
+        r.add_message("T008", "stores through an address alias should invalidate verified code.", true);
+        return false;
+    }
+
+    return true;
+}
+
+static bool test_stack_guard(basecode::result& r, basecode::terp&) {
+    basecode::heap_options_t options;
+    options.stack_size = 64 * 1024;
+
+    basecode::terp guarded_terp(1024 * 1024, options);
+    if (!guarded_terp.initialize(r))
+        return false;
+
+    basecode::instruction_emitter bootstrap_emitter(0);
+    bootstrap_emitter.jump_direct(0);
+
+    basecode::instruction_emitter fn_double_emitter(bootstrap_emitter.end_address());
+    fn_double_emitter.load_stack_offset_to_register(0, 8);
+    fn_double_emitter.add_int_register_to_register(basecode::op_sizes::qword, 0, 0, 0);
+    fn_double_emitter.store_register_to_stack_offset(0, 8);
+    fn_double_emitter.rts();
+
+    basecode::instruction_emitter main_emitter(fn_double_emitter.end_address());
+    main_emitter.push_int_constant(basecode::op_sizes::qword, 21);
+    main_emitter.jump_subroutine_direct(fn_double_emitter.start_address());
+    main_emitter.pop_int_register(basecode::op_sizes::qword, 1);
+    main_emitter.exit();
+
+    bootstrap_emitter[0].patch_branch_address(main_emitter.start_address());
+    bootstrap_emitter.encode(r, guarded_terp);
+    fn_double_emitter.encode(r, guarded_terp);
+    main_emitter.encode(r, guarded_terp);
+
+    basecode::verifier verifier(guarded_terp);
+    uint64_t max_depth = 0;
+    if (!verifier.verify(r, 0, main_emitter.end_address())
+    ||  !verifier.max_stack_depth(0, max_depth)
+    ||  max_depth != 16) {
+        r.add_message("T009", "program entry should need exactly 16 bytes of stack.", true);
+        return false;
+    }
+
+    if (!run_terp(r, guarded_terp))
+        return false;
+
+    if (guarded_terp.stack_high_water() != max_depth) {
+        r.add_message("T009", "stack high water should match the static maximum depth.", true);
+        return false;
+    }
+
+    // zero-valued pushes still count
+    guarded_terp.reset();
+    basecode::instruction_emitter zeros_emitter(0);
+    for (size_t i = 0; i < 3; i++)
+        zeros_emitter.push_int_constant(basecode::op_sizes::qword, 0);
+    for (size_t i = 0; i < 3; i++)
+        zeros_emitter.pop_int_register(basecode::op_sizes::qword, 1);
+    zeros_emitter.exit();
+    zeros_emitter.encode(r, guarded_terp);
+
+    if (!run_terp(r, guarded_terp))
+        return false;
+
+    if (guarded_terp.stack_high_water() != 24) {
+        r.add_message("T009", "stack high water should count pushes of zero.", true);
+        return false;
+    }
+
+    guarded_terp.reset();
+    basecode::instruction_emitter fn_runaway_emitter(0);
+    fn_runaway_emitter.jump_subroutine_direct(fn_runaway_emitter.start_address());
+    fn_runaway_emitter.encode(r, guarded_terp);
+
+    basecode::result overflow_result;
+    if (guarded_terp.run(overflow_result) != basecode::run_status::failed
+    ||  !overflow_result.has_code("B015")) {
+        r.add_message("T009", "runaway recursion should trap with B015.", true);
+        return false;
+    }
+
+    return true;
+}
+
+static bool test_heap_allocator(basecode::result& r, basecode::terp&) {
+    basecode::heap_options_t options;
+    options.stack_size = 64 * 1024;
+    options.allocator_size = 64 * 1024;
+    basecode::terp alloc_terp(1024 * 1024, options);
+    if (!alloc_terp.initialize(r))
+        return false;
+
+    basecode::instruction_emitter main_emitter(0);
+    main_emitter.alloc_int_constant(1, 24);
+    main_emitter.alloc_int_constant(2, 24);
+    main_emitter.free_int_register(1);
+    main_emitter.alloc_int_constant(3, 20);
+    main_emitter.alloc_int_constant(4, 4096);
+    main_emitter.free_int_register(4);
+    main_emitter.alloc_int_constant(5, 3000);
+    main_emitter.exit();
+    main_emitter.encode(r, alloc_terp);
+
+    if (!run_terp(r, alloc_terp))
+        return false;
+
+    auto first = alloc_terp.register_file().i[1];
+    if (first == 0
+    ||  alloc_terp.register_file().i[2] == first
+    ||  alloc_terp.register_file().i[3] != first
+    ||  alloc_terp.register_file().i[5] != alloc_terp.register_file().i[4]) {
+        r.add_message("T010", "freed blocks should be reused by the next matching alloc.", true);
+        return false;
+    }
+
+    // sizes that can never fit come back empty instead of aligning to 0
+    alloc_terp.reset();
+    basecode::instruction_emitter oversized_emitter(0);
+    oversized_emitter.alloc_int_constant(1, UINT64_MAX - 3);
+    oversized_emitter.exit();
+    oversized_emitter.encode(r, alloc_terp);
+
+    if (!run_terp(r, alloc_terp) || alloc_terp.register_file().i[1] != 0) {
+        r.add_message("T010", "alloc of a size near UINT64_MAX should return 0.", true);
+        return false;
+    }
+
+    alloc_terp.reset();
+    basecode::instruction_emitter double_free_emitter(0);
+    double_free_emitter.alloc_int_constant(1, 64);
+    double_free_emitter.free_int_register(1);
+    double_free_emitter.free_int_register(1);
+    double_free_emitter.exit();
+    double_free_emitter.encode(r, alloc_terp);
+
+    basecode::result double_free_result;
+    if (alloc_terp.run(double_free_result) != basecode::run_status::failed
+    ||  !double_free_result.has_code("B016")) {
+        r.add_message("T010", "double free should fail with B016.", true);
+        return false;
+    }
+
+    // reset released everything, so the pool starts over at the same block
+    if (alloc_terp.register_file().i[1] != first) {
+        r.add_message("T010", "reset should release every allocation.", true);
+        return false;
+    }
+
+    // block headers are guest memory: a forged size class is refused
+    alloc_terp.reset();
+    basecode::instruction_emitter forged_tag_emitter(0);
+    forged_tag_emitter.alloc_int_constant(1, 64);
+    forged_tag_emitter.move_int_constant_to_register(basecode::op_sizes::qword, 0xa110ca7ed0000009, 2);
+    forged_tag_emitter.subtract_int_constant_from_register(basecode::op_sizes::qword, 3, 1, 8);
+    forged_tag_emitter.store_with_offset_from_register(2, 3, 0);
+    forged_tag_emitter.free_int_register(1);
+    forged_tag_emitter.exit();
+    forged_tag_emitter.encode(r, alloc_terp);
+
+    basecode::result forged_tag_result;
+    if (alloc_terp.run(forged_tag_result) != basecode::run_status::failed
+    ||  !forged_tag_result.has_code("B016")) {
+        r.add_message("T010", "free of a block with a forged size class should fail with B016.", true);
+        return false;
+    }
+
+    // so is the region header: links and a bump pointer aimed outside the
+    // pool are never followed, the allocations just come back empty
+    alloc_terp.reset();
+    auto region = reinterpret_cast<uint64_t*>(alloc_terp.heap() + first - 16 - 96);
+    region[1] = UINT64_MAX - 15;        // bump
+    region[2] = UINT64_MAX;             // end
+    region[3] = 0x10;                   // large_free
+    region[4 + 2] = 0x7ffffff0;         // 64-byte free list
+
+    basecode::instruction_emitter forged_region_emitter(0);
+    forged_region_emitter.alloc_int_constant(1, 64);
+    forged_region_emitter.alloc_int_constant(2, 4096);
+    forged_region_emitter.exit();
+    forged_region_emitter.encode(r, alloc_terp);
+
+    if (!run_terp(r, alloc_terp)
+    ||  alloc_terp.register_file().i[1] != 0
+    ||  alloc_terp.register_file().i[2] != 0) {
+        r.add_message("T010", "a forged region header should not hand out blocks.", true);
+        return false;
+    }
+
+    return true;
+}
+
+static bool test_wide_arithmetic(basecode::result& r, basecode::terp& terp) {
+    const uint64_t a_address = 0x10000;
+    const uint64_t b_address = 0x10010;
+    const uint64_t t_address = 0x10020;
+
+    // fib(100) = 354224848179261915075 needs two 64-bit limbs
+    auto limbs = reinterpret_cast<uint64_t*>(terp.heap() + a_address);
+    limbs[0] = 0; limbs[1] = 0;
+    limbs[2] = 1; limbs[3] = 0;
+
+    basecode::instruction_emitter main_emitter(0);
+    main_emitter.move_int_constant_to_register(basecode::op_sizes::qword, 100, 1);
+    main_emitter.move_int_constant_to_register(basecode::op_sizes::qword, a_address, 2);
+    main_emitter.move_int_constant_to_register(basecode::op_sizes::qword, b_address, 3);
+    main_emitter.move_int_constant_to_register(basecode::op_sizes::qword, t_address, 4);
+
+    auto loop_address = main_emitter.end_address();
+    main_emitter.add_big_integer(4, 2, 3, 2, 10);
+    main_emitter.copy_memory(basecode::op_sizes::qword, 3, 2, 2);
+    main_emitter.copy_memory(basecode::op_sizes::qword, 4, 3, 2);
+    main_emitter.dec(basecode::op_sizes::qword, 1);
+    main_emitter.compare_int_register_to_constant(basecode::op_sizes::qword, 1, 0);
+    main_emitter.branch_if_not_equal(loop_address);
+
+    // split into decimal halves: hi:lo / 10^19
+    main_emitter.load_with_offset_to_register(2, 5, 0);
+    main_emitter.load_with_offset_to_register(2, 6, 8);
+    main_emitter.move_int_constant_to_register(basecode::op_sizes::qword, 10000000000000000000ull, 7);
+    main_emitter.divide_wide(5, 6, 7);
+
+    main_emitter.move_int_constant_to_register(basecode::op_sizes::qword, UINT64_MAX, 8);
+    main_emitter.multiply_wide(20, 21, 8, 8);
+    main_emitter.exit();
+    main_emitter.encode(r, terp);
+
+    if (!run_terp(r, terp))
+        return false;
+
+    const auto& registers = terp.register_file();
+    if (registers.i[5] != 35 || registers.i[6] != 4224848179261915075ull) {
+        r.add_message("T011", "fib(100) should be 354224848179261915075.", true);
+        return false;
+    }
+
+    if (registers.i[20] != 0xfffffffffffffffe || registers.i[21] != 1) {
+        r.add_message("T011", "mulx should produce the full 128-bit product.", true);
+        return false;
+    }
+
+    return true;
+}
+
+static bool test_memoized_fibonacci(basecode::result& r, basecode::terp& terp) {
+    basecode::instruction_emitter bootstrap_emitter(0);
+    bootstrap_emitter.jump_direct(0);
+
+    // fib(n) = n < 2 ? n : fib(n - 1) + fib(n - 2); exponential without memoization
+    basecode::instruction_emitter fn_fibonacci(bootstrap_emitter.end_address());
+    fn_fibonacci.pure(true);
+    fn_fibonacci.load_stack_offset_to_register(0, 8);
+    fn_fibonacci.compare_int_register_to_constant(basecode::op_sizes::qword, 0, 0);
+    fn_fibonacci.branch_if_equal(0);
+    fn_fibonacci.compare_int_register_to_constant(basecode::op_sizes::qword, 0, 1);
+    fn_fibonacci.branch_if_equal(0);
+    fn_fibonacci.jump_direct(0);
+    auto label_exit_fib = fn_fibonacci.end_address();
+    fn_fibonacci[2].patch_branch_address(label_exit_fib);
+    fn_fibonacci[4].patch_branch_address(label_exit_fib);
+    fn_fibonacci.rts();
+
+    fn_fibonacci[5].patch_branch_address(fn_fibonacci.end_address());
+    fn_fibonacci.subtract_int_constant_from_register(basecode::op_sizes::qword, 1, 0, 1);
+    fn_fibonacci.push_int_register(basecode::op_sizes::qword, 1);
+    fn_fibonacci.jump_subroutine_direct(fn_fibonacci.start_address());
+    fn_fibonacci.pop_int_register(basecode::op_sizes::qword, 1);
+    fn_fibonacci.load_stack_offset_to_register(0, 8);
+    fn_fibonacci.push_int_register(basecode::op_sizes::qword, 1);
+    fn_fibonacci.subtract_int_constant_from_register(basecode::op_sizes::qword, 2, 0, 2);
+    fn_fibonacci.push_int_register(basecode::op_sizes::qword, 2);
+    fn_fibonacci.jump_subroutine_direct(fn_fibonacci.start_address());
+    fn_fibonacci.pop_int_register(basecode::op_sizes::qword, 2);
+    fn_fibonacci.pop_int_register(basecode::op_sizes::qword, 1);
+    fn_fibonacci.add_int_register_to_register(basecode::op_sizes::qword, 1, 1, 2);
+    fn_fibonacci.store_register_to_stack_offset(1, 8);
+    fn_fibonacci.rts();
+
+    basecode::instruction_emitter main_emitter(fn_fibonacci.end_address());
+    main_emitter.push_int_constant(basecode::op_sizes::qword, 90);
+    main_emitter.jump_subroutine_direct(fn_fibonacci.start_address());
+    main_emitter.pop_int_register(basecode::op_sizes::qword, 0);
+    main_emitter.exit();
+
+    bootstrap_emitter[0].patch_branch_address(main_emitter.start_address());
+    bootstrap_emitter.encode(r, terp);
+    fn_fibonacci.encode(r, terp);
+    main_emitter.encode(r, terp);
+
+    if (!run_terp(r, terp))
+        return false;
+
+    if (terp.register_file().i[0] != 2880067194370816120ull) {
+        r.add_message("T012", "memoized fib(90) should be 2880067194370816120.", true);
+        return false;
+    }
+
+    // every n in 0..90 is computed exactly once
+    if (terp.memo().misses() != 91 || terp.memo().hits() == 0) {
+        r.add_message("T012", "each fib(n) should miss the memo table only once.", true);
+        return false;
+    }
+
+    return true;
+}
+
+static bool test_partial_evaluation(basecode::result& r, basecode::terp& terp) {
+    basecode::instruction_emitter bootstrap_emitter(0);
+    bootstrap_emitter.jump_direct(0);
+
+    basecode::instruction_emitter fn_square_emitter(bootstrap_emitter.end_address());
+    fn_square_emitter.pure(true);
+    fn_square_emitter.load_stack_offset_to_register(0, 8);
+    fn_square_emitter.multiply_int_register_to_register(basecode::op_sizes::dword, 0, 0, 0);
+    fn_square_emitter.store_register_to_stack_offset(0, 8);
+    fn_square_emitter.rts();
+
+    basecode::instruction_emitter fn_spin_emitter(fn_square_emitter.end_address());
+    fn_spin_emitter.pure(true);
+    fn_spin_emitter.jump_direct(fn_spin_emitter.start_address());
+
+    basecode::instruction_emitter main_emitter(fn_spin_emitter.end_address());
+    main_emitter.push_int_constant(basecode::op_sizes::dword, 9);
+    main_emitter.jump_subroutine_direct(fn_square_emitter.start_address());
+    main_emitter.pop_int_register(basecode::op_sizes::dword, 5);
+    main_emitter.push_int_constant(basecode::op_sizes::dword, 5);
+    main_emitter.jump_subroutine_direct(fn_square_emitter.start_address());
+    main_emitter.pop_int_register(basecode::op_sizes::dword, 6);
+    main_emitter.exit();
+
+    basecode::partial_evaluator evaluator(1024 * 1024, 1000);
+    evaluator.add_function(r, fn_square_emitter);
+    evaluator.add_function(r, fn_spin_emitter);
+
+    auto main_size = main_emitter.size();
+    if (main_emitter.fold_constant_calls(evaluator) != 2 || main_emitter.size() != main_size) {
+        r.add_message("T013", "both constant square calls should fold in place.", true);
+        return false;
+    }
+
+    uint64_t value;
+    if (evaluator.evaluate(fn_spin_emitter.start_address(), 1, value)) {
+        r.add_message("T013", "a call that exhausts the budget must not fold.", true);
+        return false;
+    }
+
+    bootstrap_emitter[0].patch_branch_address(main_emitter.start_address());
+    bootstrap_emitter.encode(r, terp);
+    fn_square_emitter.encode(r, terp);
+    fn_spin_emitter.encode(r, terp);
+    main_emitter.encode(r, terp);
+
+    if (!run_terp(r, terp))
+        return false;
+
+    if (terp.register_file().i[5] != 81 || terp.register_file().i[6] != 25) {
+        r.add_message("T013", "folded calls should leave 81 and 25 in I5 and I6.", true);
+        return false;
+    }
+
+    if (terp.memo().misses() != 0) {
+        r.add_message("T013", "folded program should not call square at runtime.", true);
+        return false;
+    }
+
+    return true;
+}
+
+static void build_sum_scaled_module(basecode::ir_module& module) {
+    using basecode::ir_opcodes;
+
+    // sum_scaled(n) = sum over i < n of (n * (4 * 5) + n * (4 * 5))
+    auto fn_sum_scaled = module.add_function("sum_scaled", 1);
+    auto loop_block = fn_sum_scaled->add_block();
+    auto done_block = fn_sum_scaled->add_block();
+    auto zero_block = fn_sum_scaled->add_block();
+
+    basecode::ir_builder builder(*fn_sum_scaled);
+    auto n = fn_sum_scaled->parameter();
+    auto scale = builder.binary(ir_opcodes::mul, builder.constant(4), builder.constant(5));
+    auto zero = builder.constant(0);
+    auto one = builder.constant(1);
+    builder.binary(ir_opcodes::add, n, one);
+    builder.cond_branch(builder.binary(ir_opcodes::cmp_eq, n, zero), zero_block, loop_block);
+
+    builder.position_at_end(loop_block);
+    auto i = builder.phi();
+    auto total = builder.phi();
+    auto lhs = builder.binary(ir_opcodes::mul, n, scale);
+    auto rhs = builder.binary(ir_opcodes::mul, n, scale);
+    auto next_total = builder.binary(
+            ir_opcodes::add,
+            builder.binary(ir_opcodes::add, total, builder.binary(ir_opcodes::add, lhs, rhs)),
+            builder.constant(0));
+    auto next_i = builder.binary(ir_opcodes::add, i, one);
+    builder.cond_branch(builder.binary(ir_opcodes::cmp_ne, next_i, n), loop_block, done_block);
+    builder.add_incoming(i, zero, fn_sum_scaled->entry());
+    builder.add_incoming(i, next_i, loop_block);
+    builder.add_incoming(total, zero, fn_sum_scaled->entry());
+    builder.add_incoming(total, next_total, loop_block);
+
+    builder.position_at_end(done_block);
+    builder.ret(next_total);
+
+    builder.position_at_end(zero_block);
+    builder.ret(zero);
+
+    // main() = sum_scaled(10) + sum_scaled(3); the first result lives across
+    // the second call
+    auto fn_main = module.add_function("main", 0);
+    basecode::ir_builder main_builder(*fn_main);
+    auto first = main_builder.call(fn_sum_scaled, main_builder.constant(10));
+    auto second = main_builder.call(fn_sum_scaled, main_builder.constant(3));
+    main_builder.ret(main_builder.binary(ir_opcodes::add, first, second));
+}
+
+static bool run_ir_module(
+        basecode::result& r,
+        basecode::terp& terp,
+        const basecode::ir_module& module,
+        uint64_t& value) {
+    terp.reset();
+
+    basecode::instruction_emitter bootstrap_emitter(0);
+    bootstrap_emitter.jump_direct(0);
+
+    std::vector<basecode::instruction_emitter> emitters;
+    if (!module.lower(r, bootstrap_emitter.end_address(), emitters))
+        return false;
+
+    basecode::instruction_emitter main_emitter(emitters.back().end_address());
+    main_emitter.push_int_constant(basecode::op_sizes::qword, 0);
+    main_emitter.jump_subroutine_direct(module.address_of(module.functions().back().get()));
+    main_emitter.pop_int_register(basecode::op_sizes::qword, 0);
+    main_emitter.exit();
+
+    bootstrap_emitter[0].patch_branch_address(main_emitter.start_address());
+    bootstrap_emitter.encode(r, terp);
+    for (auto& emitter : emitters)
+        emitter.encode(r, terp);
+    main_emitter.encode(r, terp);
+
+    if (!run_terp(r, terp))
+        return false;
+    value = terp.register_file().i[0];
+    return true;
+}
+
+static bool test_ir_pipeline(basecode::result& r, basecode::terp& terp) {
+    basecode::ir_module plain_module;
+    build_sum_scaled_module(plain_module);
+    uint64_t plain_value = 0;
+    if (!run_ir_module(r, terp, plain_module, plain_value))
+        return false;
+
+    basecode::ir_module optimized_module;
+    build_sum_scaled_module(optimized_module);
+    auto fn_sum_scaled = optimized_module.functions().front().get();
+    auto before = fn_sum_scaled->instruction_count();
+    auto pipeline = basecode::ir_pass_manager::standard_pipeline();
+    pipeline.run(optimized_module);
+
+    uint64_t optimized_value = 0;
+    if (!run_ir_module(r, terp, optimized_module, optimized_value))
+        return false;
+
+    if (plain_value != 4360 || optimized_value != plain_value) {
+        r.add_message("T014", "sum_scaled(10) + sum_scaled(3) should be 4360 before and after optimization.", true);
+        return false;
+    }
+
+    // 4 * 5 folded, n + 1 dropped, n * 20 computed once and hoisted, x + 0 gone
+    size_t multiplies = 0;
+    for (const auto& block : fn_sum_scaled->blocks()) {
+        auto is_loop = !block->instructions.empty()
+            && block->instructions.front()->op == basecode::ir_opcodes::phi;
+        for (const auto& inst : block->instructions) {
+            if (inst->op != basecode::ir_opcodes::mul)
+                continue;
+            multiplies++;
+            if (is_loop) {
+                r.add_message("T014", "n * 20 should be hoisted out of the loop.", true);
+                return false;
+            }
+        }
+    }
+
+    if (multiplies != 1 || fn_sum_scaled->instruction_count() >= before) {
+        r.add_message("T014", "the pass pipeline should fold, share and drop instructions.", true);
+        return false;
+    }
+
+    return true;
+}
+
+static bool test_inlining(basecode::result& r, basecode::terp& terp) {
+    using basecode::ir_opcodes;
+
+    // square(9) + square(5) collapses to a constant once square is inlined
+    basecode::ir_module square_module;
+    auto fn_square = square_module.add_function("square", 1);
+    basecode::ir_builder square_builder(*fn_square);
+    square_builder.ret(square_builder.binary(
+            ir_opcodes::mul,
+            fn_square->parameter(),
+            fn_square->parameter()));
+
+    auto fn_main = square_module.add_function("main", 0);
+    basecode::ir_builder main_builder(*fn_main);
+    main_builder.ret(main_builder.binary(
+            ir_opcodes::add,
+            main_builder.call(fn_square, main_builder.constant(9)),
+            main_builder.call(fn_square, main_builder.constant(5))));
+
+    auto pipeline = basecode::ir_pass_manager::standard_pipeline();
+    pipeline.run(square_module);
+
+    uint64_t value = 0;
+    if (!run_ir_module(r, terp, square_module, value))
+        return false;
+
+    if (value != 106 || fn_main->instruction_count() != 2) {
+        r.add_message("T015", "main should fold to ret 106 once square is inlined.", true);
+        return false;
+    }
+
+    // sum_scaled is too big to inline until the profile says it is hot
+    basecode::ir_module sum_module;
+    build_sum_scaled_module(sum_module);
+    if (!run_ir_module(r, terp, sum_module, value))
+        return false;
+
+    auto inliner = std::make_unique<basecode::inlining_pass>(
+            basecode::inlining_pass::default_size_limit,
+            basecode::inlining_pass::default_hot_size_limit,
+            2);
+    auto fn_sum_main = sum_module.functions().back().get();
+    if (inliner->run(*fn_sum_main) != 0) {
+        r.add_message("T015", "cold sum_scaled should not be inlined.", true);
+        return false;
+    }
+
+    inliner->load_profile(sum_module, terp);
+    basecode::ir_pass_manager profiled_pipeline;
+    profiled_pipeline.add(std::move(inliner));
+    profiled_pipeline.add(std::make_unique<basecode::constant_propagation_pass>());
+    profiled_pipeline.add(std::make_unique<basecode::dead_code_elimination_pass>());
+    profiled_pipeline.run(*fn_sum_main);
+
+    for (const auto& block : fn_sum_main->blocks()) {
+        for (const auto& inst : block->instructions) {
+            if (inst->op == ir_opcodes::call) {
+                r.add_message("T015", "hot sum_scaled should be inlined into main.", true);
+                return false;
+            }
+        }
+    }
+
+    if (!run_ir_module(r, terp, sum_module, value))
+        return false;
+
+    if (value != 4360) {
+        r.add_message("T015", "inlined sum_scaled calls should still total 4360.", true);
+        return false;
+    }
+
+    return true;
+}
+
+static bool test_on_stack_replacement(basecode::result& r, basecode::terp& terp) {
+    // sum 0..99999 in a loop the program enters exactly once
+    basecode::instruction_emitter sum_emitter(0);
+    sum_emitter.move_int_constant_to_register(basecode::op_sizes::qword, 0, 1);
+    sum_emitter.move_int_constant_to_register(basecode::op_sizes::qword, 0, 2);
+    auto sum_loop = sum_emitter.end_address();
+    sum_emitter.integer_arithmetic(basecode::op_codes::add, basecode::op_sizes::qword, 1, 1, 2);
+    sum_emitter.inc(basecode::op_sizes::qword, 2);
+    sum_emitter.compare_int_register_to_constant(basecode::op_sizes::qword, 2, 100000);
+    auto sum_back_edge = sum_emitter.end_address();
+    sum_emitter.branch_if_not_equal(sum_loop);
+    sum_emitter.exit();
+    sum_emitter.encode(r, terp);
+
+    if (r.is_failed() || !run_terp(r, terp))
+        return false;
+
+    if (terp.register_file().i[1] != 4999950000) {
+        r.add_message("T017", "I1 should contain 4999950000.", true);
+        return false;
+    }
+
+    auto loop = terp.osr_loop(sum_back_edge);
+    if (loop == nullptr
+    ||  !loop->is_compiled()
+    ||  loop->entries != 1
+    ||  loop->back_edges != basecode::terp::default_osr_threshold) {
+        r.add_message("T017", "the loop should move to the loop tier once, when it gets hot.", true);
+        return false;
+    }
+
+    // a loop that rewrites its own first instruction (with the same bytes)
+    // deoptimizes on every pass through the loop tier
+    terp.reset();
+    terp.osr_threshold(16);
+
+    basecode::instruction_emitter patch_emitter(0);
+    patch_emitter.move_int_constant_to_register(basecode::op_sizes::qword, 0, 2);
+    patch_emitter.move_int_constant_to_register(basecode::op_sizes::qword, 0, 3);
+    auto patch_loop = patch_emitter.end_address();
+    patch_emitter[1].operands[0].value.u64 = patch_loop;
+    patch_emitter.load_with_offset_to_register(3, 4, 0);
+    patch_emitter.store_with_offset_from_register(4, 3, 0);
+    patch_emitter.inc(basecode::op_sizes::qword, 2);
+    patch_emitter.compare_int_register_to_constant(basecode::op_sizes::qword, 2, 1000);
+    auto patch_back_edge = patch_emitter.end_address();
+    patch_emitter.branch_if_not_equal(patch_loop);
+    patch_emitter.exit();
+    patch_emitter.encode(r, terp);
+
+    auto completed = !r.is_failed() && run_terp(r, terp);
+    terp.osr_threshold(basecode::terp::default_osr_threshold);
+    if (!completed)
+        return false;
+
+    loop = terp.osr_loop(patch_back_edge);
+    if (terp.register_file().i[2] != 1000
+    ||  loop == nullptr
+    ||  loop->deopts == 0
+    ||  loop->deopts != loop->entries) {
+        r.add_message("T017", "stores into a compiled loop should deoptimize it.", true);
+        return false;
+    }
+
+    return true;
+}
+
+// builds the translated program with the host C compiler, runs it on a fresh
+// heap and reads back I0-I63 followed by SP
+static bool run_translated_program(
+        basecode::result& r,
+        const basecode::c_backend& backend,
+        size_t heap_size,
+        std::vector<uint64_t>& state) {
+    auto base_path = std::filesystem::temp_directory_path()
+        / fmt::format("basecode_aot_{}", getpid());
+    auto source_path = base_path.string() + ".c";
+    auto binary_path = base_path.string();
+
+    {
+        std::ofstream source(source_path);
+        source << backend.source();
+        source << "\n#include <stdio.h>\n#include <stdlib.h>\n\n";
+        source << "int main(void) {\n";
+        source << "    static bc_state_t s;\n";
+        source << fmt::format("    s.heap = calloc(1, {});\n", heap_size);
+        source << "    s.mask = ~UINT64_C(0);\n";
+        source << fmt::format("    s.sp = {};\n", heap_size);
+        source << fmt::format("    {}(&s);\n", backend.run_symbol());
+        source << "    if (s.status != BC_EXITED) return 1;\n";
+        source << "    for (int i = 0; i < 64; i++) printf(\"%llu\\n\", (unsigned long long)s.i[i]);\n";
+        source << "    printf(\"%llu\\n\", (unsigned long long)s.sp);\n";
+        source << "    return 0;\n}\n";
+    }
+
+    auto command = fmt::format("cc -O2 -o {} {}", binary_path, source_path);
+    if (std::system(command.c_str()) != 0) {
+        r.add_message("T016", "translated C source does not compile.", true);
+        return false;
+    }
+
+    auto output = popen(binary_path.c_str(), "r");
+    if (output == nullptr) {
+        r.add_message("T016", "unable to run the translated program.", true);
+        return false;
+    }
+    unsigned long long value;
+    while (fscanf(output, "%llu", &value) == 1)
+        state.push_back(value);
+    auto status = pclose(output);
+
+    std::filesystem::remove(source_path);
+    std::filesystem::remove(binary_path);
+
+    if (status != 0 || state.size() != 65) {
+        r.add_message("T016", "translated program did not exit cleanly.", true);
+        return false;
+    }
+    return true;
+}
+
+static bool test_aot_c_backend(basecode::result& r, basecode::terp& terp) {
+    using program_test = bool (*)(basecode::result&, basecode::terp&);
+    const std::pair<const char*, program_test> programs[] = {
+        {"square", test_square},
+        {"fibonacci", test_fibonacci},
+    };
+
+    auto has_compiler = std::system("cc --version > /dev/null 2>&1") == 0;
+    if (!has_compiler)
+        fmt::print("no host C compiler: translated programs are not run.\n");
+
+    for (const auto& program : programs) {
+        // the interpreter run leaves the program in the heap and the
+        // registers to compare against
+        terp.reset();
+        if (!program.second(r, terp))
+            return false;
+
+        basecode::c_backend backend;
+        if (!backend.translate(r, terp, 0, terp.heap_size(), 0))
+            return false;
+
+        if (backend.function_count() != 2) {
+            r.add_message(
+                    "T016",
+                    fmt::format("{} should translate to a main and one subroutine.", program.first),
+                    true);
+            return false;
+        }
+
+        if (!has_compiler)
+            continue;
+
+        std::vector<uint64_t> state;
+        if (!run_translated_program(r, backend, terp.heap_size(), state))
+            return false;
+
+        const auto& registers = terp.register_file();
+        for (size_t i = 0; i < 64; i++) {
+            if (state[i] != registers.i[i]) {
+                r.add_message(
+                        "T016",
+                        fmt::format("translated {} disagrees with the interpreter on I{}.", program.first, i),
+                        true);
+                return false;
+            }
+        }
+        if (state[64] != registers.sp) {
+            r.add_message(
+                    "T016",
+                    fmt::format("translated {} disagrees with the interpreter on SP.", program.first),
+                    true);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool test_conditional_branches(basecode::result& r, basecode::terp& terp) {
+    const basecode::op_codes branches[] = {
+        basecode::op_codes::bg,
+        basecode::op_codes::bge,
+        basecode::op_codes::bl,
+        basecode::op_codes::ble,
+        basecode::op_codes::ba,
+        basecode::op_codes::bae,
+        basecode::op_codes::bb,
+        basecode::op_codes::bbe,
+    };
+    const std::pair<uint64_t, uint64_t> operands[] = {
+        {5, 3},
+        {3, 5},
+        {7, 7},
+        {UINT64_MAX, 1},
+        {1, UINT64_MAX},
+        {static_cast<uint64_t>(INT64_MIN), 1},
+        {static_cast<uint64_t>(INT64_MAX), UINT64_MAX},
+    };
+
+    // for each pair, I10 onwards collects one bit per branch that was taken
+    basecode::instruction_emitter emitter(0);
+    for (size_t pair = 0; pair < 7; pair++) {
+        auto mask_index = static_cast<uint8_t>(10 + pair);
+        emitter.move_int_constant_to_register(basecode::op_sizes::qword, operands[pair].first, 1);
+        emitter.move_int_constant_to_register(basecode::op_sizes::qword, operands[pair].second, 2);
+        for (size_t bit = 0; bit < 8; bit++) {
+            emitter.compare_int_register_to_register(basecode::op_sizes::qword, 1, 2);
+            auto branch_index = emitter.instruction_count();
+            emitter.branch_if_compare(branches[bit], 0);
+            auto skip_index = emitter.instruction_count();
+            emitter.jump_direct(0);
+            emitter[branch_index].patch_branch_address(emitter.end_address());
+            emitter.integer_arithmetic_constant(
+                    basecode::op_codes::or_op,
+                    basecode::op_sizes::qword,
+                    mask_index,
+                    mask_index,
+                    1u << bit);
+            emitter[skip_index].patch_branch_address(emitter.end_address());
+        }
+    }
+    emitter.exit();
+    emitter.encode(r, terp);
+
+    if (r.is_failed() || !run_terp(r, terp))
+        return false;
+
+    for (size_t pair = 0; pair < 7; pair++) {
+        auto lhs = operands[pair].first;
+        auto rhs = operands[pair].second;
+        auto signed_lhs = static_cast<int64_t>(lhs);
+        auto signed_rhs = static_cast<int64_t>(rhs);
+        const bool taken[] = {
+            signed_lhs > signed_rhs,
+            signed_lhs >= signed_rhs,
+            signed_lhs < signed_rhs,
+            signed_lhs <= signed_rhs,
+            lhs > rhs,
+            lhs >= rhs,
+            lhs < rhs,
+            lhs <= rhs,
+        };
+        uint64_t expected = 0;
+        for (size_t bit = 0; bit < 8; bit++)
+            expected |= taken[bit] ? 1u << bit : 0;
+        if (terp.register_file().i[10 + pair] != expected) {
+            r.add_message(
+                    "T018",
+                    fmt::format("branches after cmp ${:X}, ${:X} should take mask {:08b}.", lhs, rhs, expected),
+                    true);
+            return false;
+        }
+    }
+
+    // the translated program has to agree bit for bit
+    if (std::system("cc --version > /dev/null 2>&1") != 0)
+        return true;
+
+    basecode::c_backend backend;
+    if (!backend.translate(r, terp, 0, emitter.end_address(), 0))
+        return false;
+
+    std::vector<uint64_t> state;
+    if (!run_translated_program(r, backend, terp.heap_size(), state))
+        return false;
+    for (size_t pair = 0; pair < 7; pair++) {
+        if (state[10 + pair] != terp.register_file().i[10 + pair]) {
+            r.add_message("T018", "translated branches disagree with the interpreter.", true);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool test_lazy_flags(basecode::result& r, basecode::terp& terp) {
+    // add rewrites carry while cmp 1, 2 is still pending: bb must see the
+    // add's carry, bl the compare's negative flag
+    const basecode::op_codes branches[] = {
+        basecode::op_codes::bb,
+        basecode::op_codes::bl,
+    };
+
+    basecode::instruction_emitter emitter(0);
+    emitter.move_int_constant_to_register(basecode::op_sizes::qword, 1, 1);
+    emitter.move_int_constant_to_register(basecode::op_sizes::qword, 2, 2);
+    for (size_t bit = 0; bit < 2; bit++) {
+        emitter.compare_int_register_to_register(basecode::op_sizes::qword, 1, 2);
+        emitter.integer_arithmetic(basecode::op_codes::add, basecode::op_sizes::qword, 3, 1, 2);
+        auto branch_index = emitter.instruction_count();
+        emitter.branch_if_compare(branches[bit], 0);
+        auto skip_index = emitter.instruction_count();
+        emitter.jump_direct(0);
+        emitter[branch_index].patch_branch_address(emitter.end_address());
+        emitter.integer_arithmetic_constant(
+                basecode::op_codes::or_op,
+                basecode::op_sizes::qword,
+                10,
+                10,
+                1u << bit);
+        emitter[skip_index].patch_branch_address(emitter.end_address());
+    }
+    emitter.exit();
+    emitter.encode(r, terp);
+
+    if (r.is_failed() || !run_terp(r, terp))
+        return false;
+
+    if (terp.register_file().i[10] != 2) {
+        r.add_message("T018", "a carry written after cmp should override only the carry flag.", true);
+        return false;
+    }
+
+    return true;
+}
+
+static bool test_guest_threads(basecode::result& r, basecode::terp&) {
+    const uint64_t counter_address = 0x10000;
+    const uint64_t flag_address = 0x10008;
+
+    basecode::heap_options_t options;
+    options.stack_size = 64 * 1024;
+    options.allocator_size = 512 * 1024;
+    basecode::terp thread_terp(2 * 1024 * 1024, options);
+    if (!thread_terp.initialize(r))
+        return false;
+
+    basecode::instruction_emitter bootstrap_emitter(0);
+    bootstrap_emitter.jump_direct(0);
+
+    // adds 1 to the counter at I0 10000 times, returns how often it did
+    basecode::instruction_emitter worker_emitter(bootstrap_emitter.end_address());
+    worker_emitter.move_int_constant_to_register(basecode::op_sizes::qword, 10000, 1);
+    worker_emitter.move_int_constant_to_register(basecode::op_sizes::qword, 1, 2);
+    worker_emitter.move_int_constant_to_register(basecode::op_sizes::qword, 0, 4);
+    auto worker_loop_address = worker_emitter.end_address();
+    worker_emitter.fetch_add(3, 0, 2);
+    worker_emitter.inc(basecode::op_sizes::qword, 4);
+    worker_emitter.dec(basecode::op_sizes::qword, 1);
+    worker_emitter.compare_int_register_to_constant(basecode::op_sizes::qword, 1, 0);
+    worker_emitter.branch_if_not_equal(worker_loop_address);
+    worker_emitter.move_int_register_to_register(basecode::op_sizes::qword, 4, 0);
+    worker_emitter.exit();
+
+    // sleeps until the flag at I0 is set, returns it
+    basecode::instruction_emitter waiter_emitter(worker_emitter.end_address());
+    auto waiter_loop_address = waiter_emitter.end_address();
+    waiter_emitter.atomic_load(1, 0);
+    waiter_emitter.compare_int_register_to_constant(basecode::op_sizes::qword, 1, 0);
+    auto done_index = waiter_emitter.instruction_count();
+    waiter_emitter.branch_if_not_equal(0);
+    waiter_emitter.move_int_constant_to_register(basecode::op_sizes::qword, 0, 2);
+    waiter_emitter.wait_on_address(0, 2);
+    waiter_emitter.jump_direct(waiter_loop_address);
+    waiter_emitter[done_index].patch_branch_address(waiter_emitter.end_address());
+    waiter_emitter.move_int_register_to_register(basecode::op_sizes::qword, 1, 0);
+    waiter_emitter.exit();
+
+    basecode::instruction_emitter main_emitter(waiter_emitter.end_address());
+    main_emitter.move_int_constant_to_register(basecode::op_sizes::qword, counter_address, 10);
+    main_emitter.move_int_constant_to_register(basecode::op_sizes::qword, flag_address, 11);
+    for (uint8_t i = 1; i <= 4; i++)
+        main_emitter.spawn_thread(i, worker_emitter.start_address(), 10);
+    main_emitter.spawn_thread(5, waiter_emitter.start_address(), 11);
+    for (uint8_t i = 1; i <= 4; i++)
+        main_emitter.join_thread(i, i);
+    main_emitter.move_int_constant_to_register(basecode::op_sizes::qword, 7, 12);
+    main_emitter.atomic_store(11, 12);
+    main_emitter.notify_address(11);
+    main_emitter.join_thread(5, 5);
+    main_emitter.atomic_load(6, 10);
+
+    // the first cas sees 40000 and swaps, the second one no longer does
+    main_emitter.move_int_constant_to_register(basecode::op_sizes::qword, 40000, 20);
+    main_emitter.move_int_constant_to_register(basecode::op_sizes::qword, 1, 21);
+    main_emitter.compare_and_swap(7, 10, 20, 21);
+    auto swapped_index = main_emitter.instruction_count();
+    main_emitter.branch_if_not_equal(0);
+    main_emitter.inc(basecode::op_sizes::qword, 9);
+    main_emitter[swapped_index].patch_branch_address(main_emitter.end_address());
+    main_emitter.compare_and_swap(8, 10, 20, 21);
+    main_emitter.exit();
+
+    bootstrap_emitter[0].patch_branch_address(main_emitter.start_address());
+    bootstrap_emitter.encode(r, thread_terp);
+    worker_emitter.encode(r, thread_terp);
+    waiter_emitter.encode(r, thread_terp);
+    main_emitter.encode(r, thread_terp);
+
+    if (r.is_failed() || !run_terp(r, thread_terp))
+        return false;
+
+    const auto& registers = thread_terp.register_file();
+    for (size_t i = 1; i <= 4; i++) {
+        if (registers.i[i] != 10000) {
+            r.add_message("T019", fmt::format("thread {} should return 10000.", i), true);
+            return false;
+        }
+    }
+
+    if (registers.i[6] != 40000) {
+        r.add_message(
+                "T019",
+                fmt::format("counter should be 40000, not {}.", registers.i[6]),
+                true);
+        return false;
+    }
+
+    if (registers.i[5] != 7) {
+        r.add_message("T019", "waiter should wake up with the flag set.", true);
+        return false;
+    }
+
+    if (registers.i[7] != 40000
+    ||  registers.i[9] != 1
+    ||  registers.i[8] != 1
+    ||  *reinterpret_cast<uint64_t*>(thread_terp.heap() + counter_address) != 1) {
+        r.add_message("T019", "cas should swap exactly once.", true);
+        return false;
+    }
+
+    // a thread overwrites fn_one with fn_two after the main thread cached
+    // fn_one at its call site: the next call must run the new code
+    thread_terp.reset();
+    basecode::instruction_emitter patch_bootstrap_emitter(0);
+    patch_bootstrap_emitter.jump_direct(0);
+
+    basecode::instruction_emitter fn_one_emitter(patch_bootstrap_emitter.end_address());
+    fn_one_emitter.move_int_constant_to_register(basecode::op_sizes::qword, 1, 0);
+    fn_one_emitter.rts();
+
+    basecode::instruction_emitter fn_two_emitter(fn_one_emitter.end_address());
+    fn_two_emitter.move_int_constant_to_register(basecode::op_sizes::qword, 2, 0);
+    fn_two_emitter.rts();
+
+    basecode::instruction_emitter fn_call_emitter(fn_two_emitter.end_address());
+    fn_call_emitter.jump_subroutine_direct(fn_one_emitter.start_address());
+    fn_call_emitter.rts();
+
+    auto fn_size = fn_two_emitter.end_address() - fn_two_emitter.start_address();
+    basecode::instruction_emitter patcher_emitter(fn_call_emitter.end_address());
+    patcher_emitter.move_int_constant_to_register(basecode::op_sizes::qword, fn_two_emitter.start_address(), 1);
+    patcher_emitter.move_int_constant_to_register(basecode::op_sizes::qword, fn_one_emitter.start_address(), 2);
+    patcher_emitter.copy_memory(basecode::op_sizes::byte, 1, 2, fn_size);
+    patcher_emitter.exit();
+
+    basecode::instruction_emitter patch_main_emitter(patcher_emitter.end_address());
+    patch_main_emitter.jump_subroutine_direct(fn_call_emitter.start_address());
+    patch_main_emitter.spawn_thread(1, patcher_emitter.start_address(), 0);
+    patch_main_emitter.join_thread(2, 1);
+    patch_main_emitter.jump_subroutine_direct(fn_call_emitter.start_address());
+    patch_main_emitter.exit();
+
+    patch_bootstrap_emitter[0].patch_branch_address(patch_main_emitter.start_address());
+    patch_bootstrap_emitter.encode(r, thread_terp);
+    fn_one_emitter.encode(r, thread_terp);
+    fn_two_emitter.encode(r, thread_terp);
+    fn_call_emitter.encode(r, thread_terp);
+    patcher_emitter.encode(r, thread_terp);
+    patch_main_emitter.encode(r, thread_terp);
+
+    if (r.is_failed() || !run_terp(r, thread_terp))
+        return false;
+
+    if (thread_terp.register_file().i[0] != 2) {
+        r.add_message("T019", "a code store in one thread should invalidate the others' caches.", true);
+        return false;
+    }
+
+    // a thread that never exits must not keep reset() from returning
+    thread_terp.reset();
+    basecode::instruction_emitter spin_bootstrap_emitter(0);
+    spin_bootstrap_emitter.jump_direct(0);
+
+    basecode::instruction_emitter spinner_emitter(spin_bootstrap_emitter.end_address());
+    spinner_emitter.jump_direct(spinner_emitter.start_address());
+
+    basecode::instruction_emitter spin_main_emitter(spinner_emitter.end_address());
+    spin_main_emitter.spawn_thread(1, spinner_emitter.start_address(), 0);
+    spin_main_emitter.exit();
+
+    spin_bootstrap_emitter[0].patch_branch_address(spin_main_emitter.start_address());
+    spin_bootstrap_emitter.encode(r, thread_terp);
+    spinner_emitter.encode(r, thread_terp);
+    spin_main_emitter.encode(r, thread_terp);
+
+    if (r.is_failed() || !run_terp(r, thread_terp))
+        return false;
+    thread_terp.reset();
+
+    return true;
+}
+
+static bool test_channels(basecode::result& r, basecode::terp&) {
+    const uint64_t buffer_address = 0x10000;
+    const uint64_t message_count = 1000;
+
+    basecode::channel ring(basecode::channel_kind::spsc, 3, sizeof(uint64_t));
+    if (!ring.initialize(r))
+        return false;
+
+    // capacity rounds up to 4: the fifth send finds the ring full
+    for (uint64_t i = 1; i <= 5; i++) {
+        if (ring.try_send(&i, sizeof(i)) != (i <= 4)) {
+            r.add_message("T020", "spsc ring should hold exactly 4 messages.", true);
+            return false;
+        }
+    }
+    for (uint64_t i = 1; i <= 4; i++) {
+        uint64_t value = 0;
+        size_t size = 0;
+        if (!ring.try_receive(&value, size) || value != i || size != sizeof(value)) {
+            r.add_message("T020", "spsc ring should deliver messages in order.", true);
+            return false;
+        }
+    }
+
+    basecode::channel pipe(basecode::channel_kind::spsc, 256, sizeof(uint64_t));
+    basecode::channel handoff(basecode::channel_kind::mpmc, 4, sizeof(uint64_t));
+    if (!pipe.initialize(r) || !handoff.initialize(r))
+        return false;
+
+    basecode::channel_registry channels;
+    channels.add(1, &pipe);
+    channels.add(2, &handoff);
+
+    // two independent terps: the producer streams 1..1000 through channel 1,
+    // the consumer sums whatever arrives
+    basecode::terp producer(1024 * 1024);
+    basecode::terp consumer(1024 * 1024);
+    if (!producer.initialize(r) || !consumer.initialize(r))
+        return false;
+    producer.channels(&channels);
+    consumer.channels(&channels);
+
+    basecode::instruction_emitter producer_emitter(0);
+    producer_emitter.move_int_constant_to_register(basecode::op_sizes::qword, 1, 1);
+    producer_emitter.move_int_constant_to_register(basecode::op_sizes::qword, 1, 2);
+    producer_emitter.move_int_constant_to_register(basecode::op_sizes::qword, buffer_address, 3);
+    producer_emitter.move_int_constant_to_register(basecode::op_sizes::qword, sizeof(uint64_t), 4);
+    auto produce_address = producer_emitter.end_address();
+    producer_emitter.store_with_offset_from_register(1, 3, 0);
+    auto retry_send_address = producer_emitter.end_address();
+    producer_emitter.send_message(5, 2, 3, 4);
+    producer_emitter.compare_int_register_to_constant(basecode::op_sizes::qword, 5, 0);
+    producer_emitter.branch_if_equal(retry_send_address);
+    producer_emitter.inc(basecode::op_sizes::qword, 1);
+    producer_emitter.compare_int_register_to_constant(basecode::op_sizes::qword, 1, message_count + 1);
+    producer_emitter.branch_if_not_equal(produce_address);
+    producer_emitter.exit();
+    producer_emitter.encode(r, producer);
+
+    basecode::instruction_emitter consumer_emitter(0);
+    consumer_emitter.move_int_constant_to_register(basecode::op_sizes::qword, message_count, 1);
+    consumer_emitter.move_int_constant_to_register(basecode::op_sizes::qword, 1, 2);
+    consumer_emitter.move_int_constant_to_register(basecode::op_sizes::qword, buffer_address, 3);
+    consumer_emitter.move_int_constant_to_register(basecode::op_sizes::qword, 0, 0);
+    auto consume_address = consumer_emitter.end_address();
+    consumer_emitter.receive_message(5, 2, 3);
+    consumer_emitter.compare_int_register_to_constant(basecode::op_sizes::qword, 5, 0);
+    consumer_emitter.branch_if_equal(consume_address);
+    consumer_emitter.load_with_offset_to_register(3, 6, 0);
+    consumer_emitter.add_int_register_to_register(basecode::op_sizes::qword, 0, 0, 6);
+    consumer_emitter.dec(basecode::op_sizes::qword, 1);
+    consumer_emitter.compare_int_register_to_constant(basecode::op_sizes::qword, 1, 0);
+    consumer_emitter.branch_if_not_equal(consume_address);
+    consumer_emitter.exit();
+    consumer_emitter.encode(r, consumer);
+    if (r.is_failed())
+        return false;
+
+    basecode::result producer_result;
+    auto producer_status = basecode::run_status::failed;
+    std::thread producer_thread([&]() {
+        producer_status = producer.run(producer_result);
+    });
+    auto consumer_status = consumer.run(r);
+    producer_thread.join();
+
+    if (producer_status != basecode::run_status::exited
+    ||  consumer_status != basecode::run_status::exited
+    ||  consumer.register_file().i[0] != message_count * (message_count + 1) / 2) {
+        r.add_message("T020", "consumer should receive every message from the producer.", true);
+        return false;
+    }
+
+    // zero-copy handoff on a shared heap: a spawned thread sends the address
+    // of a block it filled, the receiver reads it in place and frees it
+    basecode::heap_options_t options;
+    options.stack_size = 64 * 1024;
+    options.allocator_size = 256 * 1024;
+    basecode::terp shared_terp(1024 * 1024, options);
+    if (!shared_terp.initialize(r))
+        return false;
+    shared_terp.channels(&channels);
+
+    basecode::instruction_emitter bootstrap_emitter(0);
+    bootstrap_emitter.jump_direct(0);
+
+    basecode::instruction_emitter sender_emitter(bootstrap_emitter.end_address());
+    sender_emitter.alloc_int_constant(1, 64);
+    sender_emitter.move_int_constant_to_register(basecode::op_sizes::qword, 42, 2);
+    sender_emitter.store_with_offset_from_register(2, 1, 0);
+    sender_emitter.move_int_constant_to_register(basecode::op_sizes::qword, buffer_address + 8, 3);
+    sender_emitter.store_with_offset_from_register(1, 3, 0);
+    sender_emitter.move_int_constant_to_register(basecode::op_sizes::qword, 2, 4);
+    sender_emitter.move_int_constant_to_register(basecode::op_sizes::qword, sizeof(uint64_t), 5);
+    sender_emitter.send_message(6, 4, 3, 5);
+    sender_emitter.exit();
+
+    basecode::instruction_emitter main_emitter(sender_emitter.end_address());
+    main_emitter.spawn_thread(1, sender_emitter.start_address(), 0);
+    main_emitter.join_thread(1, 1);
+    main_emitter.move_int_constant_to_register(basecode::op_sizes::qword, 2, 2);
+    main_emitter.move_int_constant_to_register(basecode::op_sizes::qword, buffer_address, 3);
+    main_emitter.receive_message(4, 2, 3);
+    main_emitter.load_with_offset_to_register(3, 5, 0);
+    main_emitter.load_with_offset_to_register(5, 6, 0);
+    main_emitter.free_int_register(5);
+    main_emitter.exit();
+
+    bootstrap_emitter[0].patch_branch_address(main_emitter.start_address());
+    bootstrap_emitter.encode(r, shared_terp);
+    sender_emitter.encode(r, shared_terp);
+    main_emitter.encode(r, shared_terp);
+
+    if (r.is_failed() || !run_terp(r, shared_terp))
+        return false;
+
+    if (shared_terp.register_file().i[4] != sizeof(uint64_t)
+    ||  shared_terp.register_file().i[6] != 42) {
+        r.add_message("T020", "receiver should read the sender's block in place.", true);
+        return false;
+    }
+
+    return true;
+}
+
+static bool test_heap_placement(basecode::result& r, basecode::terp&) {
+    const uint64_t huge_page_size = 2 * 1024 * 1024;
+
+    basecode::heap_options_t options;
+    options.stack_size = 64 * 1024;
+    options.huge_pages = basecode::huge_page_mode::transparent;
+    options.numa_node = basecode::heap_options_t::local_numa_node;
+
+    basecode::terp placed_terp((1024 * 1024) * 32, options);
+    if (!placed_terp.initialize(r))
+        return false;
+
+    if (reinterpret_cast<uintptr_t>(placed_terp.heap()) % huge_page_size != 0) {
+        r.add_message("T021", "transparent huge page heaps should be 2MB aligned.", true);
+        return false;
+    }
+
+    basecode::instruction_emitter main_emitter(0);
+    main_emitter.move_int_constant_to_register(basecode::op_sizes::qword, 0x1000000, 1);
+    main_emitter.move_int_constant_to_register(basecode::op_sizes::qword, 42, 2);
+    main_emitter.store_with_offset_from_register(2, 1, 0);
+    main_emitter.load_with_offset_to_register(1, 3, 0);
+    main_emitter.exit();
+    main_emitter.encode(r, placed_terp);
+
+    if (r.is_failed() || !run_terp(r, placed_terp))
+        return false;
+
+    // moving to another worker migrates the pages already touched
+    if (placed_terp.register_file().i[3] != 42
+    ||  !placed_terp.bind_heap(r, basecode::heap_options_t::local_numa_node))
+        return false;
+
+    basecode::result invalid_result;
+    if (placed_terp.bind_heap(invalid_result, 64) || !invalid_result.has_code("B024")) {
+        r.add_message("T021", "binding to a node that can't exist should fail with B024.", true);
+        return false;
+    }
+
+    options.masked_addresses = true;
+    basecode::terp masked_terp((1024 * 1024) * 3, options);
+    if (!masked_terp.initialize(r))
+        return false;
+
+    // the hugetlb pool is usually empty unless the host reserved one
+    basecode::heap_options_t hugetlb_options;
+    hugetlb_options.stack_size = 64 * 1024;
+    hugetlb_options.huge_pages = basecode::huge_page_mode::hugetlb;
+    basecode::terp hugetlb_terp((1024 * 1024) * 8, hugetlb_options);
+
+    basecode::result hugetlb_result;
+    if (hugetlb_terp.initialize(hugetlb_result)) {
+        if (reinterpret_cast<uintptr_t>(hugetlb_terp.heap()) % huge_page_size != 0) {
+            r.add_message("T021", "hugetlb heaps should be 2MB aligned.", true);
+            return false;
+        }
+    } else if (!hugetlb_result.has_code("B024")) {
+        r.add_message("T021", "an empty hugetlb pool should fail with B024.", true);
+        return false;
+    }
+
+    return true;
+}
+
+static bool test_code_cache(basecode::result& r, basecode::terp& terp) {
+    auto directory = std::filesystem::temp_directory_path()
+        / fmt::format("basecode-cache-{}", getpid());
+    std::filesystem::create_directories(directory);
+    basecode::code_cache cache(directory.string());
+
+    basecode::instruction_emitter sum_emitter(0);
+    sum_emitter.move_int_constant_to_register(basecode::op_sizes::qword, 0, 1);
+    sum_emitter.move_int_constant_to_register(basecode::op_sizes::qword, 0, 2);
+    auto sum_loop = sum_emitter.end_address();
+    sum_emitter.integer_arithmetic(basecode::op_codes::add, basecode::op_sizes::qword, 1, 1, 2);
+    sum_emitter.inc(basecode::op_sizes::qword, 2);
+    sum_emitter.compare_int_register_to_constant(basecode::op_sizes::qword, 2, 100000);
+    auto sum_back_edge = sum_emitter.end_address();
+    sum_emitter.branch_if_not_equal(sum_loop);
+    sum_emitter.exit();
+    sum_emitter.encode(r, terp);
+
+    // cold run: verify, warm the loop tier up, translate, then store it all
+    basecode::verifier verifier(terp);
+    if (!verifier.verify(r, 0, sum_emitter.end_address()) || !run_terp(r, terp))
+        return false;
+
+    basecode::c_backend backend;
+    if (!backend.translate(r, terp, 0, sum_emitter.end_address(), 0))
+        return false;
+
+    auto key = basecode::code_cache::program_key(terp, 0, sum_emitter.end_address());
+    basecode::code_cache_sections sections;
+    terp.save_to_cache(sections, 0, sum_emitter.end_address());
+    sections[basecode::cache_section::c_source].assign(
+            backend.source().begin(),
+            backend.source().end());
+    if (!cache.store(r, key, sections))
+        return false;
+
+    // a restarted process: same program, fresh terp
+    basecode::terp warm_terp(1024 * 1024);
+    if (!warm_terp.initialize(r))
+        return false;
+    sum_emitter.encode(r, warm_terp);
+
+    basecode::code_cache_entry entry;
+    auto warm_key = basecode::code_cache::program_key(warm_terp, 0, sum_emitter.end_address());
+    if (warm_key != key || !cache.load(r, warm_key, entry)) {
+        r.add_message("T022", "the same program should hit its cache entry.", true);
+        return false;
+    }
+    if (!warm_terp.restore_from_cache(r, entry))
+        return false;
+
+    auto loop = warm_terp.osr_loop(sum_back_edge);
+    if (!warm_terp.is_verified(0) || loop == nullptr || !loop->is_compiled()) {
+        r.add_message("T022", "a cache hit should restore the verified range and loop tier.", true);
+        return false;
+    }
+
+    if (!run_terp(r, warm_terp))
+        return false;
+
+    // the loop tier takes over on the very first back edge
+    if (warm_terp.register_file().i[1] != 4999950000
+    ||  loop->back_edges != 0
+    ||  loop->entries != 1) {
+        r.add_message("T022", "the restored loop should run from the first back edge.", true);
+        return false;
+    }
+
+    const uint8_t* source;
+    size_t source_size;
+    if (!entry.find(basecode::cache_section::c_source, source, source_size)
+    ||  std::string(reinterpret_cast<const char*>(source), source_size) != backend.source()) {
+        r.add_message("T022", "the cached C source should match the translation.", true);
+        return false;
+    }
+    entry.release();
+
+    // flip one payload byte: the entry must be rejected, as a warning
+    auto path = cache.entry_path(key);
+    std::vector<char> bytes(std::filesystem::file_size(path));
+    std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+    file.read(bytes.data(), bytes.size());
+    bytes.back() ^= 0x01;
+    file.seekp(0);
+    file.write(bytes.data(), bytes.size());
+    file.close();
+
+    basecode::result corrupt_result;
+    auto corrupt_hit = cache.load(corrupt_result, key, entry);
+    basecode::result miss_result;
+    auto miss_hit = cache.load(miss_result, key + 1, entry);
+    std::filesystem::remove_all(directory);
+
+    if (corrupt_hit || !corrupt_result.has_code("B025") || corrupt_result.is_failed()) {
+        r.add_message("T022", "a corrupted entry should be ignored with a B025 warning.", true);
+        return false;
+    }
+
+    if (miss_hit || !miss_result.messages().empty()) {
+        r.add_message("T022", "an unknown key should miss quietly.", true);
+        return false;
+    }
+
+    return true;
+}
+
 static int time_test_function(
         basecode::result& r,
         basecode::terp& terp,
@@ -152,6 +2155,31 @@ int main() {
 
     time_test_function(r, terp, "test_square", test_square);
     time_test_function(r, terp, "test_fibonacci", test_fibonacci);
+    time_test_function(r, terp, "test_tail_call", test_tail_call);
+    time_test_function(r, terp, "test_call_site_cache", test_call_site_cache);
+    time_test_function(r, terp, "test_snapshot_fork", test_snapshot_fork);
+    time_test_function(r, terp, "test_preemption", test_preemption);
+    time_test_function(r, terp, "test_async_host_call", test_async_host_call);
+    time_test_function(r, terp, "test_bulk_memory", test_bulk_memory);
+    time_test_function(r, terp, "test_vector_dot_product", test_vector_dot_product);
+    time_test_function(r, terp, "test_batch_lanes", test_batch_lanes);
+    time_test_function(r, terp, "test_verifier", test_verifier);
+    time_test_function(r, terp, "test_masked_heap", test_masked_heap);
+    time_test_function(r, terp, "test_stack_guard", test_stack_guard);
+    time_test_function(r, terp, "test_heap_allocator", test_heap_allocator);
+    time_test_function(r, terp, "test_wide_arithmetic", test_wide_arithmetic);
+    time_test_function(r, terp, "test_memoized_fibonacci", test_memoized_fibonacci);
+    time_test_function(r, terp, "test_partial_evaluation", test_partial_evaluation);
+    time_test_function(r, terp, "test_ir_pipeline", test_ir_pipeline);
+    time_test_function(r, terp, "test_inlining", test_inlining);
+    time_test_function(r, terp, "test_aot_c_backend", test_aot_c_backend);
+    time_test_function(r, terp, "test_on_stack_replacement", test_on_stack_replacement);
+    time_test_function(r, terp, "test_conditional_branches", test_conditional_branches);
+    time_test_function(r, terp, "test_lazy_flags", test_lazy_flags);
+    time_test_function(r, terp, "test_guest_threads", test_guest_threads);
+    time_test_function(r, terp, "test_channels", test_channels);
+    time_test_function(r, terp, "test_heap_placement", test_heap_placement);
+    time_test_function(r, terp, "test_code_cache", test_code_cache);
 
     return 0;
 }
\ No newline at end of file
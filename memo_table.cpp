@@ -0,0 +1,82 @@
+#include "memo_table.h"
+
+namespace basecode {
+
+    memo_table::memo_table(size_t capacity) {
+        size_t slots = max_probes;
+        while (slots < capacity)
+            slots <<= 1;
+        _entries.resize(slots);
+        _mask = slots - 1;
+    }
+
+    void memo_table::clear() {
+        for (auto& entry : _entries)
+            entry.used = false;
+        _size = 0;
+        _hits = 0;
+        _misses = 0;
+        _evictions = 0;
+    }
+
+    size_t memo_table::size() const {
+        return _size;
+    }
+
+    uint64_t memo_table::hits() const {
+        return _hits;
+    }
+
+    uint64_t memo_table::misses() const {
+        return _misses;
+    }
+
+    uint64_t memo_table::evictions() const {
+        return _evictions;
+    }
+
+    bool memo_table::find(uint64_t function, uint64_t argument, uint64_t& value) {
+        auto slot = home_slot(function, argument);
+        for (size_t probe = 0; probe < max_probes; probe++) {
+            const auto& entry = _entries[(slot + probe) & _mask];
+            if (!entry.used)
+                break;
+            if (entry.function == function && entry.argument == argument) {
+                value = entry.value;
+                _hits++;
+                return true;
+            }
+        }
+        _misses++;
+        return false;
+    }
+
+    void memo_table::insert(uint64_t function, uint64_t argument, uint64_t value) {
+        auto slot = home_slot(function, argument);
+        for (size_t probe = 0; probe < max_probes; probe++) {
+            auto& entry = _entries[(slot + probe) & _mask];
+            if (!entry.used) {
+                entry = {true, function, argument, value};
+                _size++;
+                return;
+            }
+            if (entry.function == function && entry.argument == argument) {
+                entry.value = value;
+                return;
+            }
+        }
+
+        _entries[slot] = {true, function, argument, value};
+        _evictions++;
+    }
+
+    size_t memo_table::home_slot(uint64_t function, uint64_t argument) const {
+        // splitmix64 finalizer
+        uint64_t key = argument ^ (function * 0x9e3779b97f4a7c15);
+        key = (key ^ (key >> 30)) * 0xbf58476d1ce4e5b9;
+        key = (key ^ (key >> 27)) * 0x94d049bb133111eb;
+        key ^= key >> 31;
+        return static_cast<size_t>(key) & _mask;
+    }
+
+};
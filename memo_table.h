@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace basecode {
+
+    // results of pure functions keyed by (function address, argument).  the
+    // table is open-addressed with linear probing over a fixed power-of-two
+    // number of slots; when a key's probe window is full the home slot is
+    // overwritten, so memory stays bounded no matter how many distinct
+    // arguments a program produces.
+    class memo_table {
+    public:
+        static const size_t default_capacity = 4096;
+        static const size_t max_probes = 8;
+
+        explicit memo_table(size_t capacity = default_capacity);
+
+        void clear();
+
+        size_t size() const;
+
+        uint64_t hits() const;
+
+        uint64_t misses() const;
+
+        uint64_t evictions() const;
+
+        bool find(uint64_t function, uint64_t argument, uint64_t& value);
+
+        void insert(uint64_t function, uint64_t argument, uint64_t value);
+
+    private:
+        struct entry_t {
+            bool used = false;
+            uint64_t function = 0;
+            uint64_t argument = 0;
+            uint64_t value = 0;
+        };
+
+        size_t home_slot(uint64_t function, uint64_t argument) const;
+
+    private:
+        size_t _size = 0;
+        size_t _mask = 0;
+        uint64_t _hits = 0;
+        uint64_t _misses = 0;
+        uint64_t _evictions = 0;
+        std::vector<entry_t> _entries {};
+    };
+
+};
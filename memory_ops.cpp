@@ -0,0 +1,190 @@
+#include <cstring>
+#include "memory_ops.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BASECODE_X86_KERNELS
+#endif
+
+namespace basecode {
+
+    using fill_kernel_t = void (*)(uint8_t*, uint64_t, size_t);
+    using find_kernel_t = size_t (*)(const uint8_t*, uint64_t, size_t, size_t);
+
+    // replicates the low `width` bytes of value across all eight bytes
+    static inline uint64_t replicate(uint64_t value, size_t width) {
+        switch (width) {
+            case 1:  return (value & 0xffu) * 0x0101010101010101u;
+            case 2:  return (value & 0xffffu) * 0x0001000100010001u;
+            case 4:  return (value & 0xffffffffu) * 0x0000000100000001u;
+            default: return value;
+        }
+    }
+
+    static inline uint64_t truncate(uint64_t value, size_t width) {
+        return width == 8 ? value : value & ((uint64_t(1) << (width * 8)) - 1);
+    }
+
+    static void fill_tail(uint8_t* target, uint64_t pattern, size_t offset, size_t length) {
+        for (; offset < length; offset++)
+            target[offset] = static_cast<uint8_t>(pattern >> ((offset % 8) * 8));
+    }
+
+    static void fill_scalar(uint8_t* target, uint64_t pattern, size_t length) {
+        size_t offset = 0;
+        for (; offset + 8 <= length; offset += 8)
+            memcpy(target + offset, &pattern, sizeof(pattern));
+        fill_tail(target, pattern, offset, length);
+    }
+
+    static size_t find_scalar(
+            const uint8_t* data,
+            uint64_t value,
+            size_t width,
+            size_t index,
+            size_t count) {
+        for (; index < count; index++) {
+            uint64_t element = 0;
+            memcpy(&element, data + index * width, width);
+            if (element == value)
+                return index;
+        }
+        return count;
+    }
+
+    static size_t find_generic(const uint8_t* data, uint64_t value, size_t width, size_t count) {
+        if (width == 1) {
+            auto match = static_cast<const uint8_t*>(memchr(data, static_cast<int>(value), count));
+            return match != nullptr ? static_cast<size_t>(match - data) : count;
+        }
+        return find_scalar(data, value, width, 0, count);
+    }
+
+#if defined(BASECODE_X86_KERNELS)
+    static void fill_sse2(uint8_t* target, uint64_t pattern, size_t length) {
+        auto vector = _mm_set1_epi64x(static_cast<long long>(pattern));
+        size_t offset = 0;
+        for (; offset + 64 <= length; offset += 64) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(target + offset), vector);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(target + offset + 16), vector);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(target + offset + 32), vector);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(target + offset + 48), vector);
+        }
+        for (; offset + 16 <= length; offset += 16)
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(target + offset), vector);
+        fill_tail(target, pattern, offset, length);
+    }
+
+    __attribute__((target("avx2")))
+    static void fill_avx2(uint8_t* target, uint64_t pattern, size_t length) {
+        auto vector = _mm256_set1_epi64x(static_cast<long long>(pattern));
+        size_t offset = 0;
+        for (; offset + 128 <= length; offset += 128) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(target + offset), vector);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(target + offset + 32), vector);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(target + offset + 64), vector);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(target + offset + 96), vector);
+        }
+        for (; offset + 32 <= length; offset += 32)
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(target + offset), vector);
+        fill_tail(target, pattern, offset, length);
+    }
+
+    static size_t find_sse2(const uint8_t* data, uint64_t value, size_t width, size_t count) {
+        // sse2 has no 64-bit lane compare
+        if (width == 1 || width == 8)
+            return find_generic(data, value, width, count);
+
+        auto needle = _mm_set1_epi64x(static_cast<long long>(replicate(value, width)));
+        const size_t per_vector = 16 / width;
+
+        size_t index = 0;
+        for (; index + per_vector <= count; index += per_vector) {
+            auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + index * width));
+            auto equal = width == 2 ?
+                    _mm_cmpeq_epi16(block, needle) :
+                    _mm_cmpeq_epi32(block, needle);
+            auto mask = static_cast<uint32_t>(_mm_movemask_epi8(equal));
+            if (mask != 0)
+                return index + __builtin_ctz(mask) / width;
+        }
+        return find_scalar(data, value, width, index, count);
+    }
+
+    __attribute__((target("avx2")))
+    static size_t find_avx2(const uint8_t* data, uint64_t value, size_t width, size_t count) {
+        if (width == 1)
+            return find_generic(data, value, width, count);
+
+        auto needle = _mm256_set1_epi64x(static_cast<long long>(replicate(value, width)));
+        const size_t per_vector = 32 / width;
+
+        size_t index = 0;
+        for (; index + per_vector <= count; index += per_vector) {
+            auto block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + index * width));
+            __m256i equal;
+            switch (width) {
+                case 2:  equal = _mm256_cmpeq_epi16(block, needle); break;
+                case 4:  equal = _mm256_cmpeq_epi32(block, needle); break;
+                default: equal = _mm256_cmpeq_epi64(block, needle); break;
+            }
+            auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(equal));
+            if (mask != 0)
+                return index + __builtin_ctz(mask) / width;
+        }
+        return find_scalar(data, value, width, index, count);
+    }
+
+    static fill_kernel_t select_fill_kernel() {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return fill_avx2;
+        return fill_sse2;
+    }
+
+    static find_kernel_t select_find_kernel() {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return find_avx2;
+        return find_sse2;
+    }
+#else
+    static fill_kernel_t select_fill_kernel() {
+        return fill_scalar;
+    }
+
+    static find_kernel_t select_find_kernel() {
+        return find_generic;
+    }
+#endif
+
+    static const fill_kernel_t s_fill_kernel = select_fill_kernel();
+
+    static const find_kernel_t s_find_kernel = select_find_kernel();
+
+    void memory_ops::copy(uint8_t* target, const uint8_t* source, size_t length) {
+        // libc's memmove is already vectorized and handles overlap in either direction
+        memmove(target, source, length);
+    }
+
+    int memory_ops::compare(const uint8_t* lhs, const uint8_t* rhs, size_t length) {
+        return memcmp(lhs, rhs, length);
+    }
+
+    void memory_ops::fill(uint8_t* target, uint64_t value, size_t width, size_t count) {
+        auto length = width * count;
+        auto pattern = replicate(value, width);
+        if (width == 1) {
+            memset(target, static_cast<uint8_t>(value), length);
+        } else if (length < 32) {
+            fill_scalar(target, pattern, length);
+        } else {
+            s_fill_kernel(target, pattern, length);
+        }
+    }
+
+    size_t memory_ops::find(const uint8_t* data, uint64_t value, size_t width, size_t count) {
+        return s_find_kernel(data, truncate(value, width), width, count);
+    }
+
+};
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace basecode {
+
+    // bulk memory kernels behind the copy, fill, cmpm and find instructions.
+    // on x86 the fill and find kernels are picked at startup from the AVX2 or
+    // SSE2 implementations based on what the host cpu supports; everything else
+    // falls back to scalar code.
+    class memory_ops {
+    public:
+        // memmove semantics: overlapping ranges are copied correctly
+        static void copy(uint8_t* target, const uint8_t* source, size_t length);
+
+        static int compare(const uint8_t* lhs, const uint8_t* rhs, size_t length);
+
+        // writes `count` elements of `width` (1, 2, 4 or 8) bytes, each holding
+        // the low `width` bytes of `value`
+        static void fill(uint8_t* target, uint64_t value, size_t width, size_t count);
+
+        // index of the first `width` byte element equal to `value`, or `count`
+        // when there is none
+        static size_t find(const uint8_t* data, uint64_t value, size_t width, size_t count);
+    };
+
+};
@@ -0,0 +1,86 @@
+#include <algorithm>
+#include "partial_evaluator.h"
+#include "instruction_emitter.h"
+
+namespace basecode {
+
+    // a guarded stack turns runaway recursion into a trap instead of letting it
+    // overwrite the functions being evaluated
+    static heap_options_t sandbox_options(size_t heap_size) {
+        heap_options_t options;
+        options.stack_size = heap_size / 4;
+        return options;
+    }
+
+    partial_evaluator::partial_evaluator(
+            size_t heap_size,
+            uint64_t budget) : _sandbox(heap_size, sandbox_options(heap_size)),
+                               _budget(budget) {
+    }
+
+    bool partial_evaluator::add_function(result& r, const instruction_emitter& function) {
+        if (!_initialized) {
+            if (!_sandbox.initialize(r))
+                return false;
+            _initialized = true;
+        }
+
+        // address zero holds the sandbox's own bootstrap jmp, which is where
+        // the real program keeps its bootstrap too
+        instruction_emitter bootstrap(0);
+        bootstrap.jump_direct(0);
+        if (function.start_address() < bootstrap.end_address()) {
+            r.add_message("B018", "function overlaps the bootstrap jump at address zero.", true);
+            return false;
+        }
+
+        if (function.end_address() > _sandbox.heap_size() / 2) {
+            r.add_message("B018", "function does not fit the partial evaluator sandbox.", true);
+            return false;
+        }
+
+        // encode() only reads the emitter; a copy keeps the caller's const
+        auto copy = function;
+        if (!copy.encode(r, _sandbox))
+            return false;
+
+        if (function.is_pure())
+            _pure_functions.insert(function.start_address());
+        _scratch_address = std::max(_scratch_address, function.end_address());
+        return true;
+    }
+
+    bool partial_evaluator::evaluate(uint64_t function, uint64_t argument, uint64_t& value) {
+        if (!_initialized || _pure_functions.count(function) == 0)
+            return false;
+
+        instruction_emitter bootstrap(0);
+        bootstrap.jump_direct(_scratch_address);
+
+        instruction_emitter driver(_scratch_address);
+        driver.push_int_constant(op_sizes::qword, argument);
+        driver.jump_subroutine_direct(function);
+        driver.pop_int_register(op_sizes::qword, 0);
+        driver.exit();
+
+        // reset() forgets pure marks, so re-mark them: the sandbox memoizes too,
+        // which keeps recursive folds like fib(n) linear
+        _sandbox.reset();
+        for (auto address : _pure_functions)
+            _sandbox.mark_pure(address);
+
+        result r;
+        if (!bootstrap.encode(r, _sandbox) || !driver.encode(r, _sandbox))
+            return false;
+        if (_sandbox.run(r, _budget) != run_status::exited)
+            return false;
+        value = _sandbox.register_file().i[0];
+        _evaluations++;
+        return true;
+    }
+
+    size_t partial_evaluator::evaluations() const {
+        return _evaluations;
+    }
+
+};
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_set>
+#include "terp.h"
+#include "result.h"
+
+namespace basecode {
+
+    class instruction_emitter;
+
+    // runs calls to pure functions on constant arguments at code generation
+    // time, inside a private sandbox terp.  functions are encoded into the
+    // sandbox at the same addresses they'll have in the real program, so call
+    // targets resolve unchanged.  each evaluation gets `budget` basic blocks of
+    // fuel; anything that doesn't exit cleanly within it (loops forever, traps,
+    // calls the host) is simply not folded.
+    class partial_evaluator {
+    public:
+        static const uint64_t default_budget = 1000000;
+
+        explicit partial_evaluator(
+                size_t heap_size = 1024 * 1024,
+                uint64_t budget = default_budget);
+
+        // every function a folded call may reach has to be added, pure or not;
+        // only calls to pure ones are folded
+        bool add_function(result& r, const instruction_emitter& function);
+
+        bool evaluate(uint64_t function, uint64_t argument, uint64_t& value);
+
+        size_t evaluations() const;
+
+    private:
+        terp _sandbox;
+        uint64_t _budget;
+        bool _initialized = false;
+        size_t _evaluations = 0;
+        uint64_t _scratch_address = 0;
+        std::unordered_set<uint64_t> _pure_functions {};
+    };
+
+};
@@ -1,8 +1,22 @@
 #include <sstream>
 #include <iomanip>
+#include <algorithm>
+#include <type_traits>
 #include <fmt/format.h>
 #include <climits>
+#include <mutex>
+#include <condition_variable>
+#include <cstring>
+#include <csignal>
+#include <csetjmp>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 #include "terp.h"
+#include "verifier.h"
+#include "memory_ops.h"
+#include "terp_snapshot.h"
 #include "hex_formatter.h"
 
 namespace basecode {
@@ -19,26 +33,353 @@ namespace basecode {
         return (n >> c) | (n << ((-c) & mask));
     }
 
-    terp::terp(size_t heap_size) : _heap_size(heap_size) {
+    static bool is_branch(op_codes op) {
+        switch (op) {
+            case op_codes::bz:
+            case op_codes::bnz:
+            case op_codes::tbz:
+            case op_codes::tbnz:
+            case op_codes::bne:
+            case op_codes::beq:
+            case op_codes::bg:
+            case op_codes::bge:
+            case op_codes::bl:
+            case op_codes::ble:
+            case op_codes::ba:
+            case op_codes::bae:
+            case op_codes::bb:
+            case op_codes::bbe:
+            case op_codes::jmp:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    // when a terp with masked addresses is running, a fault inside its heap
+    // reservation unwinds back into run() and becomes a B014 trap.
+    struct heap_fault_context_t {
+        sigjmp_buf jump_buffer;
+        uint8_t* start = nullptr;
+        uint8_t* end = nullptr;
+        uint64_t fault_address = 0;
+    };
+
+    static thread_local heap_fault_context_t* s_fault_context = nullptr;
+
+    static struct sigaction s_previous_segv_action {};
+
+    static void heap_fault_handler(int signal, siginfo_t* info, void* ucontext) {
+        auto context = s_fault_context;
+        auto address = static_cast<uint8_t*>(info->si_addr);
+        if (context != nullptr && address >= context->start && address < context->end) {
+            context->fault_address = static_cast<uint64_t>(address - context->start);
+            siglongjmp(context->jump_buffer, 1);
+        }
+
+        // not ours: chain to whoever had the signal before.  our handler stays
+        // installed, so later guard faults in any terp still trap.
+        if ((s_previous_segv_action.sa_flags & SA_SIGINFO) != 0
+        &&  s_previous_segv_action.sa_sigaction != nullptr) {
+            s_previous_segv_action.sa_sigaction(signal, info, ucontext);
+            return;
+        }
+
+        auto handler = s_previous_segv_action.sa_handler;
+        if (handler != SIG_DFL && handler != SIG_IGN) {
+            handler(signal);
+            return;
+        }
+
+        // nobody handles it: the default action, on the faulting access again
+        struct sigaction default_action {};
+        default_action.sa_handler = SIG_DFL;
+        sigemptyset(&default_action.sa_mask);
+        sigaction(signal, &default_action, nullptr);
+    }
+
+    static void install_heap_fault_handler() {
+        static std::once_flag s_installed;
+        std::call_once(s_installed, []() {
+            struct sigaction action {};
+            action.sa_sigaction = heap_fault_handler;
+            action.sa_flags = SA_SIGINFO | SA_NODEFER;
+            sigemptyset(&action.sa_mask);
+            sigaction(SIGSEGV, &action, &s_previous_segv_action);
+        });
+    }
+
+    // futex-style parking for wait/notify.  it is shared by every terp in the
+    // process, so threads on the same heap meet on the host address.
+    struct wait_bucket_t {
+        std::mutex mutex;
+        std::condition_variable condition;
+    };
+
+    static wait_bucket_t s_wait_buckets[64];
+
+    static wait_bucket_t& wait_bucket(const uint64_t* address) {
+        return s_wait_buckets[(reinterpret_cast<uintptr_t>(address) >> 3) % 64];
+    }
+
+    terp::terp(
+            size_t heap_size,
+            const heap_options_t& options) : _heap_size(heap_size),
+                                             _options(options) {
     }
 
     terp::~terp() {
-        delete _heap;
-        _heap = nullptr;
+        join_all_threads();
+        free_heap();
+    }
+
+    void terp::free_heap() {
+        _allocator.detach();
+        if (_heap != nullptr) {
+            if (_owns_heap)
+                munmap(_heap, _mapping_size);
+            _heap = nullptr;
+        }
+    }
+
+    static const size_t s_huge_page_size = 2 * 1024 * 1024;
+
+    // from <numaif.h>, which would also drag in libnuma
+    static const int s_mpol_bind = 2;
+    static const unsigned s_mpol_mf_move = 1u << 1;
+
+    // over-reserves by `alignment` and trims both ends, so THP can back the
+    // mapping with whole huge pages from its first byte
+    static void* map_aligned(size_t size, size_t alignment, int prot, int flags) {
+        const auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        size = (size + page_size - 1) & ~(page_size - 1);
+
+        auto reservation = mmap(nullptr, size + alignment, prot, flags, -1, 0);
+        if (reservation == MAP_FAILED)
+            return MAP_FAILED;
+
+        auto start = reinterpret_cast<uintptr_t>(reservation);
+        auto aligned = (start + alignment - 1) & ~(alignment - 1);
+        if (aligned > start)
+            munmap(reservation, aligned - start);
+        auto end = start + size + alignment;
+        if (end > aligned + size)
+            munmap(reinterpret_cast<void*>(aligned + size), end - (aligned + size));
+        return reinterpret_cast<void*>(aligned);
+    }
+
+    bool terp::map_heap(result& r, int fd) {
+        free_heap();
+
+        // the guard granularity follows the options even for snapshot clones,
+        // so a clone lays out its stack guard and allocator like its source
+        _page_size = _options.huge_pages == huge_page_mode::hugetlb ?
+            s_huge_page_size :
+            static_cast<size_t>(sysconf(_SC_PAGESIZE));
+
+        // snapshot clones are file backed and keep regular pages
+        auto huge_pages = fd == -1 ? _options.huge_pages : huge_page_mode::none;
+
+        const int flags = fd == -1 ? MAP_PRIVATE | MAP_ANONYMOUS : MAP_PRIVATE;
+        if (!_options.masked_addresses) {
+            auto mapping_size = _heap_size;
+            void* heap;
+            switch (huge_pages) {
+                case huge_page_mode::hugetlb: {
+                    mapping_size = (_heap_size + s_huge_page_size - 1) & ~(s_huge_page_size - 1);
+                    heap = mmap(
+                            nullptr,
+                            mapping_size,
+                            PROT_READ | PROT_WRITE,
+                            flags | MAP_HUGETLB,
+                            -1,
+                            0);
+                    if (heap == MAP_FAILED) {
+                        r.add_message(
+                                "B024",
+                                "not enough reserved huge pages to back the heap.",
+                                true);
+                        return false;
+                    }
+                    break;
+                }
+                case huge_page_mode::transparent: {
+                    heap = map_aligned(_heap_size, s_huge_page_size, PROT_READ | PROT_WRITE, flags);
+                    if (heap != MAP_FAILED)
+                        madvise(heap, _heap_size, MADV_HUGEPAGE);
+                    break;
+                }
+                default: {
+                    heap = mmap(nullptr, _heap_size, PROT_READ | PROT_WRITE, flags, fd, 0);
+                    break;
+                }
+            }
+            if (heap == MAP_FAILED)
+                return false;
+            _heap = static_cast<uint8_t*>(heap);
+            _mapping_size = mapping_size;
+            _address_mask = UINT64_MAX;
+            return bind_pages(r, _options.numa_node, false) && protect_stack();
+        }
+
+        if (huge_pages == huge_page_mode::hugetlb) {
+            r.add_message("B024", "hugetlb heaps can't use masked addresses.", true);
+            return false;
+        }
+
+        const auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        size_t reservation = page_size;
+        while (reservation < _heap_size)
+            reservation <<= 1;
+
+        // a masked address plus the widest access (32 bytes) can't reach past
+        // the trailing guard page
+        auto mapping_size = reservation + page_size;
+        auto region = huge_pages == huge_page_mode::transparent ?
+            map_aligned(mapping_size, s_huge_page_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE) :
+            mmap(nullptr, mapping_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (region == MAP_FAILED)
+            return false;
+
+        auto heap = mmap(region, _heap_size, PROT_READ | PROT_WRITE, flags | MAP_FIXED, fd, 0);
+        if (heap == MAP_FAILED) {
+            munmap(region, mapping_size);
+            return false;
+        }
+        if (huge_pages == huge_page_mode::transparent)
+            madvise(heap, _heap_size, MADV_HUGEPAGE);
+
+        install_heap_fault_handler();
+
+        _heap = static_cast<uint8_t*>(region);
+        _mapping_size = mapping_size;
+        _address_mask = reservation - 1;
+        return bind_pages(r, _options.numa_node, false) && protect_stack();
+    }
+
+    bool terp::protect_stack() {
+        _stack_guard = 0;
+        _guard_size = 0;
+        if (_options.stack_size == 0)
+            return true;
+
+        // mprotect works in whole pages, 2MB ones for hugetlb heaps
+        if (_options.stack_size + _page_size > _heap_size)
+            return false;
+
+        auto stack_limit = (_heap_size - _options.stack_size) & ~(_page_size - 1);
+        _stack_guard = stack_limit - _page_size;
+        _guard_size = _page_size;
+        if (mprotect(_heap + _stack_guard, _page_size, PROT_NONE) != 0)
+            return false;
+
+        install_heap_fault_handler();
+        return true;
+    }
+
+    bool terp::bind_heap(result& r, int numa_node) {
+        if (_heap == nullptr) {
+            r.add_message("B024", "terp must be initialized before binding its heap.", true);
+            return false;
+        }
+        return bind_pages(r, numa_node, true);
+    }
+
+    bool terp::bind_pages(result& r, int numa_node, bool migrate) {
+        if (numa_node == heap_options_t::no_numa_node)
+            return true;
+
+#if defined(__linux__)
+        if (numa_node == heap_options_t::local_numa_node) {
+            unsigned cpu = 0;
+            unsigned node = 0;
+            if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0) {
+                r.add_message("B024", "unable to find the calling thread's NUMA node.", true);
+                return false;
+            }
+            numa_node = static_cast<int>(node);
+        }
+
+        if (numa_node < 0 || numa_node >= 64) {
+            r.add_message("B024", fmt::format("invalid NUMA node {}.", numa_node), true);
+            return false;
+        }
+
+        // pages not touched yet are placed on first fault; migrate moves the
+        // ones that already live elsewhere.  maxnode counts one extra bit.
+        uint64_t node_mask = uint64_t(1) << numa_node;
+        auto rc = syscall(
+                SYS_mbind,
+                _heap,
+                _heap_size,
+                s_mpol_bind,
+                &node_mask,
+                sizeof(node_mask) * 8 + 1,
+                migrate ? s_mpol_mf_move : 0u);
+        // a kernel built without NUMA support is one big node 0
+        if (rc != 0 && !(errno == ENOSYS && numa_node == 0)) {
+            r.add_message(
+                    "B024",
+                    fmt::format("unable to bind heap to NUMA node {}.", numa_node),
+                    true);
+            return false;
+        }
+        return true;
+#else
+        r.add_message("B024", "NUMA placement is only supported on linux.", true);
+        return false;
+#endif
+    }
+
+    bool terp::attach_allocator() {
+        if (_options.allocator_size == 0)
+            return true;
+
+        if (_options.stack_size == 0 || _options.allocator_size > _stack_guard)
+            return false;
+
+        _allocator.attach(_heap, _stack_guard - _options.allocator_size, _stack_guard);
+        return true;
     }
 
     void terp::reset() {
+        // threads run in the heap about to be recycled; they have to finish
+        join_all_threads();
+
+        // bulk release: every alloc made since the last reset goes at once
+        _allocator.format();
+
         _registers.pc = 0;
         _registers.fr = 0;
         _registers.sr = 0;
         _registers.sp = _heap_size;
+        _stack_low_water = _heap_size;
 
         for (size_t i = 0; i < 64; i++) {
             _registers.i[i] = 0;
             _registers.f[i] = 0.0;
         }
 
+        for (size_t i = 0; i < 16; i++)
+            _registers.v[i] = vector4d_t {};
+
         _exited = false;
+        _host_call.store(host_call_idle, std::memory_order_relaxed);
+        _host_call_value = 0;
+        _verified_start = 0;
+        _verified_end = 0;
+        _verified_boundaries.clear();
+        _call_target = nullptr;
+        _call_sites.clear();
+        _call_code_start = UINT64_MAX;
+        _call_code_end = 0;
+        _osr_entry = nullptr;
+        _osr_loops.clear();
+        _osr_code_start = UINT64_MAX;
+        _osr_code_end = 0;
+        _pure_functions.clear();
+        _memo_frames.clear();
+        _memo.clear();
     }
 
     uint64_t terp::pop() {
@@ -94,12 +435,61 @@ namespace basecode {
     }
 
     bool terp::step(result& r) {
+        if (_shared != nullptr && !sync_shared_state(r))
+            return false;
+        poll_host_call();
+        auto hot = load_hot_registers();
+        auto stepped = step(r, hot);
+        track_stack_depth(hot);
+        spill_hot_registers(hot);
+        if (_shared != nullptr)
+            publish_code_store();
+        return stepped;
+    }
+
+    __attribute__((always_inline)) inline bool terp::step(result& r, hot_registers_t& hot) {
         instruction_t inst;
-        auto inst_size = inst.decode(r, _heap, _registers.pc);
-        if (inst_size == 0)
+        size_t inst_size;
+        auto inst_address = hot.pc;
+        if (_call_target != nullptr) {
+            inst = _call_target->inst;
+            inst_size = _call_target->inst_size;
+            _call_target = nullptr;
+        } else if (is_verified(inst_address)) {
+            inst_size = decode_at(r, inst, inst_address);
+        } else {
+            inst_size = decode_checked(r, inst, inst_address);
+            if (inst_size == 0)
+                return false;
+        }
+
+        if (!execute(r, hot, inst, inst_address, inst_size))
             return false;
 
-        _registers.pc += inst_size;
+        // a taken backward branch closes a loop; once it has been taken often
+        // enough, run_loop switches to the loop tier at the loop head
+        if (hot.pc <= inst_address
+        &&  _osr_threshold > 0
+        &&  is_branch(inst.op)) {
+            auto& loop = _osr_loops[inst_address];
+            if (loop.is_compiled()) {
+                _osr_entry = &loop;
+            } else if (!loop.rejected && ++loop.back_edges >= _osr_threshold) {
+                if (compile_loop(loop, hot.pc, inst_address + inst_size))
+                    _osr_entry = &loop;
+            }
+        }
+
+        return true;
+    }
+
+    __attribute__((always_inline)) inline bool terp::execute(
+            result& r,
+            hot_registers_t& hot,
+            const instruction_t& inst,
+            uint64_t inst_address,
+            size_t inst_size) {
+        hot.pc += inst_size;
 
         switch (inst.op) {
             case op_codes::nop: {
@@ -107,100 +497,166 @@ namespace basecode {
             }
             case op_codes::load: {
                 uint64_t address;
-                if (!get_operand_value(r, inst, 1, address))
+                if (!get_operand_value(r, hot, inst, 1, address))
                     return false;
                 if (inst.operands_count > 2) {
                     uint64_t offset;
-                    if (!get_operand_value(r, inst, 2, offset))
+                    if (!get_operand_value(r, hot, inst, 2, offset))
                         return false;
                     address += offset;
                 }
                 uint64_t value = *qword_ptr(address);
-                if (!set_target_operand_value(r, inst, 0, value))
+                if (!set_target_operand_value(r, hot, inst, 0, value))
                     return false;
                 break;
             }
             case op_codes::store: {
                 uint64_t value;
-                if (!get_operand_value(r, inst, 0, value))
+                if (!get_operand_value(r, hot, inst, 0, value))
                     return false;
 
                 uint64_t address;
-                if (!get_operand_value(r, inst, 1, address))
+                if (!get_operand_value(r, hot, inst, 1, address))
                     return false;
                 if (inst.operands_count > 2) {
                     uint64_t offset;
-                    if (!get_operand_value(r, inst, 2, offset))
+                    if (!get_operand_value(r, hot, inst, 2, offset))
                         return false;
                     address += offset;
                 }
 
+                heap_written(address, sizeof(uint64_t));
                 *qword_ptr(address) = value;
                 break;
             }
             case op_codes::copy: {
                 uint64_t source_address, target_address;
-                if (!get_operand_value(r, inst, 0, source_address))
+                if (!get_operand_value(r, hot, inst, 0, source_address))
                     return false;
-                if (!get_operand_value(r, inst, 1, target_address))
+                if (!get_operand_value(r, hot, inst, 1, target_address))
                     return false;
                 uint64_t length;
-                if (!get_operand_value(r, inst, 2, length))
+                if (!get_operand_value(r, hot, inst, 2, length))
+                    return false;
+                if (!check_elements(r, source_address, length, op_size_in_bytes(inst.size))
+                ||  !check_elements(r, target_address, length, op_size_in_bytes(inst.size)))
                     return false;
-                memcpy(
-                        _heap + target_address,
-                        _heap + source_address,
-                        length * op_size_in_bytes(inst.size));
+                length *= op_size_in_bytes(inst.size);
+                heap_written(target_address, length);
+                memory_ops::copy(
+                        byte_ptr(target_address),
+                        byte_ptr(source_address),
+                        length);
                 break;
             }
             case op_codes::fill: {
                 uint64_t value;
-                if (!get_operand_value(r, inst, 0, value))
+                if (!get_operand_value(r, hot, inst, 0, value))
                     return false;
                 uint64_t address;
-                if (!get_operand_value(r, inst, 1, address))
+                if (!get_operand_value(r, hot, inst, 1, address))
                     return false;
                 uint64_t length;
-                if (!get_operand_value(r, inst, 2, length))
+                if (!get_operand_value(r, hot, inst, 2, length))
+                    return false;
+                if (!check_elements(r, address, length, op_size_in_bytes(inst.size)))
+                    return false;
+                heap_written(address, length * op_size_in_bytes(inst.size));
+                memory_ops::fill(
+                        byte_ptr(address),
+                        value,
+                        op_size_in_bytes(inst.size),
+                        length);
+                break;
+            }
+            case op_codes::cmpm: {
+                uint64_t lhs_address, rhs_address, length;
+                if (!get_operand_value(r, hot, inst, 1, lhs_address))
+                    return false;
+                if (!get_operand_value(r, hot, inst, 2, rhs_address))
+                    return false;
+                if (!get_operand_value(r, hot, inst, 3, length))
+                    return false;
+                if (!check_elements(r, lhs_address, length, op_size_in_bytes(inst.size))
+                ||  !check_elements(r, rhs_address, length, op_size_in_bytes(inst.size)))
                     return false;
                 length *= op_size_in_bytes(inst.size);
-
-                switch (inst.size) {
-                    case op_sizes::byte:
-                        memset(_heap + address, static_cast<uint8_t>(value), length);
-                        break;
-                    case op_sizes::word:
-                        memset(_heap + address, static_cast<uint16_t>(value), length);
-                        break;
-                    case op_sizes::dword:
-                        memset(_heap + address, static_cast<uint32_t>(value), length);
-                        break;
-                    case op_sizes::qword:
-                    default:
-                        // XXX: this is an error
-                        break;
+                auto compare_result = memory_ops::compare(
+                        byte_ptr(lhs_address),
+                        byte_ptr(rhs_address),
+                        length);
+                uint64_t value = compare_result < 0 ? UINT64_MAX : compare_result > 0 ? 1 : 0;
+                hot.flags(register_file_t::flags_t::zero, value == 0);
+                if (!set_target_operand_value(r, hot, inst, 0, value))
+                    return false;
+                break;
+            }
+            case op_codes::find: {
+                uint64_t value, address, length;
+                if (!get_operand_value(r, hot, inst, 1, value))
+                    return false;
+                if (!get_operand_value(r, hot, inst, 2, address))
+                    return false;
+                if (!get_operand_value(r, hot, inst, 3, length))
+                    return false;
+                if (!check_elements(r, address, length, op_size_in_bytes(inst.size)))
+                    return false;
+                auto index = memory_ops::find(
+                        byte_ptr(address),
+                        value,
+                        op_size_in_bytes(inst.size),
+                        length);
+                if (!set_target_operand_value(r, hot, inst, 0, static_cast<uint64_t>(index)))
+                    return false;
+                break;
+            }
+            case op_codes::alloc: {
+                uint64_t size;
+                if (!get_operand_value(r, hot, inst, 1, size))
+                    return false;
+                if (!_allocator.is_attached()) {
+                    r.add_message("B016", "alloc requires heap_options_t::allocator_size.", true);
+                    return false;
+                }
+                // exhaustion is not a fault: the guest gets a null address back
+                auto address = _allocator.allocate(size);
+                if (!set_target_operand_value(r, hot, inst, 0, address))
+                    return false;
+                break;
+            }
+            case op_codes::free: {
+                uint64_t address;
+                if (!get_operand_value(r, hot, inst, 0, address))
+                    return false;
+                if (address == 0)
+                    break;
+                if (!_allocator.release(address)) {
+                    r.add_message(
+                            "B016",
+                            fmt::format("free of ${:08X} which is not a live allocation.", address),
+                            true);
+                    return false;
                 }
-
                 break;
             }
             case op_codes::move: {
                 uint64_t source_value;
-                if (!get_operand_value(r, inst, 0, source_value))
+                if (!get_operand_value(r, hot, inst, 0, source_value))
                     return false;
-                if (!set_target_operand_value(r, inst, 1, source_value))
+                if (!set_target_operand_value(r, hot, inst, 1, source_value))
                     return false;
                 break;
             }
             case op_codes::push: {
                 uint64_t source_value;
-                if (!get_operand_value(r, inst, 0, source_value))
+                if (!get_operand_value(r, hot, inst, 0, source_value))
                     return false;
-                push(source_value);
+                push(hot, source_value);
                 break;
             }
             case op_codes::pop: {
-                uint64_t value = pop();
-                if (!set_target_operand_value(r, inst, 0, value))
+                uint64_t value = pop(hot);
+                if (!set_target_operand_value(r, hot, inst, 0, value))
                     return false;
                 break;
             }
@@ -214,125 +670,201 @@ namespace basecode {
             }
             case op_codes::add: {
                 uint64_t lhs_value, rhs_value;
-                if (!get_operand_value(r, inst, 1, lhs_value))
+                if (!get_operand_value(r, hot, inst, 1, lhs_value))
                     return false;
-                if (!get_operand_value(r, inst, 2, rhs_value))
+                if (!get_operand_value(r, hot, inst, 2, rhs_value))
                     return false;
-                if (!set_target_operand_value(r, inst, 0, lhs_value + rhs_value))
+                uint64_t sum;
+                auto carry = __builtin_add_overflow(lhs_value, rhs_value, &sum);
+                hot.flags(register_file_t::flags_t::carry, carry);
+                if (!set_target_operand_value(r, hot, inst, 0, sum))
+                    return false;
+                break;
+            }
+            case op_codes::addc: {
+                uint64_t lhs_value, rhs_value;
+                if (!get_operand_value(r, hot, inst, 1, lhs_value))
+                    return false;
+                if (!get_operand_value(r, hot, inst, 2, rhs_value))
+                    return false;
+                uint64_t sum;
+                auto carry = __builtin_add_overflow(lhs_value, rhs_value, &sum);
+                carry |= __builtin_add_overflow(
+                        sum,
+                        hot.flags(register_file_t::flags_t::carry) ? 1 : 0,
+                        &sum);
+                hot.flags(register_file_t::flags_t::carry, carry);
+                if (!set_target_operand_value(r, hot, inst, 0, sum))
                     return false;
                 break;
             }
             case op_codes::sub: {
                 uint64_t lhs_value, rhs_value;
-                if (!get_operand_value(r, inst, 1, lhs_value))
+                if (!get_operand_value(r, hot, inst, 1, lhs_value))
+                    return false;
+                if (!get_operand_value(r, hot, inst, 2, rhs_value))
+                    return false;
+                hot.flags(register_file_t::flags_t::carry, rhs_value > lhs_value);
+                if (!set_target_operand_value(r, hot, inst, 0, lhs_value - rhs_value))
+                    return false;
+                break;
+            }
+            case op_codes::subc: {
+                uint64_t lhs_value, rhs_value;
+                if (!get_operand_value(r, hot, inst, 1, lhs_value))
                     return false;
-                if (!get_operand_value(r, inst, 2, rhs_value))
+                if (!get_operand_value(r, hot, inst, 2, rhs_value))
                     return false;
-                if (!set_target_operand_value(r, inst, 0, lhs_value - rhs_value))
+                uint64_t difference;
+                auto borrow = __builtin_sub_overflow(lhs_value, rhs_value, &difference);
+                borrow |= __builtin_sub_overflow(
+                        difference,
+                        hot.flags(register_file_t::flags_t::carry) ? 1 : 0,
+                        &difference);
+                hot.flags(register_file_t::flags_t::carry, borrow);
+                if (!set_target_operand_value(r, hot, inst, 0, difference))
                     return false;
                 break;
             }
             case op_codes::mul: {
                 uint64_t lhs_value, rhs_value;
-                if (!get_operand_value(r, inst, 1, lhs_value))
+                if (!get_operand_value(r, hot, inst, 1, lhs_value))
                     return false;
-                if (!get_operand_value(r, inst, 2, rhs_value))
+                if (!get_operand_value(r, hot, inst, 2, rhs_value))
                     return false;
-                if (!set_target_operand_value(r, inst, 0, lhs_value * rhs_value))
+                if (!set_target_operand_value(r, hot, inst, 0, lhs_value * rhs_value))
+                    return false;
+                break;
+            }
+            case op_codes::mulx: {
+                uint64_t lhs_value, rhs_value;
+                if (!get_operand_value(r, hot, inst, 2, lhs_value))
+                    return false;
+                if (!get_operand_value(r, hot, inst, 3, rhs_value))
+                    return false;
+                auto product = static_cast<unsigned __int128>(lhs_value) * rhs_value;
+                if (!set_target_operand_value(r, hot, inst, 0, static_cast<uint64_t>(product >> 64)))
+                    return false;
+                if (!set_target_operand_value(r, hot, inst, 1, static_cast<uint64_t>(product)))
                     return false;
                 break;
             }
             case op_codes::div: {
                 uint64_t lhs_value, rhs_value;
-                if (!get_operand_value(r, inst, 1, lhs_value))
+                if (!get_operand_value(r, hot, inst, 1, lhs_value))
                     return false;
-                if (!get_operand_value(r, inst, 2, rhs_value))
+                if (!get_operand_value(r, hot, inst, 2, rhs_value))
                     return false;
                 uint64_t result = 0;
                 if (rhs_value != 0)
                     result = lhs_value / rhs_value;
-                if (!set_target_operand_value(r, inst, 0, result))
+                if (!set_target_operand_value(r, hot, inst, 0, result))
+                    return false;
+                break;
+            }
+            case op_codes::divx: {
+                uint64_t low_value, high_value, divisor;
+                if (!get_operand_value(r, hot, inst, 0, low_value))
+                    return false;
+                if (!get_operand_value(r, hot, inst, 1, high_value))
+                    return false;
+                if (!get_operand_value(r, hot, inst, 2, divisor))
+                    return false;
+                if (divisor == 0 || high_value >= divisor) {
+                    r.add_message(
+                            "B017",
+                            fmt::format("divx quotient of ${:016X}{:016X} / ${:X} does not fit 64 bits.",
+                                        high_value,
+                                        low_value,
+                                        divisor),
+                            true);
+                    return false;
+                }
+                auto dividend = (static_cast<unsigned __int128>(high_value) << 64) | low_value;
+                if (!set_target_operand_value(r, hot, inst, 0, static_cast<uint64_t>(dividend / divisor)))
+                    return false;
+                if (!set_target_operand_value(r, hot, inst, 1, static_cast<uint64_t>(dividend % divisor)))
                     return false;
                 break;
             }
             case op_codes::mod: {
                 uint64_t lhs_value, rhs_value;
-                if (!get_operand_value(r, inst, 1, lhs_value))
+                if (!get_operand_value(r, hot, inst, 1, lhs_value))
                     return false;
-                if (!get_operand_value(r, inst, 2, rhs_value))
+                if (!get_operand_value(r, hot, inst, 2, rhs_value))
                     return false;
-                if (!set_target_operand_value(r, inst, 0, lhs_value % rhs_value))
+                if (!set_target_operand_value(r, hot, inst, 0, lhs_value % rhs_value))
                     return false;
                 break;
             }
             case op_codes::neg: {
                 uint64_t value;
-                if (!get_operand_value(r, inst, 1, value))
+                if (!get_operand_value(r, hot, inst, 1, value))
                     return false;
                 int64_t negated_result = -static_cast<int64_t>(value);
-                if (!set_target_operand_value(r, inst, 0, static_cast<uint64_t>(negated_result)))
+                if (!set_target_operand_value(r, hot, inst, 0, static_cast<uint64_t>(negated_result)))
                     return false;
                 break;
             }
             case op_codes::shr: {
                 uint64_t lhs_value, rhs_value;
-                if (!get_operand_value(r, inst, 1, lhs_value))
+                if (!get_operand_value(r, hot, inst, 1, lhs_value))
                     return false;
-                if (!get_operand_value(r, inst, 2, rhs_value))
+                if (!get_operand_value(r, hot, inst, 2, rhs_value))
                     return false;
-                if (!set_target_operand_value(r, inst, 0, lhs_value >> rhs_value))
+                if (!set_target_operand_value(r, hot, inst, 0, lhs_value >> rhs_value))
                     return false;
                 break;
             }
             case op_codes::shl: {
                 uint64_t lhs_value, rhs_value;
-                if (!get_operand_value(r, inst, 1, lhs_value))
+                if (!get_operand_value(r, hot, inst, 1, lhs_value))
                     return false;
-                if (!get_operand_value(r, inst, 2, rhs_value))
+                if (!get_operand_value(r, hot, inst, 2, rhs_value))
                     return false;
-                if (!set_target_operand_value(r, inst, 0, lhs_value << rhs_value))
+                if (!set_target_operand_value(r, hot, inst, 0, lhs_value << rhs_value))
                     return false;
                 break;
             }
             case op_codes::ror: {
                 uint64_t lhs_value, rhs_value;
-                if (!get_operand_value(r, inst, 1, lhs_value))
+                if (!get_operand_value(r, hot, inst, 1, lhs_value))
                     return false;
-                if (!get_operand_value(r, inst, 2, rhs_value))
+                if (!get_operand_value(r, hot, inst, 2, rhs_value))
                     return false;
                 uint64_t right_rotated_value = rotr(lhs_value, static_cast<uint8_t>(rhs_value));
-                if (!set_target_operand_value(r, inst, 0, right_rotated_value))
+                if (!set_target_operand_value(r, hot, inst, 0, right_rotated_value))
                     return false;
                 break;
             }
             case op_codes::rol: {
                 uint64_t lhs_value, rhs_value;
-                if (!get_operand_value(r, inst, 1, lhs_value))
+                if (!get_operand_value(r, hot, inst, 1, lhs_value))
                     return false;
-                if (!get_operand_value(r, inst, 2, rhs_value))
+                if (!get_operand_value(r, hot, inst, 2, rhs_value))
                     return false;
                 uint64_t left_rotated_value = rotl(lhs_value, static_cast<uint8_t>(rhs_value));
-                if (!set_target_operand_value(r, inst, 0, left_rotated_value))
+                if (!set_target_operand_value(r, hot, inst, 0, left_rotated_value))
                     return false;
                 break;
             }
             case op_codes::and_op: {
                 uint64_t lhs_value, rhs_value;
-                if (!get_operand_value(r, inst, 1, lhs_value))
+                if (!get_operand_value(r, hot, inst, 1, lhs_value))
                     return false;
-                if (!get_operand_value(r, inst, 2, rhs_value))
+                if (!get_operand_value(r, hot, inst, 2, rhs_value))
                     return false;
-                if (!set_target_operand_value(r, inst, 0, lhs_value & rhs_value))
+                if (!set_target_operand_value(r, hot, inst, 0, lhs_value & rhs_value))
                     return false;
                 break;
             }
             case op_codes::or_op: {
                 uint64_t lhs_value, rhs_value;
-                if (!get_operand_value(r, inst, 1, lhs_value))
+                if (!get_operand_value(r, hot, inst, 1, lhs_value))
                     return false;
-                if (!get_operand_value(r, inst, 2, rhs_value))
+                if (!get_operand_value(r, hot, inst, 2, rhs_value))
                     return false;
-                if (!set_target_operand_value(r, inst, 0, lhs_value | rhs_value))
+                if (!set_target_operand_value(r, hot, inst, 0, lhs_value | rhs_value))
                     return false;
                 break;
             }
@@ -341,30 +873,30 @@ namespace basecode {
             }
             case op_codes::not_op: {
                 uint64_t value;
-                if (!get_operand_value(r, inst, 1, value))
+                if (!get_operand_value(r, hot, inst, 1, value))
                     return false;
                 uint64_t not_result = ~value;
-                if (!set_target_operand_value(r, inst, 0, not_result))
+                if (!set_target_operand_value(r, hot, inst, 0, not_result))
                     return false;
                 break;
             }
             case op_codes::bis: {
                 uint64_t value, bit_number;
-                if (!get_operand_value(r, inst, 1, value))
+                if (!get_operand_value(r, hot, inst, 1, value))
                     return false;
-                if (!get_operand_value(r, inst, 2, bit_number))
+                if (!get_operand_value(r, hot, inst, 2, bit_number))
                     return false;
-                if (!set_target_operand_value(r, inst, 0, value | (2^bit_number)))
+                if (!set_target_operand_value(r, hot, inst, 0, value | (2^bit_number)))
                     return false;
                 break;
             }
             case op_codes::bic: {
                 uint64_t value, bit_number;
-                if (!get_operand_value(r, inst, 1, value))
+                if (!get_operand_value(r, hot, inst, 1, value))
                     return false;
-                if (!get_operand_value(r, inst, 2, bit_number))
+                if (!get_operand_value(r, hot, inst, 2, bit_number))
                     return false;
-                if (!set_target_operand_value(r, inst, 0, value & ~(2^bit_number)))
+                if (!set_target_operand_value(r, hot, inst, 0, value & ~(2^bit_number)))
                     return false;
                 break;
             }
@@ -373,133 +905,1064 @@ namespace basecode {
             }
             case op_codes::cmp: {
                 uint64_t lhs_value, rhs_value;
-                if (!get_operand_value(r, inst, 0, lhs_value))
+                if (!get_operand_value(r, hot, inst, 0, lhs_value))
+                    return false;
+                if (!get_operand_value(r, hot, inst, 1, rhs_value))
+                    return false;
+                hot.compare(lhs_value, rhs_value);
+                break;
+            }
+            case op_codes::bz: {
+                hot.flags(register_file_t::flags_t::zero, false);
+
+                uint64_t value, address;
+                if (!get_operand_value(r, hot, inst, 0, value))
                     return false;
-                if (!get_operand_value(r, inst, 1, rhs_value))
+                if (!get_operand_value(r, hot, inst, 1, address))
                     return false;
-                uint64_t result = lhs_value - rhs_value;
-                _registers.flags(register_file_t::flags_t::zero, result == 0);
-                _registers.flags(register_file_t::flags_t::overflow, rhs_value > lhs_value);
+                if (value == 0)
+                    hot.pc = address;
                 break;
             }
-            case op_codes::bz: {
-                _registers.flags(register_file_t::flags_t::zero, false);
+            case op_codes::bnz: {
+                hot.flags(register_file_t::flags_t::zero, false);
+
+                uint64_t value, address;
+                if (!get_operand_value(r, hot, inst, 0, value))
+                    return false;
+                if (!get_operand_value(r, hot, inst, 1, address))
+                    return false;
+                if (value != 0)
+                    hot.pc = address;
+                break;
+            }
+            case op_codes::tbz: {
+                hot.flags(register_file_t::flags_t::zero, false);
+
+                uint64_t value, mask, address;
+                if (!get_operand_value(r, hot, inst, 0, value))
+                    return false;
+                if (!get_operand_value(r, hot, inst, 1, mask))
+                    return false;
+                if (!get_operand_value(r, hot, inst, 2, address))
+                    return false;
+                if ((value & mask) == 0)
+                    hot.pc = address;
+                break;
+            }
+            case op_codes::tbnz: {
+                hot.flags(register_file_t::flags_t::zero, false);
+
+                uint64_t value, mask, address;
+                if (!get_operand_value(r, hot, inst, 0, value))
+                    return false;
+                if (!get_operand_value(r, hot, inst, 1, mask))
+                    return false;
+                if (!get_operand_value(r, hot, inst, 2, address))
+                    return false;
+                if ((value & mask) != 0)
+                    hot.pc = address;
+                break;
+            }
+            case op_codes::bne: {
+                uint64_t address;
+                if (!get_operand_value(r, hot, inst, 0, address))
+                    return false;
+                if (hot.flags(register_file_t::flags_t::zero) == 0) {
+                    hot.pc = address;
+                }
+                break;
+            }
+            case op_codes::beq: {
+                uint64_t address;
+                if (!get_operand_value(r, hot, inst, 0, address))
+                    return false;
+                if (hot.flags(register_file_t::flags_t::zero) != 0) {
+                    hot.flags(register_file_t::flags_t::zero, false);
+                    hot.pc = address;
+                }
+                break;
+            }
+            case op_codes::bg:
+            case op_codes::bge:
+            case op_codes::bl:
+            case op_codes::ble:
+            case op_codes::ba:
+            case op_codes::bae:
+            case op_codes::bb:
+            case op_codes::bbe: {
+                uint64_t address;
+                if (!get_operand_value(r, hot, inst, 0, address))
+                    return false;
+                if (hot.condition(inst.op))
+                    hot.pc = address;
+                break;
+            }
+            case op_codes::jsr: {
+                hot.flags(register_file_t::flags_t::zero, false);
+                uint64_t address;
+                if (!get_operand_value(r, hot, inst, 0, address))
+                    return false;
+                if (!_pure_functions.empty() && memo_lookup(hot.sp, address))
+                    break;
+                push(hot, hot.pc);
+                if (!enter_call_target(r, inst_address, address))
+                    return false;
+                hot.pc = address;
+                break;
+            }
+            case op_codes::tjsr: {
+                hot.flags(register_file_t::flags_t::zero, false);
+                uint64_t address;
+                if (!get_operand_value(r, hot, inst, 0, address))
+                    return false;
+                if (!enter_call_target(r, inst_address, address))
+                    return false;
+                hot.pc = address;
+                break;
+            }
+            case op_codes::rts: {
+                uint64_t address = pop(hot);
+                hot.pc = address;
+                if (!_memo_frames.empty())
+                    memo_return(hot.sp);
+                break;
+            }
+            case op_codes::jmp: {
+                hot.flags(register_file_t::flags_t::zero, false);
+                uint64_t address;
+                if (!get_operand_value(r, hot, inst, 0, address))
+                    return false;
+                hot.pc = address;
+                break;
+            }
+            case op_codes::vload:
+            case op_codes::vstore: {
+                uint64_t address;
+                if (!get_operand_value(r, hot, inst, 1, address))
+                    return false;
+                if (inst.operands_count > 2) {
+                    uint64_t offset;
+                    if (!get_operand_value(r, hot, inst, 2, offset))
+                        return false;
+                    address += offset;
+                }
+                if (inst.op == op_codes::vload) {
+                    memcpy(&vector_operand(inst, 0), byte_ptr(address), sizeof(vector4d_t));
+                } else {
+                    heap_written(address, sizeof(vector4d_t));
+                    memcpy(byte_ptr(address), &vector_operand(inst, 0), sizeof(vector4d_t));
+                }
+                break;
+            }
+            case op_codes::vsplat: {
+                double value;
+                if (!get_operand_value(r, hot, inst, 1, value))
+                    return false;
+                vector_operand(inst, 0) = vector4d_t {value, value, value, value};
+                break;
+            }
+            case op_codes::vadd: {
+                vector_operand(inst, 0) = vector_operand(inst, 1) + vector_operand(inst, 2);
+                break;
+            }
+            case op_codes::vsub: {
+                vector_operand(inst, 0) = vector_operand(inst, 1) - vector_operand(inst, 2);
+                break;
+            }
+            case op_codes::vmul: {
+                vector_operand(inst, 0) = vector_operand(inst, 1) * vector_operand(inst, 2);
+                break;
+            }
+            case op_codes::vmin: {
+                const auto& lhs = vector_operand(inst, 1);
+                const auto& rhs = vector_operand(inst, 2);
+                vector_operand(inst, 0) = lhs < rhs ? lhs : rhs;
+                break;
+            }
+            case op_codes::vmax: {
+                const auto& lhs = vector_operand(inst, 1);
+                const auto& rhs = vector_operand(inst, 2);
+                vector_operand(inst, 0) = lhs > rhs ? lhs : rhs;
+                break;
+            }
+            case op_codes::vfma: {
+                vector_operand(inst, 0) = vector_operand(inst, 1) * vector_operand(inst, 2)
+                    + vector_operand(inst, 3);
+                break;
+            }
+            case op_codes::vhadd:
+            case op_codes::vhmin:
+            case op_codes::vhmax: {
+                const auto& value = vector_operand(inst, 1);
+                double reduced = value[0];
+                for (size_t lane = 1; lane < 4; lane++) {
+                    switch (inst.op) {
+                        case op_codes::vhmin:
+                            reduced = std::min(reduced, value[lane]);
+                            break;
+                        case op_codes::vhmax:
+                            reduced = std::max(reduced, value[lane]);
+                            break;
+                        default:
+                            reduced += value[lane];
+                            break;
+                    }
+                }
+                if (!set_target_operand_value(r, hot, inst, 0, reduced))
+                    return false;
+                break;
+            }
+            case op_codes::spawn: {
+                uint64_t entry, argument, id;
+                if (!get_operand_value(r, hot, inst, 1, entry))
+                    return false;
+                if (!get_operand_value(r, hot, inst, 2, argument))
+                    return false;
+                if (!spawn_thread(r, entry, argument, id))
+                    return false;
+                if (!set_target_operand_value(r, hot, inst, 0, id))
+                    return false;
+                break;
+            }
+            case op_codes::join: {
+                uint64_t id, value;
+                if (!get_operand_value(r, hot, inst, 1, id))
+                    return false;
+                if (!join_thread(r, id, value))
+                    return false;
+                if (!set_target_operand_value(r, hot, inst, 0, value))
+                    return false;
+                break;
+            }
+            case op_codes::aload:
+            case op_codes::astore:
+            case op_codes::cas:
+            case op_codes::xadd:
+            case op_codes::wait:
+            case op_codes::notify: {
+                auto address_index = inst.op == op_codes::aload
+                    || inst.op == op_codes::astore
+                    || inst.op == op_codes::cas
+                    || inst.op == op_codes::xadd ? 1 : 0;
+                uint64_t address;
+                if (!get_operand_value(r, hot, inst, address_index, address))
+                    return false;
+                if (!check_range(r, address, sizeof(uint64_t)))
+                    return false;
+                if (address % sizeof(uint64_t) != 0) {
+                    r.add_message(
+                            "B022",
+                            fmt::format("atomic access at ${:08X} is not 8-byte aligned.", address),
+                            true);
+                    return false;
+                }
+
+                auto ptr = qword_ptr(address);
+                uint64_t value = 0;
+                switch (inst.op) {
+                    case op_codes::aload: {
+                        value = __atomic_load_n(ptr, __ATOMIC_SEQ_CST);
+                        break;
+                    }
+                    case op_codes::astore: {
+                        if (!get_operand_value(r, hot, inst, 0, value))
+                            return false;
+                        heap_written(address, sizeof(uint64_t));
+                        __atomic_store_n(ptr, value, __ATOMIC_SEQ_CST);
+                        break;
+                    }
+                    case op_codes::cas: {
+                        uint64_t desired;
+                        if (!get_operand_value(r, hot, inst, 2, value))
+                            return false;
+                        if (!get_operand_value(r, hot, inst, 3, desired))
+                            return false;
+                        heap_written(address, sizeof(uint64_t));
+                        // on failure `value` receives what was there instead
+                        auto swapped = __atomic_compare_exchange_n(
+                                ptr,
+                                &value,
+                                desired,
+                                false,
+                                __ATOMIC_SEQ_CST,
+                                __ATOMIC_SEQ_CST);
+                        hot.flags(register_file_t::flags_t::zero, swapped);
+                        break;
+                    }
+                    case op_codes::xadd: {
+                        uint64_t addend;
+                        if (!get_operand_value(r, hot, inst, 2, addend))
+                            return false;
+                        heap_written(address, sizeof(uint64_t));
+                        value = __atomic_fetch_add(ptr, addend, __ATOMIC_SEQ_CST);
+                        break;
+                    }
+                    case op_codes::wait: {
+                        uint64_t expected;
+                        if (!get_operand_value(r, hot, inst, 1, expected))
+                            return false;
+                        auto& bucket = wait_bucket(ptr);
+                        std::unique_lock<std::mutex> lock(bucket.mutex);
+                        if (__atomic_load_n(ptr, __ATOMIC_SEQ_CST) == expected
+                        &&  (_shared == nullptr || !_shared->cancelled.load(std::memory_order_relaxed)))
+                            bucket.condition.wait(lock);
+                        break;
+                    }
+                    default: {
+                        // taking the lock orders this notify after any waiter's
+                        // check of the value, so no wakeup is lost
+                        auto& bucket = wait_bucket(ptr);
+                        std::lock_guard<std::mutex> lock(bucket.mutex);
+                        bucket.condition.notify_all();
+                        break;
+                    }
+                }
+
+                if (inst.op == op_codes::aload
+                ||  inst.op == op_codes::cas
+                ||  inst.op == op_codes::xadd) {
+                    if (!set_target_operand_value(r, hot, inst, 0, value))
+                        return false;
+                }
+                break;
+            }
+            case op_codes::send:
+            case op_codes::recv: {
+                uint64_t id, address;
+                if (!get_operand_value(r, hot, inst, 1, id))
+                    return false;
+                if (!get_operand_value(r, hot, inst, 2, address))
+                    return false;
+
+                auto channel = _channels != nullptr ? _channels->find(id) : nullptr;
+                if (channel == nullptr) {
+                    r.add_message("B023", fmt::format("no channel with id {}.", id), true);
+                    return false;
+                }
+
+                uint64_t value = 0;
+                if (inst.op == op_codes::send) {
+                    uint64_t length;
+                    if (!get_operand_value(r, hot, inst, 3, length))
+                        return false;
+                    if (length == 0 || length > channel->message_size()) {
+                        r.add_message(
+                                "B023",
+                                fmt::format(
+                                        "message of {} bytes doesn't fit channel {}.",
+                                        length,
+                                        id),
+                                true);
+                        return false;
+                    }
+                    if (!check_range(r, address, length))
+                        return false;
+                    value = channel->try_send(byte_ptr(address), length) ? 1 : 0;
+                } else {
+                    if (!check_range(r, address, channel->message_size()))
+                        return false;
+                    heap_written(address, channel->message_size());
+                    size_t size;
+                    if (channel->try_receive(byte_ptr(address), size))
+                        value = size;
+                }
+
+                if (!set_target_operand_value(r, hot, inst, 0, value))
+                    return false;
+                break;
+            }
+            case op_codes::hcall: {
+                uint64_t id;
+                if (!get_operand_value(r, hot, inst, 0, id))
+                    return false;
+
+                auto function = _host_functions != nullptr ?
+                        _host_functions->find(id) :
+                        nullptr;
+                if (function == nullptr) {
+                    r.add_message(
+                            "B010",
+                            fmt::format("no host function registered for id {}.", id),
+                            true);
+                    return false;
+                }
+
+                // the host sees, and may change, the spilled register file
+                uint64_t value = 0;
+                spill_hot_registers(hot);
+                _host_call.store(host_call_pending, std::memory_order_relaxed);
+                auto status = (*function)(r, *this, value);
+                hot = load_hot_registers();
+                switch (status) {
+                    case host_call_status::completed:
+                        _host_call.store(host_call_idle, std::memory_order_relaxed);
+                        _registers.i[0] = value;
+                        break;
+                    case host_call_status::suspended:
+                        // complete_host_call() may already have run; the run
+                        // loop collects the result either way
+                        break;
+                    case host_call_status::failed:
+                        _host_call.store(host_call_idle, std::memory_order_relaxed);
+                        return false;
+                }
+                break;
+            }
+            case op_codes::meta: {
+                break;
+            }
+            case op_codes::debug: {
+                break;
+            }
+            case op_codes::exit: {
+                _exited = true;
+                break;
+            }
+        }
+
+        // every taken branch, call or return starts a new basic block
+        if (hot.pc != inst_address + inst_size)
+            --_fuel;
+
+        return !r.is_failed();
+    }
+
+    run_status terp::run(result& r, uint64_t budget) {
+        _fuel = budget;
+        if (!has_guard_regions())
+            return run_loop(r);
+
+        heap_fault_context_t context;
+        context.start = _heap;
+        context.end = _heap + _mapping_size;
+
+        auto previous_context = s_fault_context;
+        if (sigsetjmp(context.jump_buffer, 0) != 0) {
+            s_fault_context = previous_context;
+            if (_guard_size > 0
+            &&  context.fault_address >= _stack_guard
+            &&  context.fault_address < _stack_guard + _guard_size) {
+                r.add_message(
+                        "B015",
+                        fmt::format("stack overflow at SP ${:08X}.", _registers.sp),
+                        true);
+            } else {
+                r.add_message(
+                        "B014",
+                        fmt::format("heap access fault at ${:08X}.", context.fault_address),
+                        true);
+            }
+            return run_status::failed;
+        }
+
+        s_fault_context = &context;
+        auto status = run_loop(r);
+        s_fault_context = previous_context;
+        return status;
+    }
+
+    run_status terp::run_loop(result& r) {
+        // PC, SP and FR live in locals for the whole run; step() and execute()
+        // are forced inline and nothing out of line takes their address, so
+        // they can stay in host registers.  a heap fault
+        // longjmps straight out of here, so with guard regions they're also
+        // spilled after every step to keep the register file current for
+        // the trap report.
+        auto hot = load_hot_registers();
+        auto spill_every_step = has_guard_regions();
+        auto status = run_status::exited;
+        while (!_exited) {
+            if (_shared != nullptr && !sync_shared_state(r)) {
+                status = run_status::failed;
+                break;
+            }
+            if (poll_host_call() == host_call_pending) {
+                status = run_status::suspended;
+                break;
+            }
+            if (_fuel == 0) {
+                status = run_status::yielded;
+                break;
+            }
+            if (!step(r, hot)) {
+                status = run_status::failed;
+                break;
+            }
+            track_stack_depth(hot);
+            if (_osr_entry != nullptr) {
+                auto loop = _osr_entry;
+                _osr_entry = nullptr;
+                // hand over a copy: taking the address of `hot` itself would
+                // force it out of registers for the whole loop
+                auto loop_hot = hot;
+                auto entered = run_compiled_loop(r, loop_hot, *loop);
+                hot = loop_hot;
+                if (!entered) {
+                    status = run_status::failed;
+                    break;
+                }
+            }
+            if (spill_every_step)
+                spill_hot_registers(hot);
+        }
+        if (_shared != nullptr)
+            publish_code_store();
+        spill_hot_registers(hot);
+        return status;
+    }
+
+    void terp::attach_thread(
+            const terp& parent,
+            uint64_t entry,
+            uint64_t argument,
+            uint64_t stack_top) {
+        _owns_heap = false;
+        _heap = parent._heap;
+        _mapping_size = parent._mapping_size;
+        _address_mask = parent._address_mask;
+        _stack_guard = parent._stack_guard;
+        _guard_size = parent._guard_size;
+        _host_functions = parent._host_functions;
+        _channels = parent._channels;
+        _pure_functions = parent._pure_functions;
+        _verified_start = parent._verified_start;
+        _verified_end = parent._verified_end;
+        _verified_boundaries = parent._verified_boundaries;
+        _osr_threshold = parent._osr_threshold;
+        _shared = parent._shared;
+        _code_epoch = parent._code_epoch;
+
+        // the pool is already formatted: attach to it, don't reset it
+        attach_allocator();
+
+        _registers.pc = entry;
+        _registers.sp = stack_top;
+        _registers.i[0] = argument;
+    }
+
+    bool terp::spawn_thread(result& r, uint64_t entry, uint64_t argument, uint64_t& id) {
+        if (!_allocator.is_attached()) {
+            r.add_message("B021", "spawn needs an allocator pool for thread stacks.", true);
+            return false;
+        }
+
+        auto stack = _allocator.allocate(_options.thread_stack_size);
+        if (stack == 0) {
+            r.add_message("B021", "no room in the allocator pool for a thread stack.", true);
+            return false;
+        }
+
+        if (_shared == nullptr) {
+            _shared = std::make_shared<heap_shared_state_t>();
+            share_code_range(_verified_start, _verified_end);
+            share_code_range(_osr_code_start, _osr_code_end);
+            share_code_range(_call_code_start, _call_code_end);
+        }
+
+        auto thread = std::make_unique<guest_thread_t>();
+        thread->stack = stack;
+        thread->interpreter = std::make_unique<terp>(_heap_size, _options);
+        thread->interpreter->attach_thread(
+                *this,
+                entry,
+                argument,
+                (stack + _options.thread_stack_size) & ~(sizeof(uint64_t) - 1));
+
+        auto state = thread.get();
+        state->worker = std::thread([state]() {
+            state->status = state->interpreter->run(state->r);
+            // hand the thread's cached blocks back to the shared lists
+            state->interpreter->_allocator.flush();
+        });
+
+        _threads.push_back(std::move(thread));
+        id = _threads.size();
+        return true;
+    }
+
+    bool terp::join_thread(result& r, uint64_t id, uint64_t& value) {
+        if (id == 0 || id > _threads.size() || _threads[id - 1] == nullptr) {
+            r.add_message("B021", fmt::format("no running thread with id {}.", id), true);
+            return false;
+        }
+
+        auto& thread = _threads[id - 1];
+        thread->worker.join();
+        if (thread->status != run_status::exited) {
+            r.add_message("B021", fmt::format("thread {} did not exit cleanly.", id), true);
+            for (const auto& message : thread->r.messages())
+                r.add_message(message.code(), message.message(), message.is_error());
+            return false;
+        }
+
+        value = thread->interpreter->_registers.i[0];
+        _allocator.release(thread->stack);
+        thread.reset();
+        return true;
+    }
+
+    void terp::join_all_threads() {
+        // the heap's owner cancels every guest thread on it, nested ones
+        // included: one spinning or parked in wait would otherwise keep
+        // reset() and the destructor from ever returning
+        if (_owns_heap && _shared != nullptr) {
+            _shared->cancelled.store(true, std::memory_order_relaxed);
+            for (auto& bucket : s_wait_buckets) {
+                std::lock_guard<std::mutex> lock(bucket.mutex);
+                bucket.condition.notify_all();
+            }
+        }
 
-                uint64_t value, address;
-                if (!get_operand_value(r, inst, 0, value))
-                    return false;
-                if (!get_operand_value(r, inst, 1, address))
-                    return false;
-                if (value == 0)
-                    _registers.pc = address;
-                break;
+        for (auto& thread : _threads) {
+            if (thread != nullptr && thread->worker.joinable())
+                thread->worker.join();
+        }
+        _threads.clear();
+
+        if (_owns_heap)
+            _shared.reset();
+    }
+
+    void terp::invalidate_code() {
+        _verified_start = 0;
+        _verified_end = 0;
+        _verified_boundaries.clear();
+        invalidate_compiled_loops();
+        invalidate_call_targets();
+    }
+
+    void terp::share_code_range(uint64_t start, uint64_t end) {
+        if (_shared == nullptr || start >= end)
+            return;
+        auto current = _shared->code_start.load(std::memory_order_relaxed);
+        while (start < current
+        &&     !_shared->code_start.compare_exchange_weak(current, start, std::memory_order_relaxed)) {
+        }
+        current = _shared->code_end.load(std::memory_order_relaxed);
+        while (end > current
+        &&     !_shared->code_end.compare_exchange_weak(current, end, std::memory_order_relaxed)) {
+        }
+    }
+
+    void terp::publish_code_store() {
+        if (!_code_stored)
+            return;
+        _code_stored = false;
+        _shared->code_epoch.fetch_add(1, std::memory_order_release);
+    }
+
+    // between instructions on a heap shared with guest threads: publish our
+    // stores into code, drop everything decoded ahead if another thread
+    // stored into code, and stop once the owner cancels the threads
+    bool terp::sync_shared_state(result& r) {
+        publish_code_store();
+        if (_shared->cancelled.load(std::memory_order_relaxed) && !_owns_heap) {
+            r.add_message("B021", "guest thread cancelled by the terp that owns its heap.", true);
+            return false;
+        }
+        auto epoch = _shared->code_epoch.load(std::memory_order_acquire);
+        if (epoch != _code_epoch) {
+            _code_epoch = epoch;
+            invalidate_code();
+        }
+        return true;
+    }
+
+    bool terp::compile_loop(osr_loop_t& loop, uint64_t start, uint64_t end) {
+        loop.start = start;
+        loop.end = end;
+        loop.slots.assign((end - start) / 8, -1);
+        loop.instructions.clear();
+
+        // the loop tier runs without the per-step decode and verifier check,
+        // so everything it may reach has to pass both up front.  a failure
+        // isn't an error: the loop just stays interpreted.
+        result compile_result;
+        auto address = start;
+        while (address < end) {
+            osr_loop_t::decoded_t decoded;
+            decoded.size = decode_at(compile_result, decoded.inst, address);
+            if (decoded.size == 0
+            ||  address + decoded.size > end
+            ||  !verifier::check_instruction(compile_result, decoded.inst, address)) {
+                loop.rejected = true;
+                loop.slots.clear();
+                loop.instructions.clear();
+                return false;
             }
-            case op_codes::bnz: {
-                _registers.flags(register_file_t::flags_t::zero, false);
+            loop.slots[(address - start) / 8] = static_cast<int32_t>(loop.instructions.size());
+            loop.instructions.push_back(decoded);
+            address += decoded.size;
+        }
 
-                uint64_t value, address;
-                if (!get_operand_value(r, inst, 0, value))
-                    return false;
-                if (!get_operand_value(r, inst, 1, address))
-                    return false;
-                if (value != 0)
-                    _registers.pc = address;
+        _osr_code_start = std::min(_osr_code_start, start);
+        _osr_code_end = std::max(_osr_code_end, end);
+        share_code_range(start, end);
+        return true;
+    }
+
+    bool terp::run_compiled_loop(result& r, hot_registers_t& loop_hot, osr_loop_t& loop) {
+        if (!loop.is_compiled())
+            return true;
+        loop.entries++;
+        _osr_invalidated = false;
+
+        // work on a local copy so execute() can keep it in registers
+        auto hot = loop_hot;
+        auto ok = true;
+        while (!_exited
+            && _host_call.load(std::memory_order_relaxed) == host_call_idle
+            && _fuel > 0) {
+            auto address = hot.pc;
+            if (address < loop.start || address >= loop.end)
                 break;
-            }
-            case op_codes::tbz: {
-                _registers.flags(register_file_t::flags_t::zero, false);
 
-                uint64_t value, mask, address;
-                if (!get_operand_value(r, inst, 0, value))
-                    return false;
-                if (!get_operand_value(r, inst, 1, mask))
-                    return false;
-                if (!get_operand_value(r, inst, 2, address))
-                    return false;
-                if ((value & mask) == 0)
-                    _registers.pc = address;
+            auto slot = loop.slots[(address - loop.start) / 8];
+            if (slot < 0)
                 break;
-            }
-            case op_codes::tbnz: {
-                _registers.flags(register_file_t::flags_t::zero, false);
 
-                uint64_t value, mask, address;
-                if (!get_operand_value(r, inst, 0, value))
-                    return false;
-                if (!get_operand_value(r, inst, 1, mask))
-                    return false;
-                if (!get_operand_value(r, inst, 2, address))
-                    return false;
-                if ((value & mask) != 0)
-                    _registers.pc = address;
+            // calls and returns keep the interpreter's call-site and memo
+            // bookkeeping, so the interpreter runs them
+            const auto& decoded = loop.instructions[slot];
+            if (decoded.inst.op == op_codes::jsr
+            ||  decoded.inst.op == op_codes::tjsr
+            ||  decoded.inst.op == op_codes::rts) {
+                loop.side_exits++;
                 break;
             }
-            case op_codes::bne: {
-                uint64_t address;
-                if (!get_operand_value(r, inst, 0, address))
-                    return false;
-                if (_registers.flags(register_file_t::flags_t::zero) == 0) {
-                    _registers.pc = address;
-                }
+
+            if (!execute(r, hot, decoded.inst, address, decoded.size)) {
+                ok = false;
                 break;
             }
-            case op_codes::beq: {
-                uint64_t address;
-                if (!get_operand_value(r, inst, 0, address))
-                    return false;
-                if (_registers.flags(register_file_t::flags_t::zero) != 0) {
-                    _registers.flags(register_file_t::flags_t::zero, false);
-                    _registers.pc = address;
-                }
+            track_stack_depth(hot);
+            if (has_guard_regions())
+                spill_hot_registers(hot);
+            if (_shared != nullptr && !sync_shared_state(r)) {
+                ok = false;
                 break;
             }
-            case op_codes::bg: {
+
+            // the loop, or another thread, stored into its code: the decoded
+            // copy is stale
+            if (_osr_invalidated) {
+                loop.deopts++;
                 break;
             }
-            case op_codes::bge: {
-                break;
+        }
+        loop_hot = hot;
+        return ok;
+    }
+
+    // a store over a cached callee's first instruction: keep the sites and
+    // their counts, but decode every target again on its next call
+    void terp::invalidate_call_targets() {
+        for (auto& site : _call_sites) {
+            for (size_t i = 0; i < site.count; i++)
+                site.entries[i].inst_size = 0;
+        }
+        _call_target = nullptr;
+        _call_code_start = UINT64_MAX;
+        _call_code_end = 0;
+    }
+
+    void terp::invalidate_compiled_loops() {
+        for (auto& entry : _osr_loops) {
+            auto& loop = entry.second;
+            if (!loop.is_compiled())
+                continue;
+            loop.back_edges = 0;
+            loop.slots.clear();
+            loop.instructions.clear();
+        }
+        _osr_code_start = UINT64_MAX;
+        _osr_code_end = 0;
+        _osr_invalidated = true;
+    }
+
+    const osr_loop_t* terp::osr_loop(uint64_t branch_address) const {
+        auto it = _osr_loops.find(branch_address);
+        if (it == _osr_loops.end())
+            return nullptr;
+        return &it->second;
+    }
+
+    void terp::osr_threshold(uint64_t back_edges) {
+        _osr_threshold = back_edges;
+    }
+
+    // compiled_loops section: per loop a cached_loop_t, its slots padded to 8
+    // bytes, then its decoded instructions
+    struct cached_loop_t {
+        uint64_t branch_address;
+        uint64_t start;
+        uint64_t end;
+        uint64_t slot_count;
+        uint64_t instruction_count;
+    };
+
+    struct cached_instruction_t {
+        uint64_t size;
+        instruction_t inst;
+    };
+
+    static_assert(
+        std::is_trivially_copyable<instruction_t>::value,
+        "decoded instructions are cached as raw bytes");
+
+    static void append_bytes(std::vector<uint8_t>& buffer, const void* data, size_t size) {
+        auto bytes = static_cast<const uint8_t*>(data);
+        buffer.insert(buffer.end(), bytes, bytes + size);
+    }
+
+    void terp::save_to_cache(code_cache_sections& sections, uint64_t start, uint64_t end) const {
+        if (_verified_end > _verified_start
+        &&  _verified_start >= start
+        &&  _verified_end <= end) {
+            const uint64_t range[] = {_verified_start, _verified_end};
+            auto& section = sections[cache_section::verified_range];
+            section.clear();
+            append_bytes(section, range, sizeof(range));
+            append_bytes(
+                    section,
+                    _verified_boundaries.data(),
+                    _verified_boundaries.size() * sizeof(uint64_t));
+        }
+
+        std::vector<uint8_t> loops;
+        for (const auto& entry : _osr_loops) {
+            const auto& loop = entry.second;
+            if (!loop.is_compiled() || loop.start < start || loop.end > end)
+                continue;
+
+            cached_loop_t record {
+                entry.first,
+                loop.start,
+                loop.end,
+                loop.slots.size(),
+                loop.instructions.size()};
+            append_bytes(loops, &record, sizeof(record));
+            append_bytes(loops, loop.slots.data(), loop.slots.size() * sizeof(int32_t));
+            loops.resize((loops.size() + 7) & ~size_t(7));
+            for (const auto& decoded : loop.instructions) {
+                cached_instruction_t cached {decoded.size, decoded.inst};
+                append_bytes(loops, &cached, sizeof(cached));
             }
-            case op_codes::bl: {
-                break;
+        }
+        if (!loops.empty())
+            sections[cache_section::compiled_loops] = std::move(loops);
+    }
+
+    bool terp::restore_from_cache(result& r, const code_cache_entry& entry) {
+        const uint8_t* data;
+        size_t size;
+        if (entry.find(cache_section::verified_range, data, size)) {
+            uint64_t range[2] {};
+            if (size >= sizeof(range))
+                memcpy(range, data, sizeof(range));
+            auto words = range[1] > range[0] ? ((range[1] - range[0]) / 8 + 63) / 64 : 0;
+            if (size < sizeof(range)
+            ||  range[1] > _heap_size
+            ||  size != sizeof(range) + words * sizeof(uint64_t)) {
+                r.add_message("B025", "cached verified range is malformed.", true);
+                return false;
             }
-            case op_codes::ble: {
-                break;
+            _verified_start = range[0];
+            _verified_end = range[1];
+            _verified_boundaries.resize(words);
+            memcpy(_verified_boundaries.data(), data + sizeof(range), words * sizeof(uint64_t));
+            share_code_range(_verified_start, _verified_end);
+        }
+
+        if (!entry.find(cache_section::compiled_loops, data, size))
+            return true;
+
+        // the checksum already vouched for the bytes; this guards against a
+        // writer with a different idea of the layout
+        size_t offset = 0;
+        while (offset < size) {
+            cached_loop_t record;
+            if (size - offset < sizeof(record)) {
+                r.add_message("B025", "cached loop record is truncated.", true);
+                return false;
             }
-            case op_codes::jsr: {
-                _registers.flags(register_file_t::flags_t::zero, false);
-                push(_registers.pc);
-                uint64_t address;
-                if (!get_operand_value(r, inst, 0, address))
-                    return false;
-                _registers.pc = address;
-                break;
+            memcpy(&record, data + offset, sizeof(record));
+            offset += sizeof(record);
+
+            auto slots_size = (record.slot_count * sizeof(int32_t) + 7) & ~size_t(7);
+            if (record.end <= record.start
+            ||  record.slot_count != (record.end - record.start) / 8
+            ||  record.instruction_count > record.slot_count
+            ||  size - offset < slots_size
+            ||  (size - offset - slots_size) / sizeof(cached_instruction_t) < record.instruction_count) {
+                r.add_message("B025", "cached loop record is malformed.", true);
+                return false;
             }
-            case op_codes::rts: {
-                uint64_t address = pop();
-                _registers.pc = address;
-                break;
+
+            osr_loop_t loop;
+            loop.start = record.start;
+            loop.end = record.end;
+            loop.slots.resize(record.slot_count);
+            memcpy(loop.slots.data(), data + offset, record.slot_count * sizeof(int32_t));
+            offset += slots_size;
+
+            loop.instructions.resize(record.instruction_count);
+            for (auto& decoded : loop.instructions) {
+                cached_instruction_t cached;
+                memcpy(&cached, data + offset, sizeof(cached));
+                offset += sizeof(cached);
+                decoded.size = cached.size;
+                decoded.inst = cached.inst;
             }
-            case op_codes::jmp: {
-                _registers.flags(register_file_t::flags_t::zero, false);
-                uint64_t address;
-                if (!get_operand_value(r, inst, 0, address))
+
+            for (auto slot : loop.slots) {
+                if (slot >= static_cast<int32_t>(record.instruction_count)) {
+                    r.add_message("B025", "cached loop record is malformed.", true);
                     return false;
-                _registers.pc = address;
-                break;
-            }
-            case op_codes::meta: {
-                break;
-            }
-            case op_codes::debug: {
-                break;
-            }
-            case op_codes::exit: {
-                _exited = true;
-                break;
+                }
             }
+
+            _osr_loops[record.branch_address] = std::move(loop);
+            _osr_code_start = std::min(_osr_code_start, record.start);
+            _osr_code_end = std::max(_osr_code_end, record.end);
+            share_code_range(record.start, record.end);
         }
 
-        return !r.is_failed();
+        return true;
+    }
+
+    uint64_t terp::fuel() const {
+        return _fuel;
+    }
+
+    uint8_t terp::poll_host_call() {
+        auto state = _host_call.load(std::memory_order_acquire);
+        if (state == host_call_completed) {
+            _registers.i[0] = _host_call_value;
+            _host_call.store(host_call_idle, std::memory_order_relaxed);
+            state = host_call_idle;
+        }
+        return state;
+    }
+
+    bool terp::is_suspended() const {
+        return _host_call.load(std::memory_order_acquire) == host_call_pending;
+    }
+
+    // may run on any thread, including while the host function that
+    // suspended the terp is still on the stack.  the value is handed over
+    // through _host_call and stored into I0 by the terp's own thread.
+    void terp::complete_host_call(uint64_t value) {
+        _host_call_value = value;
+        _host_call.store(host_call_completed, std::memory_order_release);
+    }
+
+    void terp::host_functions(const host_function_registry* registry) {
+        _host_functions = registry;
+    }
+
+    void terp::channels(const channel_registry* registry) {
+        _channels = registry;
+    }
+
+    bool terp::enter_call_target(result& r, uint64_t site_address, uint64_t address) {
+        // instructions are 8-byte aligned, so neighbouring sites get
+        // neighbouring slots
+        if (_call_sites.empty())
+            _call_sites.resize(call_site_slots);
+        auto& site = _call_sites[(site_address / sizeof(uint64_t)) & (call_site_slots - 1)];
+        if (site.site != site_address) {
+            site = call_site_cache_t {};
+            site.site = site_address;
+        }
+
+        auto entry = site.find(address);
+        if (entry != nullptr) {
+            site.hits++;
+        } else {
+            site.misses++;
+            entry = site.insert(address);
+            entry->inst_size = 0;
+        }
+
+        if (entry->inst_size == 0) {
+            auto inst_size = is_verified(address) ?
+                decode_at(r, entry->inst, address) :
+                decode_checked(r, entry->inst, address);
+            if (inst_size == 0)
+                return false;
+            entry->inst_size = inst_size;
+            _call_code_start = std::min(_call_code_start, address);
+            _call_code_end = std::max(_call_code_end, address + inst_size);
+            share_code_range(address, address + inst_size);
+        }
+
+        _call_target = entry;
+        return true;
+    }
+
+    // the checked interpreter's fetch: anything the verifier hasn't vouched
+    // for, including dynamic transfers into the middle of an instruction
+    size_t terp::decode_checked(result& r, instruction_t& inst, uint64_t address) {
+        if (address >= _heap_size) {
+            r.add_message("B012", fmt::format("PC ${:08X} is outside the heap.", address), true);
+            return 0;
+        }
+
+        auto encoding_size = *byte_ptr(address);
+        if (encoding_size < instruction_t::base_size
+        ||  encoding_size % 8 != 0
+        ||  address + encoding_size > _heap_size) {
+            r.add_message(
+                    "B012",
+                    fmt::format("invalid instruction at ${:08X}: bad encoding size.", address),
+                    true);
+            return 0;
+        }
+
+        auto inst_size = decode_at(r, inst, address);
+        if (inst_size == 0 || !verifier::check_instruction(r, inst, address))
+            return 0;
+        return inst_size;
+    }
+
+    bool terp::memo_lookup(uint64_t sp, uint64_t address) {
+        if (_pure_functions.count(address) == 0)
+            return false;
+
+        auto argument = *qword_ptr(sp);
+        uint64_t value;
+        if (_memo.find(address, argument, value)) {
+            // the result takes the argument's slot, exactly as if the callee ran
+            *qword_ptr(sp) = value;
+            return true;
+        }
+
+        _memo_frames.push_back({address, argument, sp - sizeof(uint64_t)});
+        return false;
+    }
+
+    void terp::memo_return(uint64_t sp) {
+        // frames the stack has already unwound past without an rts are dead
+        auto return_slot = sp - sizeof(uint64_t);
+        while (!_memo_frames.empty() && _memo_frames.back().sp < return_slot)
+            _memo_frames.pop_back();
+
+        if (_memo_frames.empty() || _memo_frames.back().sp != return_slot)
+            return;
+
+        const auto& frame = _memo_frames.back();
+        _memo.insert(frame.function, frame.argument, *qword_ptr(sp));
+        _memo_frames.pop_back();
+    }
+
+    void terp::mark_pure(uint64_t address) {
+        _pure_functions.insert(address);
+    }
+
+    const memo_table& terp::memo() const {
+        return _memo;
     }
 
     bool terp::has_exited() const {
@@ -517,8 +1980,109 @@ namespace basecode {
     }
 
     bool terp::initialize(result& r) {
-        _heap = new uint8_t[_heap_size];
+        if (!map_heap(r, -1)) {
+            r.add_message("B001", "unable to allocate terp heap.", true);
+            return false;
+        }
+
+        if (!attach_allocator()) {
+            r.add_message("B016", "allocator region does not fit below the stack guard.", true);
+            return false;
+        }
+
+        reset();
+        return !r.is_failed();
+    }
+
+    bool terp::initialize(result& r, const terp_snapshot& snapshot) {
+        if (!snapshot.is_valid()) {
+            r.add_message("B007", "snapshot has no heap image.", true);
+            return false;
+        }
+
+        free_heap();
+        _heap_size = snapshot._heap_size;
+        _options = snapshot._options;
         reset();
+
+        // MAP_PRIVATE makes the mapping copy-on-write: we only pay for the
+        // pages this terp actually dirties.
+        if (!map_heap(r, snapshot._fd)) {
+            r.add_message("B008", "unable to map snapshot heap image.", true);
+            return false;
+        }
+
+        // the allocator's lists live in the heap image, so attach without
+        // formatting.  blocks sitting in the source terp's local caches when
+        // the snapshot was taken stay allocated in this copy.
+        if (!attach_allocator()) {
+            r.add_message("B016", "allocator region does not fit below the stack guard.", true);
+            return false;
+        }
+
+        _registers = snapshot._registers;
+        _exited = snapshot._exited;
+
+        return !r.is_failed();
+    }
+
+    bool terp::snapshot(result& r, terp_snapshot& snapshot) const {
+        if (_heap == nullptr) {
+            r.add_message("B007", "terp must be initialized before taking a snapshot.", true);
+            return false;
+        }
+
+        snapshot.release();
+
+#if defined(__linux__)
+        auto fd = memfd_create("basecode-terp-snapshot", MFD_CLOEXEC);
+#else
+        char path[] = "/tmp/basecode-terp-snapshot-XXXXXX";
+        auto fd = mkstemp(path);
+        if (fd != -1)
+            unlink(path);
+#endif
+        if (fd == -1 || ftruncate(fd, static_cast<off_t>(_heap_size)) != 0) {
+            if (fd != -1)
+                close(fd);
+            r.add_message("B009", "unable to create snapshot heap image.", true);
+            return false;
+        }
+
+        // the file starts out sparse and zero filled, so pages the program never
+        // touched don't need to be written (or stored) at all.
+        const auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        for (size_t offset = 0; offset < _heap_size; offset += page_size) {
+            auto length = std::min(page_size, _heap_size - offset);
+            if (_guard_size > 0 && offset >= _stack_guard && offset < _stack_guard + _guard_size)
+                continue;
+
+            auto page = _heap + offset;
+            if (page[0] == 0 && memcmp(page, page + 1, length - 1) == 0)
+                continue;
+
+            size_t written = 0;
+            while (written < length) {
+                auto count = pwrite(
+                        fd,
+                        page + written,
+                        length - written,
+                        static_cast<off_t>(offset + written));
+                if (count <= 0) {
+                    close(fd);
+                    r.add_message("B009", "unable to write snapshot heap image.", true);
+                    return false;
+                }
+                written += static_cast<size_t>(count);
+            }
+        }
+
+        snapshot._fd = fd;
+        snapshot._heap_size = _heap_size;
+        snapshot._options = _options;
+        snapshot._registers = _registers;
+        snapshot._exited = _exited;
+
         return !r.is_failed();
     }
 
@@ -561,6 +2125,9 @@ namespace basecode {
                     case operand_types::register_floating_point:
                         stream << "F" << std::to_string(inst.operands[i].index);
                         break;
+                    case operand_types::register_vector:
+                        stream << "V" << std::to_string(inst.operands[i].index);
+                        break;
                     case operand_types::register_sp:
                         stream << "SP";
                         break;
@@ -611,6 +2178,55 @@ namespace basecode {
         return stream.str();
     }
 
+    const call_site_cache_t* terp::call_site(uint64_t address) const {
+        if (_call_sites.empty())
+            return nullptr;
+        const auto& site = _call_sites[(address / sizeof(uint64_t)) & (call_site_slots - 1)];
+        if (site.site != address)
+            return nullptr;
+        return &site;
+    }
+
+    uint64_t terp::call_count(uint64_t target) const {
+        // polymorphic sites don't keep per-target counts
+        uint64_t count = 0;
+        for (const auto& site : _call_sites) {
+            if (site.count == 1 && site.entries[0].target == target)
+                count += site.hits + site.misses;
+        }
+        return count;
+    }
+
+    size_t terp::stack_high_water() const {
+        if (_heap == nullptr || _options.stack_size == 0)
+            return 0;
+
+        // SP is an ordinary register; a guest that moves it below the stack
+        // region is reported as having used all of it
+        auto stack_base = _stack_guard + _guard_size;
+        if (_stack_low_water < stack_base)
+            return _heap_size - stack_base;
+        return _heap_size - _stack_low_water;
+    }
+
+    bool terp::is_verified(uint64_t address) const {
+        if (address < _verified_start || address >= _verified_end || address % 8 != 0)
+            return false;
+        auto slot = (address - _verified_start) / 8;
+        return ((_verified_boundaries[slot / 64] >> (slot % 64)) & 1) != 0;
+    }
+
+    void terp::mark_verified(uint64_t start, uint64_t end, const std::vector<uint64_t>& boundaries) {
+        _verified_start = start;
+        _verified_end = end;
+        _verified_boundaries.assign(((end - start) / 8 + 63) / 64, 0);
+        for (auto address : boundaries) {
+            auto slot = (address - start) / 8;
+            _verified_boundaries[slot / 64] |= uint64_t(1) << (slot % 64);
+        }
+        share_code_range(start, end);
+    }
+
     const register_file_t& terp::register_file() const {
         return _registers;
     }
@@ -641,11 +2257,16 @@ namespace basecode {
         return stream.str();
     }
 
-    bool terp::get_operand_value(
+    // the operand accessors are forced inline into execute(), like execute()
+    // into step(): once they are, the host compiler can keep the hot
+    // registers out of memory
+    __attribute__((always_inline)) inline bool terp::get_operand_value(
             result& r,
+            const hot_registers_t&,
             const instruction_t& instruction,
             uint8_t operand_index,
             double& value) const {
+        value = 0.0;
         switch (instruction.operands[operand_index].type) {
             case operand_types::increment_register_pre:
             case operand_types::decrement_register_pre:
@@ -666,6 +2287,13 @@ namespace basecode {
                         true);
                 break;
             }
+            case operand_types::register_vector: {
+                r.add_message(
+                        "B005",
+                        "vector registers cannot be used as scalar operands.",
+                        true);
+                return false;
+            }
             case operand_types::increment_constant_pre:
             case operand_types::decrement_constant_pre:
             case operand_types::increment_constant_post:
@@ -683,11 +2311,13 @@ namespace basecode {
         return true;
     }
 
-    bool terp::get_operand_value(
+    __attribute__((always_inline)) inline bool terp::get_operand_value(
             result& r,
+            const hot_registers_t& hot,
             const instruction_t& instruction,
             uint8_t operand_index,
             uint64_t& value) const {
+        value = 0;
         switch (instruction.operands[operand_index].type) {
             case operand_types::increment_register_pre:
             case operand_types::decrement_register_pre:
@@ -701,16 +2331,23 @@ namespace basecode {
                 value = static_cast<uint64_t>(_registers.f[instruction.operands[operand_index].index]);
                 break;
             }
+            case operand_types::register_vector: {
+                r.add_message(
+                        "B005",
+                        "vector registers cannot be used as scalar operands.",
+                        true);
+                return false;
+            }
             case operand_types::register_sp: {
-                value = _registers.sp;
+                value = hot.sp;
                 break;
             }
             case operand_types::register_pc: {
-                value = _registers.pc;
+                value = hot.pc;
                 break;
             }
             case operand_types::register_flags: {
-                value = _registers.fr;
+                value = hot.flags_register();
                 break;
             }
             case operand_types::register_status: {
@@ -753,8 +2390,9 @@ namespace basecode {
         return true;
     }
 
-    bool terp::set_target_operand_value(
+    __attribute__((always_inline)) inline bool terp::set_target_operand_value(
             result& r,
+            hot_registers_t& hot,
             const instruction_t& instruction,
             uint8_t operand_index,
             uint64_t value) {
@@ -771,16 +2409,23 @@ namespace basecode {
                 _registers.f[instruction.operands[operand_index].index] = value;
                 break;
             }
+            case operand_types::register_vector: {
+                r.add_message(
+                        "B006",
+                        "vector registers cannot be scalar target operands.",
+                        true);
+                return false;
+            }
             case operand_types::register_sp: {
-                _registers.sp = value;
+                hot.sp = value;
                 break;
             }
             case operand_types::register_pc: {
-                _registers.pc = value;
+                hot.pc = value;
                 break;
             }
             case operand_types::register_flags: {
-                _registers.fr = value;
+                hot.flags_register(value);
                 break;
             }
             case operand_types::register_status: {
@@ -797,15 +2442,16 @@ namespace basecode {
                         "B006",
                         "constant cannot be a target operand type.",
                         true);
-                break;
+                return false;
             }
         }
 
-        return false;
+        return true;
     }
 
-    bool terp::set_target_operand_value(
+    __attribute__((always_inline)) inline bool terp::set_target_operand_value(
             result& r,
+            hot_registers_t& hot,
             const instruction_t& instruction,
             uint8_t operand_index,
             double value) {
@@ -822,16 +2468,23 @@ namespace basecode {
                 _registers.f[instruction.operands[operand_index].index] = value;
                 break;
             }
+            case operand_types::register_vector: {
+                r.add_message(
+                        "B006",
+                        "vector registers cannot be scalar target operands.",
+                        true);
+                return false;
+            }
             case operand_types::register_sp: {
-                _registers.sp = static_cast<uint64_t>(value);
+                hot.sp = static_cast<uint64_t>(value);
                 break;
             }
             case operand_types::register_pc: {
-                _registers.pc = static_cast<uint64_t>(value);
+                hot.pc = static_cast<uint64_t>(value);
                 break;
             }
             case operand_types::register_flags: {
-                _registers.fr = static_cast<uint64_t>(value);
+                hot.flags_register(static_cast<uint64_t>(value));
                 break;
             }
             case operand_types::register_status: {
@@ -848,11 +2501,11 @@ namespace basecode {
                         "B006",
                         "constant cannot be a target operand type.",
                         true);
-                break;
+                return false;
             }
         }
 
-        return false;
+        return true;
     }
 
 };
\ No newline at end of file
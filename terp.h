@@ -3,9 +3,22 @@
 #include <cstdint>
 #include <string>
 #include <map>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 #include "result.h"
+#include "channel.h"
+#include "code_cache.h"
+#include "host_functions.h"
+#include "heap_allocator.h"
+#include "memo_table.h"
 
 namespace basecode {
+    class terp_snapshot;
+
     // basecode interpreter, which consumes base IR
     //
     //
@@ -20,6 +33,9 @@ namespace basecode {
     // data only:
     // F0-F63: floating point registers (double precision)
     //
+    // packed vector:
+    // V0-V15: four double precision lanes each (256-bit)
+    //
     // stack pointer: sp (like an IXX register)
     // program counter: pc (can be read, but not changed)
     // flags: fr (definitely read; maybe write)
@@ -66,6 +82,15 @@ namespace basecode {
     // fill {source-register}, {target-register}, {length constant}
     // fill {source-register}, {target-register}, {length register}
     //
+    // lengths count elements of the instruction size; fill replicates the low
+    // byte/word/dword/qword of the value.  overlapping copies are allowed.
+    //
+    // cmpm {target-register}, {lhs-register}, {rhs-register}, {length}
+    //      target = 0 (and zero flag set) when equal, 1 when lhs > rhs, -1 otherwise
+    //
+    // find {target-register}, {value}, {address-register}, {length}
+    //      target = index of the first element equal to value, or length
+    //
     // register/constant
     // -------------------
     //
@@ -89,13 +114,24 @@ namespace basecode {
     //  size applicable to all: {.b|.w|.dw|.qw}
     //
     // add
-    // addc
+    // addc (add with carry in)
     //
     // sub
-    // subc
+    // subc (subtract with borrow in)
+    //
+    //  add, addc, sub, subc and cmp set the carry flag on unsigned carry/borrow
+    //  out, so multi-word values chain as add/addc... or sub/subc...
     //
     // mul
+    // mulx {hi target}, {lo target}, {lhs}, {rhs}
+    //      full 64x64 -> 128-bit unsigned product
+    //
     // div
+    // divx {lo register}, {hi register}, {divisor}
+    //      divides the 128-bit value hi:lo; lo receives the quotient and hi the
+    //      remainder.  a zero divisor or a quotient wider than 64 bits (hi >=
+    //      divisor) fails with B017.
+    //
     // mod
     // neg
     //
@@ -126,18 +162,26 @@ namespace basecode {
     //
     // bne
     // beq
-    // bae
-    // ba
-    // ble
-    // bl
-    // bo
-    // bcc
-    // bcs
-    //
-    // jsr  - equivalent to call (encode tail flag?)
+    //
+    //  after a cmp lhs, rhs:
+    //
+    // bg   (signed lhs > rhs)      ba   (unsigned lhs > rhs)
+    // bge  (signed lhs >= rhs)     bae  (unsigned lhs >= rhs)
+    // bl   (signed lhs < rhs)      bb   (unsigned lhs < rhs)
+    // ble  (signed lhs <= rhs)     bbe  (unsigned lhs <= rhs)
+    //
+    //  cmp sets zero, carry (unsigned borrow), overflow (signed overflow of
+    //  lhs - rhs) and negative (sign of lhs - rhs).  it only records its
+    //  operands, though: FR is worked out when an instruction reads or changes
+    //  it, so a cmp followed by a conditional branch never writes flags.
+    //
+    // jsr  - equivalent to call
     //          push current PC + sizeof(instruction)
     //          jmp to address
     //
+    // tjsr - tail call: jmp to address without pushing a return address,
+    //          the callee reuses the current frame and returns to our caller
+    //
     // ret  - jump to address on stack
     //
     // jmp
@@ -147,12 +191,79 @@ namespace basecode {
     //
     // nop
     //
+    // packed vector
+    // ---------------
+    //
+    // vload  {V}, [{address-register}, offset constant]
+    // vstore {V}, [{address-register}, offset constant]
+    // vsplat {V}, {F register or float constant}
+    //
+    // vadd/vsub/vmul/vmin/vmax {V target}, {V lhs}, {V rhs}
+    // vfma   {V target}, {V lhs}, {V rhs}, {V addend}
+    //
+    // vhadd/vhmin/vhmax {F target}, {V}     (horizontal reductions)
+    //
+    // threads and atomics
+    // --------------------
+    //
+    // spawn  {id target}, {entry}, {argument}
+    //      starts a guest thread at `entry` on a host worker.  it shares the
+    //      heap, gets its own register file with I0 = argument and a stack of
+    //      heap_options_t::thread_stack_size bytes from the allocator pool.
+    // join   {target}, {id}
+    //      waits for the thread to exit and receives its I0.
+    //
+    //  a store into code any thread on the heap has verified, compiled or
+    //  cached invalidates it in every thread.  resetting or destroying the
+    //  terp that owns the heap cancels its guest threads (they fail with
+    //  B021) instead of waiting for them to exit.
+    //
+    // aload  {target}, {address}
+    // astore {value}, {address}
+    // cas    {target}, {address}, {expected}, {desired}
+    //      target receives the old value; the zero flag is set when it swapped
+    // xadd   {target}, {address}, {addend}
+    //      fetch-and-add, target receives the old value
+    //
+    //  atomics work on 8-byte aligned qwords and are sequentially consistent.
+    //  plain load/store give no ordering guarantees between threads.
+    //
+    // wait   {address}, {expected}
+    //      futex-style: sleeps while the qword at address equals expected,
+    //      until a notify on the address; wakeups may be spurious.
+    // notify {address}
+    //      wakes every thread waiting on the address.
+    //
+    // channels
+    // ---------
+    //
+    // send {target}, {channel id}, {address}, {length}
+    //      copies length bytes of heap into the channel's next slot; target
+    //      receives 1 when sent, 0 when the ring is full.
+    // recv {target}, {channel id}, {address}
+    //      copies the next message to address, which needs room for the
+    //      channel's message_size; target receives its length, 0 when empty.
+    //
+    //  channel ids are looked up in the registry given to terp::channels().
+    //  terps sharing a heap (spawned threads) hand a buffer over without
+    //  copying it by sending its address: an alloc'd block then belongs to
+    //  whoever received it, and that side frees it.
+    //
+    // host calls
+    // -----------
+    //
+    // hcall {id constant} - invoke host function `id`; its result lands in I0.
+    //                       the host may suspend the terp until the result is ready.
+    //
+
+    using vector4d_t = double __attribute__((vector_size(32)));
 
     struct register_file_t {
         enum flags_t : uint16_t {
             zero     = 0b0000000000000000000000000000000000000000000000000000000000000001,
             carry    = 0b0000000000000000000000000000000000000000000000000000000000000010,
             overflow = 0b0000000000000000000000000000000000000000000000000000000000000100,
+            negative = 0b0000000000000000000000000000000000000000000000000000000000001000,
         };
 
         bool flags(flags_t f) const {
@@ -168,6 +279,7 @@ namespace basecode {
 
         uint64_t i[64];
         double f[64];
+        vector4d_t v[16];
         uint64_t pc;
         uint64_t sp;
         uint64_t fr;
@@ -180,15 +292,23 @@ namespace basecode {
         store,
         copy,
         fill,
+        cmpm,
+        find,
+        alloc,
+        free,
         move,
         push,
         pop,
         inc,
         dec,
         add,
+        addc,
         sub,
+        subc,
         mul,
+        mulx,
         div,
+        divx,
         mod,
         neg,
         shr,
@@ -213,9 +333,37 @@ namespace basecode {
         bl,
         bge,
         ble,
+        ba,
+        bae,
+        bb,
+        bbe,
         jsr,
+        tjsr,
         rts,
         jmp,
+        vload,
+        vstore,
+        vsplat,
+        vadd,
+        vsub,
+        vmul,
+        vmin,
+        vmax,
+        vfma,
+        vhadd,
+        vhmin,
+        vhmax,
+        spawn,
+        join,
+        aload,
+        astore,
+        cas,
+        xadd,
+        wait,
+        notify,
+        send,
+        recv,
+        hcall,
         meta,
         debug,
         exit,
@@ -232,6 +380,7 @@ namespace basecode {
     enum class operand_types : uint8_t {
         register_integer,
         register_floating_point,
+        register_vector,
         register_sp,
         register_pc,
         register_flags,
@@ -259,6 +408,7 @@ namespace basecode {
 
     struct instruction_t {
         static const size_t base_size = 4;
+        static const size_t max_operands = 4;
 
         size_t align(uint64_t value, size_t size) const {
             auto offset = value % size;
@@ -276,6 +426,10 @@ namespace basecode {
             op = static_cast<op_codes>(*(encoding_ptr + 1));
             size = static_cast<op_sizes>(static_cast<uint8_t>(*(encoding_ptr + 2)));
             operands_count = static_cast<uint8_t>(*(encoding_ptr + 3));
+            if (operands_count > max_operands) {
+                r.add_message("B004", "Instructions cannot have more than four operands.", true);
+                return 0;
+            }
 
             size_t offset = base_size;
             for (size_t i = 0; i < operands_count; i++) {
@@ -397,7 +551,242 @@ namespace basecode {
         op_codes op = op_codes::nop;
         op_sizes size = op_sizes::none;
         uint8_t operands_count = 0;
-        operand_encoding_t operands[4];
+        operand_encoding_t operands[max_operands];
+    };
+
+    // per-call-site inline cache for jsr.  direct call sites only ever see a single
+    // target; indirect call sites (jsr I4) keep up to max_entries targets before
+    // they start replacing entries round-robin.  each entry holds the decoded first
+    // instruction of the callee so the step after the jsr can skip decoding it;
+    // an inst_size of zero means it has to be decoded again.
+    struct call_site_cache_t {
+        static const size_t max_entries = 4;
+
+        struct entry_t {
+            uint64_t target = 0;
+            size_t inst_size = 0;
+            instruction_t inst {};
+        };
+
+        entry_t* find(uint64_t target) {
+            for (size_t i = 0; i < count; i++) {
+                if (entries[i].target == target)
+                    return &entries[i];
+            }
+            return nullptr;
+        }
+
+        entry_t* insert(uint64_t target) {
+            entry_t* entry;
+            if (count < max_entries) {
+                entry = &entries[count++];
+            } else {
+                entry = &entries[next];
+                next = static_cast<uint8_t>((next + 1) % max_entries);
+            }
+            entry->target = target;
+            return entry;
+        }
+
+        bool is_polymorphic() const {
+            return count > 1;
+        }
+
+        uint64_t site = UINT64_MAX;
+        uint8_t count = 0;
+        uint8_t next = 0;
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        entry_t entries[max_entries];
+    };
+
+    // a hot loop promoted to the loop tier: on-stack replacement for loops
+    // that are entered once and spin for a long time.  the interpreter counts
+    // taken backward branches per branch; at the threshold the range from the
+    // branch target through the branch is decoded and verified once, and the
+    // terp switches to it mid-execution at the loop head.  both tiers share
+    // the register file, so no state has to be transferred.
+    //
+    // control leaving the range, running out of fuel or reaching a call or
+    // return drops back to the interpreter; a store into any compiled range
+    // deoptimizes every compiled loop, which then has to get hot again.
+    struct osr_loop_t {
+        struct decoded_t {
+            size_t size = 0;
+            instruction_t inst {};
+        };
+
+        bool is_compiled() const {
+            return !instructions.empty();
+        }
+
+        uint64_t start = 0;
+        uint64_t end = 0;
+        bool rejected = false;
+        uint64_t back_edges = 0;
+        uint64_t entries = 0;
+        uint64_t side_exits = 0;
+        uint64_t deopts = 0;
+        // instruction index for each 8-byte slot of the range, -1 mid-instruction
+        std::vector<int32_t> slots {};
+        std::vector<decoded_t> instructions {};
+    };
+
+    // PC, SP and FR while instructions execute.  run() keeps them in locals
+    // so the host compiler can hold them in registers from one instruction to
+    // the next; they're written back to the register file when the run ends,
+    // around host calls and after a stand-alone step().
+    //
+    // FR is lazy: cmp records its operands and flags_register() derives the
+    // flags from them on demand.  single flag writes made while a compare is
+    // pending (branches clearing zero, add/sub setting carry) go into set and
+    // clear masks applied on top of the derived value, so they don't force
+    // the compare to be evaluated.
+    struct hot_registers_t {
+        static const uint64_t compare_flags =
+            register_file_t::flags_t::zero
+            | register_file_t::flags_t::carry
+            | register_file_t::flags_t::overflow
+            | register_file_t::flags_t::negative;
+
+        void compare(uint64_t lhs, uint64_t rhs) {
+            compare_lhs = lhs;
+            compare_rhs = rhs;
+            compare_pending = true;
+            flags_set &= ~compare_flags;
+            flags_clear &= ~compare_flags;
+        }
+
+        uint64_t flags_register() const {
+            if (!compare_pending)
+                return fr;
+            return (compared_flags() & ~flags_clear) | flags_set;
+        }
+
+        uint64_t compared_flags() const {
+            auto difference = compare_lhs - compare_rhs;
+            auto value = fr & ~compare_flags;
+            if (difference == 0)
+                value |= register_file_t::flags_t::zero;
+            if (compare_rhs > compare_lhs)
+                value |= register_file_t::flags_t::carry;
+            if (((compare_lhs ^ compare_rhs) & (compare_lhs ^ difference)) >> 63)
+                value |= register_file_t::flags_t::overflow;
+            if (difference >> 63)
+                value |= register_file_t::flags_t::negative;
+            return value;
+        }
+
+        void flags_register(uint64_t value) {
+            fr = value;
+            compare_pending = false;
+            flags_set = 0;
+            flags_clear = 0;
+        }
+
+        bool flags(register_file_t::flags_t f) const {
+            if (compare_pending) {
+                if ((flags_set & f) != 0)
+                    return true;
+                if ((flags_clear & f) != 0)
+                    return false;
+            }
+            return (flags_register() & f) != 0;
+        }
+
+        void flags(register_file_t::flags_t f, bool value) {
+            if (!compare_pending) {
+                fr = value ? fr | f : fr & ~f;
+            } else if (value) {
+                flags_set |= f;
+                flags_clear &= ~f;
+            } else {
+                flags_clear |= f;
+                flags_set &= ~f;
+            }
+        }
+
+        // bg/bge/bl/ble compare signed, ba/bae/bb/bbe unsigned
+        bool condition(op_codes op) const {
+            auto value = flags_register();
+            auto zero = (value & register_file_t::flags_t::zero) != 0;
+            auto carry = (value & register_file_t::flags_t::carry) != 0;
+            auto less = ((value & register_file_t::flags_t::negative) != 0)
+                != ((value & register_file_t::flags_t::overflow) != 0);
+            switch (op) {
+                case op_codes::bg:  return !zero && !less;
+                case op_codes::bge: return !less;
+                case op_codes::bl:  return less;
+                case op_codes::ble: return zero || less;
+                case op_codes::ba:  return !zero && !carry;
+                case op_codes::bae: return !carry;
+                case op_codes::bb:  return carry;
+                case op_codes::bbe: return zero || carry;
+                default:            return false;
+            }
+        }
+
+        uint64_t pc;
+        uint64_t sp;
+        uint64_t fr;
+        uint64_t compare_lhs = 0;
+        uint64_t compare_rhs = 0;
+        uint64_t flags_set = 0;
+        uint64_t flags_clear = 0;
+        bool compare_pending = false;
+    };
+
+    enum class huge_page_mode : uint8_t {
+        none,
+        transparent,
+        hugetlb,
+    };
+
+    struct heap_options_t {
+        static const int no_numa_node = -1;
+        static const int local_numa_node = -2;
+
+        // reserve the heap as a power-of-two region and mask every guest address
+        // into it.  the reservation beyond heap_size, plus one trailing guard
+        // page, is PROT_NONE: stray accesses fault and run() reports them as a
+        // B014 trap instead of touching host memory.
+        bool masked_addresses = false;
+
+        // when non-zero, the top `stack_size` bytes of the heap are the stack and
+        // the page just below it is a PROT_NONE guard: overflowing pushes trap
+        // with B015 rather than running into code and data, with no check on
+        // the push itself.
+        size_t stack_size = 0;
+
+        // when non-zero, the `allocator_size` bytes just below the stack guard
+        // are managed by a heap_allocator and handed out by alloc/free.  needs
+        // stack_size, otherwise the stack would run straight into the pool.
+        size_t allocator_size = 0;
+
+        // stack for each guest thread started by spawn, carved from the
+        // allocator pool; unlike the main stack it has no guard page.
+        size_t thread_stack_size = 64 * 1024;
+
+        // back the heap with 2MB pages.  transparent aligns the mapping to 2MB
+        // and asks for THP with madvise, quietly keeping 4KB pages wherever the
+        // kernel can't oblige; hugetlb maps from the reserved hugetlbfs pool and
+        // fails with B024 when the pool can't cover the heap.  a hugetlb stack
+        // guard is a whole 2MB page.  heaps cloned from a snapshot are backed by
+        // the snapshot file and keep regular pages.
+        huge_page_mode huge_pages = huge_page_mode::none;
+
+        // NUMA node the heap's pages are bound to.  no_numa_node leaves
+        // placement to the kernel's first-touch policy; local_numa_node picks
+        // the node of the thread calling initialize(), so initialize each terp
+        // on the worker that will run it (see terp::bind_heap for moving it).
+        int numa_node = no_numa_node;
+    };
+
+    enum class run_status : uint8_t {
+        exited,
+        yielded,
+        suspended,
+        failed,
     };
 
     struct debug_information_t {
@@ -410,7 +799,17 @@ namespace basecode {
 
     class terp {
     public:
-        explicit terp(size_t heap_size);  // `heap_size` Bytes
+        static const uint64_t default_osr_threshold = 1000;
+
+        static const size_t call_site_slots = 1024;
+
+        // bump whenever the encoding, the verifier's rules or the decoded
+        // forms change: code_cache entries are keyed by it
+        static const uint32_t vm_version = 1;
+
+        explicit terp(
+                size_t heap_size,       // `heap_size` Bytes
+                const heap_options_t& options = {});
 
         virtual ~terp();
 
@@ -420,6 +819,20 @@ namespace basecode {
 
         bool step(result& r);
 
+        // executes until the program exits, fails, or `budget` basic blocks have
+        // been entered; a yielded terp picks up where it left off on the next run.
+        run_status run(result& r, uint64_t budget = UINT64_MAX);
+
+        uint64_t fuel() const;
+
+        bool is_suspended() const;
+
+        void complete_host_call(uint64_t value);
+
+        void host_functions(const host_function_registry* registry);
+
+        void channels(const channel_registry* registry);
+
         bool has_exited() const;
 
         inline uint8_t* heap() {
@@ -432,6 +845,15 @@ namespace basecode {
 
         bool initialize(result& r);
 
+        bool initialize(result& r, const terp_snapshot& snapshot);
+
+        // rebinds the heap to `numa_node` (or the caller's node, given
+        // heap_options_t::local_numa_node) and migrates the pages already
+        // there, for when a terp moves to a worker on another socket.
+        bool bind_heap(result& r, int numa_node);
+
+        bool snapshot(result& r, terp_snapshot& snapshot) const;
+
         void dump_state(uint8_t count = 16);
 
         const register_file_t& register_file() const;
@@ -442,18 +864,80 @@ namespace basecode {
 
         std::string disassemble(const instruction_t& inst) const;
 
+        const call_site_cache_t* call_site(uint64_t address) const;
+
+        // jsr executions that reached `target` through monomorphic call sites.
+        // call sites share call_site_slots cache slots by address, so a site
+        // evicted by a colliding one loses its counts.
+        uint64_t call_count(uint64_t target) const;
+
+        // true only at an instruction boundary the verifier found, so an rts,
+        // indirect jsr or spawn landing mid-instruction takes the checked path
+        bool is_verified(uint64_t address) const;
+
+        // deepest stack use since the last reset, in bytes below the top of the
+        // heap; only tracked when heap_options_t::stack_size is set
+        size_t stack_high_water() const;
+
+        // `boundaries` are the addresses of the instructions in [start, end)
+        void mark_verified(uint64_t start, uint64_t end, const std::vector<uint64_t>& boundaries);
+
+        // calls to a pure function are answered from the memo table when the
+        // argument on top of the stack has been seen before.  the function must
+        // follow the single-slot convention: it reads its argument at SP+8 and
+        // replaces it with its result before rts.  reset() forgets pure marks.
+        void mark_pure(uint64_t address);
+
+        const memo_table& memo() const;
+
+        // taken backward branches before a loop is promoted; zero disables it
+        void osr_threshold(uint64_t back_edges);
+
+        // keyed by the address of the loop's backward branch
+        const osr_loop_t* osr_loop(uint64_t branch_address) const;
+
+        // records the verified range and the compiled loops lying inside
+        // [start, end), the program code_cache::program_key hashed
+        void save_to_cache(code_cache_sections& sections, uint64_t start, uint64_t end) const;
+
+        // installs what save_to_cache() recorded, for the same program
+        // encoded at the same address: the verifier and the loop tier's
+        // warm-up are skipped
+        bool restore_from_cache(result& r, const code_cache_entry& entry);
+
     protected:
         bool set_target_operand_value(
-                result& r, const instruction_t& instruction, uint8_t operand_index, uint64_t value);
+                result& r,
+                hot_registers_t& hot,
+                const instruction_t& instruction,
+                uint8_t operand_index,
+                uint64_t value);
 
         bool set_target_operand_value(
-                result& r, const instruction_t& instruction, uint8_t operand_index, double value);
+                result& r,
+                hot_registers_t& hot,
+                const instruction_t& instruction,
+                uint8_t operand_index,
+                double value);
 
         bool get_operand_value(
-                result& r, const instruction_t& instruction, uint8_t operand_index, uint64_t& value) const;
+                result& r,
+                const hot_registers_t& hot,
+                const instruction_t& instruction,
+                uint8_t operand_index,
+                uint64_t& value) const;
 
         bool get_operand_value(
-                result& r, const instruction_t& instruction, uint8_t operand_index, double& value) const;
+                result& r,
+                const hot_registers_t& hot,
+                const instruction_t& instruction,
+                uint8_t operand_index,
+                double& value) const;
+
+        bool enter_call_target(
+                result& r,
+                uint64_t site_address,
+                uint64_t address);
 
         inline uint8_t op_size_in_bytes(op_sizes size) const {
             switch (size) {
@@ -466,17 +950,193 @@ namespace basecode {
         }
 
     private:
+        void free_heap();
+
+        bool map_heap(result& r, int fd);
+
+        bool protect_stack();
+
+        bool bind_pages(result& r, int numa_node, bool migrate);
+
+        bool attach_allocator();
+
+        void attach_thread(const terp& parent, uint64_t entry, uint64_t argument, uint64_t stack_top);
+
+        bool spawn_thread(result& r, uint64_t entry, uint64_t argument, uint64_t& id);
+
+        bool join_thread(result& r, uint64_t id, uint64_t& value);
+
+        void join_all_threads();
+
+        size_t decode_checked(result& r, instruction_t& inst, uint64_t address);
+
+        bool memo_lookup(uint64_t sp, uint64_t address);
+
+        void memo_return(uint64_t sp);
+
+        run_status run_loop(result& r);
+
+        // stores a completed host call's result into I0; returns the state left
+        uint8_t poll_host_call();
+
+        bool step(result& r, hot_registers_t& hot);
+
+        bool execute(
+                result& r,
+                hot_registers_t& hot,
+                const instruction_t& inst,
+                uint64_t inst_address,
+                size_t inst_size);
+
+        bool compile_loop(osr_loop_t& loop, uint64_t start, uint64_t end);
+
+        bool run_compiled_loop(result& r, hot_registers_t& hot, osr_loop_t& loop);
+
+        void invalidate_compiled_loops();
+
+        void invalidate_call_targets();
+
+        void invalidate_code();
+
+        void share_code_range(uint64_t start, uint64_t end);
+
+        void publish_code_store();
+
+        bool sync_shared_state(result& r);
+
+        inline bool has_guard_regions() const {
+            return _options.masked_addresses || _options.stack_size > 0;
+        }
+
+        inline bool check_range(result& r, uint64_t address, uint64_t length) const {
+            if (address > _heap_size || length > _heap_size - address) {
+                r.add_message(
+                        "B014",
+                        "bulk memory access outside of the heap.",
+                        true);
+                return false;
+            }
+            return true;
+        }
+
+        // `count` elements of `width` bytes; the byte count itself could wrap
+        inline bool check_elements(result& r, uint64_t address, uint64_t count, size_t width) const {
+            if (address > _heap_size || (width != 0 && count > (_heap_size - address) / width)) {
+                r.add_message(
+                        "B014",
+                        "bulk memory access outside of the heap.",
+                        true);
+                return false;
+            }
+            return true;
+        }
+
+        // does [address, address + length) touch [start, end)?  written so
+        // neither side can wrap
+        static inline bool overlaps(uint64_t address, uint64_t length, uint64_t start, uint64_t end) {
+            if (length == 0 || address >= end)
+                return false;
+            return address >= start || length > start - address;
+        }
+
+        inline void heap_written(uint64_t address, uint64_t length) {
+            // stores land at the masked address, so an alias above the heap
+            // has to invalidate the same ranges
+            address &= _address_mask;
+            // self-modifying code voids whatever the verifier proved about it
+            if (overlaps(address, length, _verified_start, _verified_end)) {
+                _verified_start = 0;
+                _verified_end = 0;
+                _verified_boundaries.clear();
+            }
+            if (overlaps(address, length, _osr_code_start, _osr_code_end))
+                invalidate_compiled_loops();
+            if (overlaps(address, length, _call_code_start, _call_code_end))
+                invalidate_call_targets();
+            // other threads hear about it once the store has landed
+            if (_shared != nullptr
+            &&  overlaps(
+                    address,
+                    length,
+                    _shared->code_start.load(std::memory_order_relaxed),
+                    _shared->code_end.load(std::memory_order_relaxed)))
+                _code_stored = true;
+        }
+
+    private:
+        // what the terps on one heap have to agree on: a code epoch bumped by
+        // every store into code any of them decoded ahead, and the owner's
+        // cancellation of its guest threads
+        struct heap_shared_state_t {
+            std::atomic<uint64_t> code_epoch {0};
+            std::atomic<uint64_t> code_start {UINT64_MAX};
+            std::atomic<uint64_t> code_end {0};
+            std::atomic<bool> cancelled {false};
+        };
+
+        struct guest_thread_t {
+            uint64_t stack = 0;
+            std::unique_ptr<terp> interpreter {};
+            result r {};
+            run_status status = run_status::failed;
+            std::thread worker {};
+        };
+
+    private:
+        // a pure call in flight: its result is recorded when rts pops the
+        // return address stored at `sp`
+        struct memo_frame_t {
+            uint64_t function;
+            uint64_t argument;
+            uint64_t sp;
+        };
+
+    private:
+        // instruction fetch wraps like data accesses: with masked addresses a
+        // wild PC lands in the reservation, where a fault becomes a B014 trap
+        inline size_t decode_at(result& r, instruction_t& inst, uint64_t address) {
+            return inst.decode(r, _heap, address & _address_mask);
+        }
+
+        // _address_mask is all ones unless the heap uses masked addresses
         inline uint8_t* byte_ptr(uint64_t address) const {
-            return _heap + address;
+            return _heap + (address & _address_mask);
         }
         inline uint16_t* word_ptr(uint64_t address) const {
-            return reinterpret_cast<uint16_t*>(_heap + address);
+            return reinterpret_cast<uint16_t*>(_heap + (address & _address_mask));
         }
         inline uint32_t* dword_ptr(uint64_t address) const {
-            return reinterpret_cast<uint32_t*>(_heap + address);
+            return reinterpret_cast<uint32_t*>(_heap + (address & _address_mask));
         }
         inline uint64_t* qword_ptr(uint64_t address) const {
-            return reinterpret_cast<uint64_t*>(_heap + address);
+            return reinterpret_cast<uint64_t*>(_heap + (address & _address_mask));
+        }
+        inline hot_registers_t load_hot_registers() const {
+            return hot_registers_t {_registers.pc, _registers.sp, _registers.fr};
+        }
+        inline void spill_hot_registers(const hot_registers_t& hot) {
+            _registers.pc = hot.pc;
+            _registers.sp = hot.sp;
+            _registers.fr = hot.flags_register();
+        }
+        // every push is its own instruction, so the lowest SP seen between
+        // instructions is the deepest the stack went
+        inline void track_stack_depth(const hot_registers_t& hot) {
+            if (hot.sp < _stack_low_water)
+                _stack_low_water = hot.sp;
+        }
+
+        inline void push(hot_registers_t& hot, uint64_t value) {
+            hot.sp -= sizeof(uint64_t);
+            *qword_ptr(hot.sp) = value;
+        }
+        inline uint64_t pop(hot_registers_t& hot) {
+            uint64_t value = *qword_ptr(hot.sp);
+            hot.sp += sizeof(uint64_t);
+            return value;
+        }
+        inline vector4d_t& vector_operand(const instruction_t& instruction, uint8_t operand_index) {
+            return _registers.v[instruction.operands[operand_index].index];
         }
 
 
@@ -487,15 +1147,23 @@ namespace basecode {
             {op_codes::store,  "STORE"},
             {op_codes::copy,   "COPY"},
             {op_codes::fill,   "FILL"},
+            {op_codes::cmpm,   "CMPM"},
+            {op_codes::find,   "FIND"},
+            {op_codes::alloc,  "ALLOC"},
+            {op_codes::free,   "FREE"},
             {op_codes::move,   "MOVE"},
             {op_codes::push,   "PUSH"},
             {op_codes::pop,    "POP"},
             {op_codes::inc,    "INC"},
             {op_codes::dec,    "DEC"},
             {op_codes::add,    "ADD"},
+            {op_codes::addc,   "ADDC"},
             {op_codes::sub,    "SUB"},
+            {op_codes::subc,   "SUBC"},
             {op_codes::mul,    "MUL"},
+            {op_codes::mulx,   "MULX"},
             {op_codes::div,    "DIV"},
+            {op_codes::divx,   "DIVX"},
             {op_codes::mod,    "MOD"},
             {op_codes::neg,    "NEG"},
             {op_codes::shr,    "SHR"},
@@ -520,17 +1188,92 @@ namespace basecode {
             {op_codes::bge,    "BGE"},
             {op_codes::bl,     "BL"},
             {op_codes::ble,    "BLE"},
+            {op_codes::ba,     "BA"},
+            {op_codes::bae,    "BAE"},
+            {op_codes::bb,     "BB"},
+            {op_codes::bbe,    "BBE"},
             {op_codes::jsr,    "JSR"},
+            {op_codes::tjsr,   "TJSR"},
             {op_codes::rts,    "RTS"},
             {op_codes::jmp,    "JMP"},
+            {op_codes::vload,  "VLOAD"},
+            {op_codes::vstore, "VSTORE"},
+            {op_codes::vsplat, "VSPLAT"},
+            {op_codes::vadd,   "VADD"},
+            {op_codes::vsub,   "VSUB"},
+            {op_codes::vmul,   "VMUL"},
+            {op_codes::vmin,   "VMIN"},
+            {op_codes::vmax,   "VMAX"},
+            {op_codes::vfma,   "VFMA"},
+            {op_codes::vhadd,  "VHADD"},
+            {op_codes::vhmin,  "VHMIN"},
+            {op_codes::vhmax,  "VHMAX"},
+            {op_codes::spawn,  "SPAWN"},
+            {op_codes::join,   "JOIN"},
+            {op_codes::aload,  "ALOAD"},
+            {op_codes::astore, "ASTORE"},
+            {op_codes::cas,    "CAS"},
+            {op_codes::xadd,   "XADD"},
+            {op_codes::wait,   "WAIT"},
+            {op_codes::notify, "NOTIFY"},
+            {op_codes::send,   "SEND"},
+            {op_codes::recv,   "RECV"},
+            {op_codes::hcall,  "HCALL"},
             {op_codes::meta,   "META"},
             {op_codes::debug,  "DEBUG"},
             {op_codes::exit,   "EXIT"},
         };
         bool _exited = false;
+        // pending from just before a host function is invoked until the terp
+        // picks up its result, so a completion that arrives before the
+        // function even returns is still recorded
+        enum host_call_state : uint8_t {
+            host_call_idle,
+            host_call_pending,
+            host_call_completed,
+        };
+        std::atomic<uint8_t> _host_call {host_call_idle};
+        uint64_t _host_call_value = 0;
+        uint64_t _stack_low_water = 0;
         size_t _heap_size = 0;
+        size_t _mapping_size = 0;
+        size_t _page_size = 0;
         uint8_t* _heap = nullptr;
+        uint64_t _address_mask = UINT64_MAX;
+        uint64_t _stack_guard = 0;
+        size_t _guard_size = 0;
+        heap_options_t _options {};
+        heap_allocator _allocator {};
         register_file_t _registers {};
+        uint64_t _fuel = UINT64_MAX;
+        uint64_t _verified_start = 0;
+        uint64_t _verified_end = 0;
+        // one bit per 8-byte slot of the verified range
+        std::vector<uint64_t> _verified_boundaries {};
+        const host_function_registry* _host_functions = nullptr;
+        const channel_registry* _channels = nullptr;
+        const call_site_cache_t::entry_t* _call_target = nullptr;
+        // direct mapped by site address; allocated by the first jsr
+        std::vector<call_site_cache_t> _call_sites {};
+        uint64_t _call_code_start = UINT64_MAX;
+        uint64_t _call_code_end = 0;
+        uint64_t _osr_threshold = default_osr_threshold;
+        osr_loop_t* _osr_entry = nullptr;
+        bool _osr_invalidated = false;
+        uint64_t _osr_code_start = UINT64_MAX;
+        uint64_t _osr_code_end = 0;
+        std::unordered_map<uint64_t, osr_loop_t> _osr_loops {};
+        std::unordered_set<uint64_t> _pure_functions {};
+        std::vector<memo_frame_t> _memo_frames {};
+        memo_table _memo {};
+        // guest threads keep the heap mapped by their parent
+        bool _owns_heap = true;
+        // slot `id - 1` holds the thread spawn returned `id` for, until joined
+        std::vector<std::unique_ptr<guest_thread_t>> _threads {};
+        // set by the first spawn, shared with every thread on the heap
+        std::shared_ptr<heap_shared_state_t> _shared {};
+        uint64_t _code_epoch = 0;
+        bool _code_stored = false;
 
     };
 
@@ -0,0 +1,34 @@
+#include <unistd.h>
+#include "terp_snapshot.h"
+
+namespace basecode {
+
+    terp_snapshot::~terp_snapshot() {
+        release();
+    }
+
+    void terp_snapshot::release() {
+        if (_fd != -1) {
+            close(_fd);
+            _fd = -1;
+        }
+        _heap_size = 0;
+    }
+
+    bool terp_snapshot::is_valid() const {
+        return _fd != -1;
+    }
+
+    size_t terp_snapshot::heap_size() const {
+        return _heap_size;
+    }
+
+    const heap_options_t& terp_snapshot::options() const {
+        return _options;
+    }
+
+    const register_file_t& terp_snapshot::register_file() const {
+        return _registers;
+    }
+
+};
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include "terp.h"
+
+namespace basecode {
+
+    // frozen copy of a terp's heap and register file.  the heap image lives in
+    // an anonymous memory file (memfd) so any number of terps can be forked from
+    // it by mapping the file MAP_PRIVATE: pages are shared until a clone writes
+    // to them, which makes creating a pre-warmed terp a single mmap call.
+    // the source's heap_options_t travel with the image, so a clone gets the
+    // same stack guard, allocator and address masking whatever options it
+    // was constructed with.
+    class terp_snapshot {
+    public:
+        terp_snapshot() = default;
+
+        terp_snapshot(const terp_snapshot&) = delete;
+
+        terp_snapshot& operator=(const terp_snapshot&) = delete;
+
+        virtual ~terp_snapshot();
+
+        void release();
+
+        bool is_valid() const;
+
+        size_t heap_size() const;
+
+        const heap_options_t& options() const;
+
+        const register_file_t& register_file() const;
+
+    private:
+        friend class terp;
+
+        int _fd = -1;
+        bool _exited = false;
+        size_t _heap_size = 0;
+        heap_options_t _options {};
+        register_file_t _registers {};
+    };
+
+};
@@ -0,0 +1,535 @@
+#include <deque>
+#include <algorithm>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+#include <fmt/format.h>
+#include "verifier.h"
+
+namespace basecode {
+
+    enum class operand_kinds : uint8_t {
+        none,
+        scalar,
+        target,
+        integer_register,
+        vector_register,
+    };
+
+    struct operand_shape_t {
+        uint8_t min_count = 0;
+        uint8_t max_count = 0;
+        operand_kinds kinds[instruction_t::max_operands] {};
+    };
+
+    static bool operand_shape(op_codes op, operand_shape_t& shape) {
+        using k = operand_kinds;
+        switch (op) {
+            case op_codes::nop:
+            case op_codes::rts:
+            case op_codes::exit:
+                shape = {0, 0, {}};
+                break;
+            case op_codes::test:
+            case op_codes::meta:
+            case op_codes::debug:
+                shape = {0, 4, {k::scalar, k::scalar, k::scalar, k::scalar}};
+                break;
+            case op_codes::load:
+                shape = {2, 3, {k::target, k::scalar, k::scalar}};
+                break;
+            case op_codes::store:
+                shape = {2, 3, {k::scalar, k::scalar, k::scalar}};
+                break;
+            case op_codes::copy:
+            case op_codes::fill:
+            case op_codes::tbz:
+            case op_codes::tbnz:
+                shape = {3, 3, {k::scalar, k::scalar, k::scalar}};
+                break;
+            case op_codes::cmpm:
+            case op_codes::find:
+                shape = {4, 4, {k::target, k::scalar, k::scalar, k::scalar}};
+                break;
+            case op_codes::move:
+                shape = {2, 2, {k::scalar, k::target}};
+                break;
+            case op_codes::push:
+            case op_codes::bne:
+            case op_codes::beq:
+            case op_codes::bg:
+            case op_codes::bl:
+            case op_codes::bge:
+            case op_codes::ble:
+            case op_codes::ba:
+            case op_codes::bae:
+            case op_codes::bb:
+            case op_codes::bbe:
+            case op_codes::jsr:
+            case op_codes::tjsr:
+            case op_codes::jmp:
+            case op_codes::hcall:
+                shape = {1, 1, {k::scalar}};
+                break;
+            case op_codes::alloc:
+                shape = {2, 2, {k::target, k::scalar}};
+                break;
+            case op_codes::free:
+                shape = {1, 1, {k::scalar}};
+                break;
+            case op_codes::pop:
+                shape = {1, 1, {k::target}};
+                break;
+            case op_codes::inc:
+            case op_codes::dec:
+                shape = {1, 1, {k::integer_register}};
+                break;
+            case op_codes::add:
+            case op_codes::addc:
+            case op_codes::sub:
+            case op_codes::subc:
+            case op_codes::mul:
+            case op_codes::div:
+            case op_codes::mod:
+            case op_codes::shr:
+            case op_codes::shl:
+            case op_codes::ror:
+            case op_codes::rol:
+            case op_codes::and_op:
+            case op_codes::or_op:
+            case op_codes::xor_op:
+            case op_codes::bis:
+            case op_codes::bic:
+                shape = {3, 3, {k::target, k::scalar, k::scalar}};
+                break;
+            case op_codes::mulx:
+                shape = {4, 4, {k::target, k::target, k::scalar, k::scalar}};
+                break;
+            case op_codes::divx:
+                shape = {3, 3, {k::integer_register, k::integer_register, k::scalar}};
+                break;
+            case op_codes::neg:
+            case op_codes::not_op:
+                shape = {2, 2, {k::target, k::scalar}};
+                break;
+            case op_codes::cmp:
+            case op_codes::bz:
+            case op_codes::bnz:
+                shape = {2, 2, {k::scalar, k::scalar}};
+                break;
+            case op_codes::vload:
+            case op_codes::vstore:
+                shape = {2, 3, {k::vector_register, k::scalar, k::scalar}};
+                break;
+            case op_codes::vsplat:
+                shape = {2, 2, {k::vector_register, k::scalar}};
+                break;
+            case op_codes::vadd:
+            case op_codes::vsub:
+            case op_codes::vmul:
+            case op_codes::vmin:
+            case op_codes::vmax:
+                shape = {3, 3, {k::vector_register, k::vector_register, k::vector_register}};
+                break;
+            case op_codes::vfma:
+                shape = {4, 4, {k::vector_register, k::vector_register, k::vector_register, k::vector_register}};
+                break;
+            case op_codes::vhadd:
+            case op_codes::vhmin:
+            case op_codes::vhmax:
+                shape = {2, 2, {k::target, k::vector_register}};
+                break;
+            case op_codes::spawn:
+            case op_codes::xadd:
+            case op_codes::recv:
+                shape = {3, 3, {k::target, k::scalar, k::scalar}};
+                break;
+            case op_codes::join:
+            case op_codes::aload:
+                shape = {2, 2, {k::target, k::scalar}};
+                break;
+            case op_codes::astore:
+            case op_codes::wait:
+                shape = {2, 2, {k::scalar, k::scalar}};
+                break;
+            case op_codes::cas:
+            case op_codes::send:
+                shape = {4, 4, {k::target, k::scalar, k::scalar, k::scalar}};
+                break;
+            case op_codes::notify:
+                shape = {1, 1, {k::scalar}};
+                break;
+            default:
+                return false;
+        }
+        return true;
+    }
+
+    static bool is_register(operand_types type) {
+        switch (type) {
+            case operand_types::register_integer:
+            case operand_types::register_floating_point:
+            case operand_types::register_sp:
+            case operand_types::register_pc:
+            case operand_types::register_flags:
+            case operand_types::register_status:
+            case operand_types::increment_register_pre:
+            case operand_types::increment_register_post:
+            case operand_types::decrement_register_pre:
+            case operand_types::decrement_register_post:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    static bool writes_sp(const instruction_t& inst) {
+        operand_shape_t shape;
+        if (!operand_shape(inst.op, shape))
+            return false;
+        for (size_t i = 0; i < inst.operands_count; i++) {
+            if (shape.kinds[i] == operand_kinds::target
+            &&  inst.operands[i].type == operand_types::register_sp)
+                return true;
+        }
+        return false;
+    }
+
+    verifier::verifier(terp& terp) : _terp(terp) {
+    }
+
+    bool verifier::branch_target_operand(op_codes op, uint8_t& operand_index) {
+        switch (op) {
+            case op_codes::bz:
+            case op_codes::bnz:
+                operand_index = 1;
+                return true;
+            case op_codes::tbz:
+            case op_codes::tbnz:
+                operand_index = 2;
+                return true;
+            case op_codes::bne:
+            case op_codes::beq:
+            case op_codes::bg:
+            case op_codes::bl:
+            case op_codes::bge:
+            case op_codes::ble:
+            case op_codes::ba:
+            case op_codes::bae:
+            case op_codes::bb:
+            case op_codes::bbe:
+            case op_codes::jsr:
+            case op_codes::tjsr:
+            case op_codes::jmp:
+                operand_index = 0;
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    bool verifier::check_instruction(
+            result& r,
+            const instruction_t& inst,
+            uint64_t address) {
+        auto fail = [&](const std::string& reason) {
+            r.add_message(
+                    "B012",
+                    fmt::format("invalid instruction at ${:08X}: {}.", address, reason),
+                    true);
+            return false;
+        };
+
+        operand_shape_t shape;
+        if (!operand_shape(inst.op, shape))
+            return fail("unknown op code");
+
+        if (inst.size > op_sizes::qword)
+            return fail("unknown operand size");
+
+        if (inst.operands_count < shape.min_count || inst.operands_count > shape.max_count)
+            return fail("wrong number of operands");
+
+        for (size_t i = 0; i < inst.operands_count; i++) {
+            const auto& operand = inst.operands[i];
+            if (operand.type > operand_types::decrement_register_post)
+                return fail("unknown operand type");
+
+            switch (operand.type) {
+                case operand_types::register_vector:
+                    if (operand.index >= 16)
+                        return fail("vector register index out of range");
+                    break;
+                case operand_types::register_integer:
+                case operand_types::register_floating_point:
+                case operand_types::increment_register_pre:
+                case operand_types::increment_register_post:
+                case operand_types::decrement_register_pre:
+                case operand_types::decrement_register_post:
+                    if (operand.index >= 64)
+                        return fail("register index out of range");
+                    break;
+                default:
+                    break;
+            }
+
+            switch (shape.kinds[i]) {
+                case operand_kinds::vector_register:
+                    if (operand.type != operand_types::register_vector)
+                        return fail("operand must be a vector register");
+                    break;
+                case operand_kinds::integer_register:
+                    if (operand.type != operand_types::register_integer)
+                        return fail("operand must be an integer register");
+                    break;
+                case operand_kinds::target:
+                    if (!is_register(operand.type))
+                        return fail("target operand must be a register");
+                    break;
+                default:
+                    if (operand.type == operand_types::register_vector)
+                        return fail("vector register used as a scalar operand");
+                    break;
+            }
+        }
+
+        return true;
+    }
+
+    bool verifier::verify(result& r, uint64_t start, uint64_t end) {
+        auto fail = [&](uint64_t address, const std::string& reason) {
+            r.add_message(
+                    "B013",
+                    fmt::format("verification failed at ${:08X}: {}.", address, reason),
+                    true);
+            return false;
+        };
+
+        if (start % 8 != 0 || end > _terp.heap_size() || start >= end)
+            return fail(start, "invalid code range");
+
+        // pass 1: linear sweep, every instruction must decode and be well formed
+        std::vector<instruction_t> instructions;
+        std::vector<uint64_t> addresses;
+        std::unordered_map<uint64_t, size_t> boundaries;
+
+        auto heap = _terp.heap();
+        for (auto address = start; address < end;) {
+            auto encoding_size = heap[address];
+            if (encoding_size < instruction_t::base_size
+            ||  encoding_size % 8 != 0
+            ||  address + encoding_size > end)
+                return fail(address, "bad instruction encoding size");
+
+            instruction_t inst;
+            if (inst.decode(r, heap, address) == 0)
+                return false;
+            if (inst.encoding_size() != encoding_size)
+                return fail(address, "instruction encoding size mismatch");
+            if (!check_instruction(r, inst, address))
+                return false;
+            if (writes_sp(inst))
+                return fail(address, "stack pointer writes cannot be verified");
+
+            boundaries[address] = instructions.size();
+            instructions.push_back(inst);
+            addresses.push_back(address);
+            address += encoding_size;
+        }
+
+        // pass 2: control flow targets land on instruction boundaries
+        std::deque<size_t> entries {0};
+        for (size_t i = 0; i < instructions.size(); i++) {
+            const auto& inst = instructions[i];
+            uint8_t target_index;
+            if (!branch_target_operand(inst.op, target_index))
+                continue;
+
+            const auto& target = inst.operands[target_index];
+            if (target.type != operand_types::constant_integer) {
+                if (inst.op == op_codes::jsr || inst.op == op_codes::tjsr)
+                    continue;
+                return fail(addresses[i], "indirect branches cannot be verified");
+            }
+
+            auto it = boundaries.find(target.value.u64);
+            if (it == boundaries.end())
+                return fail(addresses[i], "branch target is not an instruction boundary");
+
+            if (inst.op == op_codes::jsr || inst.op == op_codes::tjsr)
+                entries.push_back(it->second);
+        }
+
+        // pass 3: stack depth balance, relative to each function's entry
+        const int64_t unknown_depth = INT64_MIN;
+        std::vector<int64_t> depths(instructions.size(), unknown_depth);
+        std::deque<size_t> work;
+
+        auto flow = [&](size_t index, int64_t depth) {
+            if (depths[index] == unknown_depth) {
+                depths[index] = depth;
+                work.push_back(index);
+                return true;
+            }
+            return depths[index] == depth;
+        };
+
+        struct call_edge_t {
+            uint64_t depth;
+            size_t callee;
+            bool tail;
+        };
+
+        struct function_summary_t {
+            uint64_t local_max = 0;
+            bool indirect_calls = false;
+            std::vector<call_edge_t> calls {};
+        };
+
+        std::unordered_map<size_t, function_summary_t> functions;
+
+        for (auto entry : entries) {
+            if (depths[entry] != unknown_depth) {
+                if (depths[entry] != 0)
+                    return fail(addresses[entry], "function entry reached with unbalanced stack");
+                continue;
+            }
+
+            auto& function = functions[entry];
+            flow(entry, 0);
+            while (!work.empty()) {
+                auto index = work.front();
+                work.pop_front();
+
+                const auto& inst = instructions[index];
+                auto depth = depths[index];
+                auto falls_through = true;
+
+                if (inst.op == op_codes::jsr || inst.op == op_codes::tjsr) {
+                    const auto& target = inst.operands[0];
+                    if (target.type != operand_types::constant_integer) {
+                        function.indirect_calls = true;
+                    } else {
+                        function.calls.push_back(call_edge_t {
+                            static_cast<uint64_t>(depth),
+                            boundaries[target.value.u64],
+                            inst.op == op_codes::tjsr});
+                    }
+                }
+
+                switch (inst.op) {
+                    case op_codes::push:
+                        depth += sizeof(uint64_t);
+                        function.local_max = std::max(function.local_max, static_cast<uint64_t>(depth));
+                        break;
+                    case op_codes::pop:
+                        depth -= sizeof(uint64_t);
+                        if (depth < 0)
+                            return fail(addresses[index], "pop above the function's entry frame");
+                        break;
+                    case op_codes::rts:
+                    case op_codes::tjsr:
+                        if (depth != 0)
+                            return fail(addresses[index], "function returns with unbalanced stack");
+                        falls_through = false;
+                        break;
+                    case op_codes::exit:
+                        falls_through = false;
+                        break;
+                    default:
+                        break;
+                }
+
+                uint8_t target_index;
+                if (inst.op != op_codes::jsr
+                &&  inst.op != op_codes::tjsr
+                &&  branch_target_operand(inst.op, target_index)) {
+                    auto target = boundaries[inst.operands[target_index].value.u64];
+                    if (!flow(target, depth))
+                        return fail(addresses[target], "stack depth differs between incoming paths");
+                    if (inst.op == op_codes::jmp)
+                        falls_through = false;
+                }
+
+                if (falls_through) {
+                    if (index + 1 >= instructions.size())
+                        return fail(addresses[index], "execution falls off the end of the code");
+                    if (!flow(index + 1, depth))
+                        return fail(addresses[index + 1], "stack depth differs between incoming paths");
+                }
+            }
+        }
+
+        // pass 4: worst case stack use per function, including the return
+        // addresses and frames of everything it calls.  recursion through jsr
+        // (or an indirect call) makes the depth unbounded; a cycle made only of
+        // tail calls reuses one frame and adds nothing.
+        const uint64_t unbounded = UINT64_MAX;
+        std::unordered_map<size_t, uint64_t> max_depths;
+        std::vector<size_t> call_stack;
+        std::vector<bool> tail_edges;
+        size_t skipped_cycles = 0;
+
+        std::function<uint64_t (size_t)> max_depth = [&](size_t entry) -> uint64_t {
+            auto cached = max_depths.find(entry);
+            if (cached != max_depths.end())
+                return cached->second;
+
+            const auto& function = functions[entry];
+            if (function.indirect_calls)
+                return max_depths[entry] = unbounded;
+
+            call_stack.push_back(entry);
+            auto cycles_before = skipped_cycles;
+            auto deepest = function.local_max;
+            for (const auto& call : function.calls) {
+                auto on_stack = std::find(call_stack.begin(), call_stack.end(), call.callee);
+                if (on_stack != call_stack.end()) {
+                    auto position = static_cast<size_t>(on_stack - call_stack.begin());
+                    auto all_tail = call.tail;
+                    for (size_t i = position; i < tail_edges.size() && all_tail; i++)
+                        all_tail = tail_edges[i];
+                    if (all_tail) {
+                        skipped_cycles++;
+                        continue;
+                    }
+                    deepest = unbounded;
+                    break;
+                }
+
+                tail_edges.push_back(call.tail);
+                auto callee_depth = max_depth(call.callee);
+                tail_edges.pop_back();
+
+                if (callee_depth == unbounded) {
+                    deepest = unbounded;
+                    break;
+                }
+                auto frame = call.tail ? callee_depth : call.depth + sizeof(uint64_t) + callee_depth;
+                deepest = std::max(deepest, frame);
+            }
+            call_stack.pop_back();
+
+            // depths that came out of an in-progress cycle are not final
+            if (call_stack.empty() || cycles_before == skipped_cycles || deepest == unbounded)
+                max_depths[entry] = deepest;
+            return deepest;
+        };
+
+        _max_stack_depths.clear();
+        for (const auto& function : functions)
+            _max_stack_depths[addresses[function.first]] = max_depth(function.first);
+
+        _terp.mark_verified(start, end, addresses);
+        return true;
+    }
+
+    bool verifier::max_stack_depth(uint64_t address, uint64_t& depth) const {
+        auto it = _max_stack_depths.find(address);
+        if (it == _max_stack_depths.end() || it->second == UINT64_MAX)
+            return false;
+        depth = it->second;
+        return true;
+    }
+
+};
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include "terp.h"
+#include "result.h"
+
+namespace basecode {
+
+    // load-time verifier for encoded base IR.  verify() walks [start, end) and
+    // proves that:
+    //
+    //  - every instruction decodes: known op code, size and operand types, an
+    //    operand count matching the op code, in-range register indexes;
+    //  - every direct branch, jump and call lands on an instruction boundary
+    //    inside the range, and no jump or branch is indirect;
+    //  - within each function the stack is balanced: pushes and pops agree on
+    //    every path, nothing pops above the function's entry and every rts/tjsr
+    //    sees the depth the function was entered with.  SP is never written.
+    //
+    // as a by-product it computes each function's worst case stack use, which
+    // max_stack_depth() reports for sizing heap_options_t::stack_size.
+    //
+    // on success the range's instruction boundaries are marked verified on the
+    // terp, which then runs them without per-instruction checks.  anything
+    // else goes through the checked interpreter, which applies
+    // check_instruction() to each decoded instruction; that includes a return
+    // address, indirect call target or spawn entry that isn't a boundary.
+    class verifier {
+    public:
+        explicit verifier(terp& terp);
+
+        bool verify(result& r, uint64_t start, uint64_t end);
+
+        // bytes of stack the function at `address` may use below its entry sp,
+        // including nested calls; false for recursive or indirectly calling code
+        bool max_stack_depth(uint64_t address, uint64_t& depth) const;
+
+        static bool check_instruction(
+                result& r,
+                const instruction_t& inst,
+                uint64_t address);
+
+        static bool branch_target_operand(op_codes op, uint8_t& operand_index);
+
+    private:
+        terp& _terp;
+        std::unordered_map<uint64_t, uint64_t> _max_stack_depths {};
+    };
+
+};